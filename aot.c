@@ -0,0 +1,317 @@
+#include "aot.h"
+#include "native.h"
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+
+// The vm_ops.h operation of a binary command, or NULL if code is not a binary command.
+static const char *aot_binary_op(Byte code) {
+	switch (code) {
+	case CMD_ADD: return "vm_op_add";
+	case CMD_SUB: return "vm_op_sub";
+	case CMD_MULT: return "vm_op_mult";
+	case CMD_DIV: return "vm_op_div";
+	case CMD_AND: return "vm_op_and";
+	case CMD_OR: return "vm_op_or";
+	case CMD_XOR: return "vm_op_xor";
+	case CMD_LSHIFT: return "vm_op_lshift";
+	case CMD_RSHIFT: return "vm_op_rshift";
+	case CMD_GREATER: return "vm_op_greater";
+	case CMD_LESS: return "vm_op_less";
+	case CMD_EQUAL: return "vm_op_equal";
+	case CMD_NEQUAL: return "vm_op_nequal";
+	case CMD_GEQ: return "vm_op_geq";
+	case CMD_LEQ: return "vm_op_leq";
+	default: return NULL;
+	}
+}
+
+// The enum name of a relation for vm_test, from CMD_GREATER to CMD_LEQ.
+static const char *aot_relation(Byte relation) {
+	switch (relation) {
+	case CMD_GREATER: return "CMD_GREATER";
+	case CMD_LESS: return "CMD_LESS";
+	case CMD_EQUAL: return "CMD_EQUAL";
+	case CMD_NEQUAL: return "CMD_NEQUAL";
+	case CMD_GEQ: return "CMD_GEQ";
+	default: return "CMD_LEQ";
+	}
+}
+
+// The command a jump to addr continues from: addr, or the end of the program.
+static Addr aot_target(VM *vm, Addr addr) {
+	if (addr < 0 || addr > vm->program->commands->length)
+		return vm->program->commands->length;
+	return addr;
+}
+
+// Write the label of a jump to addr.
+static void aot_emit_goto(VM *vm, FILE *out, Addr addr) {
+	Addr target = aot_target(vm, addr);
+	if (target == vm->program->commands->length)
+		fprintf(out, "goto end;");
+	else
+		fprintf(out, "goto c%ld;", target);
+}
+
+// Write the command list as vm_commands_dump would print it when the machine is at index,
+// as a fputs of a string literal.
+static int aot_emit_commands_dump(VM *vm, FILE *out, Addr index) {
+	FILE *text = tmpfile();
+	if (text == NULL)
+		return 1;
+	Addr cmd_ptr = vm->cmd_ptr;
+	vm->cmd_ptr = index;
+	vm_commands_fdump(vm, text);
+	vm->cmd_ptr = cmd_ptr;
+	rewind(text);
+
+	fprintf(out, "\tfputs(\n\t\t\"");
+	int c;
+	while ((c = fgetc(text)) != EOF) {
+		switch (c) {
+		case '\n':
+			fprintf(out, "\\n\"\n\t\t\"");
+			break;
+		case '\\':
+			fprintf(out, "\\\\");
+			break;
+		case '"':
+			fprintf(out, "\\\"");
+			break;
+		default:
+			fputc(c, out);
+			break;
+		}
+	}
+	fprintf(out, "\", stdout);\n");
+	fclose(text);
+	return 0;
+}
+
+// Write a call of the native function index, which must have a C name. Return 0 on success.
+static int aot_emit_call(VM *vm, FILE *out, Command cmd) {
+	Native *native = (Native *) vm->program->natives->heap + cmd.addr_arg;
+	if (native->symbol == NULL)
+		return 1;
+	const char *field = native->result == TYPE_FLOAT ? "float_value" : "int_value";
+	fprintf(out, "\ts[%ld].type = %s; s[%ld].%s = %s(", cmd.raddr,
+			native->result == TYPE_FLOAT ? "TYPE_FLOAT" : "TYPE_INT", cmd.raddr, field, native->symbol);
+	for (int i = 0; i < native->arg_count; i++)
+		fprintf(out, "%ss[%ld].%s", i > 0 ? ", " : "", cmd.addr + i, native->args[i] == TYPE_FLOAT ? "float_value" : "int_value");
+	fprintf(out, ");\n");
+	return 0;
+}
+
+// Write the statement of the command at index. Return 0 on success.
+static int aot_emit_command(VM *vm, FILE *out, Addr index, Command cmd) {
+	Byte code = vm_generic_code(cmd.code);
+	const char *op = aot_binary_op(code);
+	if (op != NULL) {
+		fprintf(out, "\t%s(&s[%ld], &s[%ld], &s[%ld]);\n", op, cmd.raddr, cmd.addr, cmd.addr_arg);
+		return 0;
+	}
+
+	// a typed assignment sets the type of the register too, which the optimizer counts on to
+	// remove the command that set it before.
+	switch (cmd.code) {
+	case CMD_ASSIGN_INT:
+		fprintf(out, "\ts[%ld].type = TYPE_INT; s[%ld].int_value = s[%ld].int_value;\n", cmd.addr, cmd.addr, cmd.addr_arg);
+		return 0;
+	case CMD_ASSIGN_FLOAT:
+		fprintf(out, "\ts[%ld].type = TYPE_FLOAT; s[%ld].float_value = s[%ld].float_value;\n", cmd.addr, cmd.addr, cmd.addr_arg);
+		return 0;
+	case CMD_ASSIGN_INT_FROM_FLOAT:
+		fprintf(out, "\ts[%ld].type = TYPE_INT; s[%ld].int_value = (Int) s[%ld].float_value;\n", cmd.addr, cmd.addr, cmd.addr_arg);
+		return 0;
+	case CMD_ASSIGN_FLOAT_FROM_INT:
+		fprintf(out, "\ts[%ld].type = TYPE_FLOAT; s[%ld].float_value = (Float) s[%ld].int_value;\n", cmd.addr, cmd.addr, cmd.addr_arg);
+		return 0;
+	}
+
+	switch (code) {
+	case CMD_COPY:
+		fprintf(out, "\ts[%ld] = s[%ld];\n", cmd.addr, cmd.addr_arg);
+		break;
+	case CMD_ASSIGN:
+		fprintf(out, "\tvm_op_assign(&s[%ld], &s[%ld]);\n", cmd.addr, cmd.addr_arg);
+		break;
+	case CMD_SET_BYTE:
+		fprintf(out, "\ts[%ld].type = TYPE_BYTE; s[%ld].byte_value = %d;\n", cmd.addr, cmd.addr, cmd.byte_arg);
+		break;
+	case CMD_SET_UINT:
+		fprintf(out, "\ts[%ld].type = TYPE_UINT; s[%ld].uint_value = %luUL;\n", cmd.addr, cmd.addr, cmd.uint_arg);
+		break;
+	case CMD_SET_INT:
+		if (cmd.int_arg == LONG_MIN)
+			fprintf(out, "\ts[%ld].type = TYPE_INT; s[%ld].int_value = -%ldL - 1;\n", cmd.addr, cmd.addr, LONG_MAX);
+		else
+			fprintf(out, "\ts[%ld].type = TYPE_INT; s[%ld].int_value = %ldL;\n", cmd.addr, cmd.addr, cmd.int_arg);
+		break;
+	case CMD_SET_FLOAT:
+		// Hexadecimal, so the literal is the same double. Folding can give values that have no
+		// literal, which are written as the macros of math.h with the same sign.
+		if (isnan(cmd.float_arg))
+			fprintf(out, "\ts[%ld].type = TYPE_FLOAT; s[%ld].float_value = %sNAN;\n", cmd.addr, cmd.addr, signbit(cmd.float_arg) ? "-" : "");
+		else if (isinf(cmd.float_arg))
+			fprintf(out, "\ts[%ld].type = TYPE_FLOAT; s[%ld].float_value = %sINFINITY;\n", cmd.addr, cmd.addr, signbit(cmd.float_arg) ? "-" : "");
+		else
+			fprintf(out, "\ts[%ld].type = TYPE_FLOAT; s[%ld].float_value = %a;\n", cmd.addr, cmd.addr, cmd.float_arg);
+		break;
+	case CMD_MALLOC:
+	case CMD_FREE:
+	case CMD_YIELD:
+		fprintf(out, "\t;\n");
+		break;
+	case CMD_JUMP:
+		fprintf(out, "\t");
+		aot_emit_goto(vm, out, cmd.addr);
+		fprintf(out, "\n");
+		break;
+	case CMD_JCOND:
+		fprintf(out, "\tif (vm_truth(&s[%ld])) ", cmd.addr_arg);
+		aot_emit_goto(vm, out, cmd.addr);
+		fprintf(out, "\n");
+		break;
+	case CMD_JNOT_GREATER:
+	case CMD_JNOT_LESS:
+	case CMD_JNOT_EQUAL:
+	case CMD_JNOT_NEQUAL:
+	case CMD_JNOT_GEQ:
+	case CMD_JNOT_LEQ:
+		fprintf(out, "\tif (!vm_test(%s, &s[%ld], &s[%ld])) ",
+				aot_relation(code - CMD_JNOT_GREATER + CMD_GREATER), cmd.addr, cmd.addr_arg);
+		aot_emit_goto(vm, out, cmd.raddr);
+		fprintf(out, "\n");
+		break;
+	case CMD_NOT:
+		fprintf(out, "\tvm_op_not(&s[%ld], &s[%ld]);\n", cmd.raddr, cmd.addr);
+		break;
+	case CMD_PUSH:
+		fprintf(out, "\tlength++; s = stack_reserve(s, &capacity, length);\n");
+		break;
+	case CMD_POP:
+		fprintf(out, "\tlength--;\n");
+		break;
+	case CMD_ENTER:
+		fprintf(out, "\tlength += %ld; s = stack_reserve(s, &capacity, length);\n", cmd.addr);
+		break;
+	case CMD_LEAVE:
+		fprintf(out, "\tlength -= %ld;\n", cmd.addr);
+		break;
+	case CMD_STACK:
+		fprintf(out, "\tvm_op_stack_dump(stdout, s, length);\n");
+		break;
+	case CMD_COMMANDS:
+		return aot_emit_commands_dump(vm, out, index);
+	case CMD_PRINT:
+		fprintf(out, "\tvm_op_register_dump(stdout, s, length, %ld);\n", cmd.addr);
+		break;
+	case CMD_EXIT:
+		fprintf(out, "\tgoto end;\n");
+		break;
+	case CMD_SET_SLEN:
+		fprintf(out, "\ts[%ld].type = TYPE_UINT; s[%ld].uint_value = length;\n", cmd.addr, cmd.addr);
+		break;
+	case CMD_CALL_NATIVE:
+		return aot_emit_call(vm, out, cmd);
+	default:
+		return 1;
+	}
+	return 0;
+}
+
+int aot_emit_c(VM *vm, FILE *out) {
+	Addr length = vm->program->commands->length;
+	bool *targets = (bool*) calloc(length + 1, sizeof(bool));
+	if (targets == NULL)
+		return 1;
+
+	// Only commands that are jumped to get a label. The end of the program is targets[length].
+	targets[aot_target(vm, vm->cmd_ptr)] = true;
+	for (Addr i = 0; i < length; i++) {
+		Command cmd = vm_get_cmd(vm, i);
+		switch (vm_generic_code(cmd.code)) {
+		case CMD_JUMP:
+		case CMD_JCOND:
+			targets[aot_target(vm, cmd.addr)] = true;
+			break;
+		case CMD_JNOT_GREATER:
+		case CMD_JNOT_LESS:
+		case CMD_JNOT_EQUAL:
+		case CMD_JNOT_NEQUAL:
+		case CMD_JNOT_GEQ:
+		case CMD_JNOT_LEQ:
+			targets[aot_target(vm, cmd.raddr)] = true;
+			break;
+		case CMD_EXIT:
+			targets[length] = true;
+			break;
+		}
+	}
+
+	fprintf(out, "/* Generated by ./program --emit-c. Build with: cc -O2 -I<language> this.c -lm */\n");
+	fprintf(out, "#include <stdio.h>\n");
+	fprintf(out, "#include <stdlib.h>\n");
+	fprintf(out, "#include <string.h>\n");
+	fprintf(out, "#include <math.h>\n");
+	fprintf(out, "#include \"vm_ops.h\"\n");
+	fprintf(out, "\n");
+	fprintf(out, "// Make room for length registers in the stack.\n");
+	fprintf(out, "static Register *stack_reserve(Register *stack, size_t *capacity, size_t length) {\n");
+	fprintf(out, "\tif (length <= *capacity)\n");
+	fprintf(out, "\t\treturn stack;\n");
+	fprintf(out, "\tsize_t new_capacity = *capacity * 2 > length ? *capacity * 2 : length;\n");
+	fprintf(out, "\tstack = (Register*) realloc(stack, new_capacity * sizeof(Register));\n");
+	fprintf(out, "\tif (stack == NULL) {\n");
+	fprintf(out, "\t\tprintf(\"Out of memory.\\n\");\n");
+	fprintf(out, "\t\texit(1);\n");
+	fprintf(out, "\t}\n");
+	fprintf(out, "\t*capacity = new_capacity;\n");
+	fprintf(out, "\treturn stack;\n");
+	fprintf(out, "}\n");
+	fprintf(out, "\n");
+
+	if (vm->stack->length > 0) {
+		fprintf(out, "static const Register initial_stack[%lu] = {\n", vm->stack->length);
+		for (size_t i = 0; i < vm->stack->length; i++) {
+			Register reg = vm_get(vm, i);
+			fprintf(out, "\t{.type = %d, .uint_value = 0x%lxUL},\n", reg.type, reg.uint_value);
+		}
+		fprintf(out, "};\n");
+		fprintf(out, "\n");
+	}
+
+	fprintf(out, "int main() {\n");
+	fprintf(out, "\tsize_t length = %lu;\n", vm->stack->length);
+	fprintf(out, "\tsize_t capacity = 0;\n");
+	fprintf(out, "\tRegister *s = stack_reserve(NULL, &capacity, length > 16 ? length : 16);\n");
+	if (vm->stack->length > 0)
+		fprintf(out, "\tmemcpy(s, initial_stack, sizeof(initial_stack));\n");
+	fprintf(out, "\t");
+	aot_emit_goto(vm, out, vm->cmd_ptr);
+	fprintf(out, "\n");
+	fprintf(out, "\n");
+
+	int rval = 0;
+	for (Addr i = 0; i < length; i++) {
+		Command cmd = vm_get_cmd(vm, i);
+		if (targets[i])
+			fprintf(out, "c%ld:\n", i);
+		if (aot_emit_command(vm, out, i, cmd) != 0) {
+			rval = 1;
+			goto aot_emit_c_end;
+		}
+	}
+
+	fprintf(out, "\n");
+	if (targets[length])
+		fprintf(out, "end:\n");
+	fprintf(out, "\tfree(s);\n");
+	fprintf(out, "\treturn 0;\n");
+	fprintf(out, "}\n");
+
+aot_emit_c_end:
+	free(targets);
+	return rval;
+}
@@ -0,0 +1,30 @@
+#ifndef __AOT_H__
+#define __AOT_H__
+
+#include <stdio.h>
+#include "vm.h"
+
+/*
+ * Ahead-of-time translation of a compiled program to C.
+ *
+ * The commands of the machine are written out as the body of a C main function: one label per
+ * command that is jumped to, one statement per command and gotos for the jumps. The stack is a
+ * local array of registers that grows and shrinks as the program pushes and pops, and the
+ * operations on registers are the ones of vm_ops.h, so the translated program prints exactly what
+ * vm_run would.
+ *
+ * The output depends on no object file of this project, only on its headers. Build it with:
+ *
+ *     cc -O2 -I<path to this repository> program.c -o program -lm
+ *
+ * Calls of native functions are written as calls of the C functions by name, so only programs
+ * that call builtins (see native.h) can be translated.
+ */
+
+// Public functions:
+
+// Write the commands of the machine to out as a standalone C program, starting from vm->cmd_ptr
+// with the current stack of the machine. Return 0 on success.
+int aot_emit_c(VM *vm, FILE *out);
+
+#endif /* __AOT_H__ */
@@ -1,7 +1,11 @@
 #include "array.h"
 
+#include <stdint.h>
+
 static int array_extend(Array *array){
 	size_t old_capacity = array->capacity;
+	if (old_capacity > SIZE_MAX / 2 / array->data_size)
+		return 1;
 	size_t new_capacity = (array->capacity > 0) ? array->capacity * 2 : 2;
 
 	void *old_heap = array->heap;
@@ -11,7 +15,9 @@ static int array_extend(Array *array){
 
 	memset(new_heap, 0, new_capacity * array->data_size);
 	memcpy(new_heap, old_heap, old_capacity * array->data_size);
-	free(old_heap);
+	if (!array->borrowed)
+		free(old_heap);
+	array->borrowed = 0;
 
 	array->heap = new_heap;
 	array->capacity = new_capacity;
@@ -27,6 +33,7 @@ Array *array_new(size_t data_size, size_t initial_length){
 	array->length = initial_length;
 	array->capacity = initial_length;
 	array->data_size = data_size;
+	array->borrowed = 0;
 	array->heap = malloc(array->length * array->data_size);
 	if (array->heap == NULL) {
 		free(array);
@@ -37,8 +44,37 @@ Array *array_new(size_t data_size, size_t initial_length){
 	return array;
 }
 
+Array *array_view(void *heap, size_t data_size, size_t length){
+	Array *array = (Array*) malloc(sizeof(Array));
+	if (array == NULL)
+		return NULL;
+
+	array->heap = heap;
+	array->length = length;
+	array->capacity = length;
+	array->data_size = data_size;
+	array->borrowed = 1;
+	return array;
+}
+
+void array_init_view(Array *array, void *heap, size_t data_size, size_t length, size_t capacity){
+	array->heap = heap;
+	array->length = length;
+	array->capacity = capacity;
+	array->data_size = data_size;
+	array->borrowed = 1;
+}
+
+void array_release(Array *array){
+	if (!array->borrowed)
+		free(array->heap);
+	array->heap = NULL;
+	array->borrowed = 1;
+}
+
 void array_delete(Array *array){
-	free(array->heap);
+	if (!array->borrowed)
+		free(array->heap);
 	free(array);
 }
 
@@ -77,6 +113,28 @@ long array_pop(Array *array, void *out_element){
 	return array->length;
 }
 
+int array_resize(Array *array, size_t length){
+	// a length whose bytes do not fit in a size_t could never be allocated.
+	if (length > SIZE_MAX / array->data_size)
+		return 1;
+	while (array->capacity < length){
+		int rval = array_extend(array);
+		if (rval)
+			return rval;
+	}
+	array->length = length;
+	return 0;
+}
+
+void array_clear(Array *array) {
+	array->length = 0;
+	if (array->borrowed) {
+		array->heap = NULL;
+		array->capacity = 0;
+		array->borrowed = 0;
+	}
+}
+
 int array_contains(Array *array, void *element) {
 	if (array->length == 0)
 		return 0;
@@ -11,11 +11,24 @@ typedef struct Array {
 	size_t length;
 	size_t capacity;
 	size_t data_size;
+	int borrowed;	/* The heap belongs to someone else (see array_view) and is not freed. */
 } Array;
 
 /* Set initial_length to 0 to use it as a stack. */
 Array *array_new(size_t data_size, size_t initial_length);
 
+/* Make an array over length elements already in memory, without copying them. The memory is not
+ * freed by array_delete and must outlive the array. Growing the array moves it to its own heap. */
+Array *array_view(void *heap, size_t data_size, size_t length);
+
+/* Make an array in place, over memory for capacity elements of which the first length are in use.
+ * As with array_view the memory is not freed, and growing the array moves it to its own heap.
+ * Free that heap with array_release. */
+void array_init_view(Array *array, void *heap, size_t data_size, size_t length, size_t capacity);
+
+/* Free the heap of an array made with array_init_view, if it has one of its own. */
+void array_release(Array *array);
+
 /* Delete array. */
 void array_delete(Array *array);
 
@@ -36,6 +49,12 @@ long array_peek(Array *array, void *out_element);
 /* Get and remove the element at the end of the array. Return the element's index. */
 long array_pop(Array *array, void *out_element);
 
+/* Set the length of the array, expanding it if needed. Elements past the old length are left as they were. Return 0 on success. */
+int array_resize(Array *array, size_t length);
+
+/* Empty the array, keeping its heap to be filled again. An array over borrowed memory lets go of it instead. */
+void array_clear(Array *array);
+
 /* Returns 1 if element is in the array, otherwise return 0. */
 int array_contains(Array *array, void *element);
 
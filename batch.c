@@ -0,0 +1,299 @@
+#include "batch.h"
+#include "compiler.h"
+#include "scheduler.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct BatchWorker {
+	Batch *batch;
+	int index;
+	pthread_t thread;
+} BatchWorker;
+
+// Take the next script from the front of the deque of the worker.
+// Return false if the deque is empty.
+static bool batch_pop(BatchDeque *deque, size_t *index) {
+	bool found = false;
+	pthread_mutex_lock(&deque->mutex);
+	if (deque->front < deque->back) {
+		*index = deque->front++;
+		found = true;
+	}
+	pthread_mutex_unlock(&deque->mutex);
+	return found;
+}
+
+// Move the back half of the deque of another worker to the deque of worker.
+// Return false if all other deques are empty.
+static bool batch_steal(Batch *batch, int worker) {
+	for (int i = 1; i < batch->workers; i++) {
+		BatchDeque *victim = &batch->deques[(worker + i) % batch->workers];
+		size_t front = 0;
+		size_t back = 0;
+		pthread_mutex_lock(&victim->mutex);
+		if (victim->front < victim->back) {
+			back = victim->back;
+			front = back - (back - victim->front + 1) / 2;
+			victim->back = front;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+
+		if (front < back) {
+			BatchDeque *deque = &batch->deques[worker];
+			pthread_mutex_lock(&deque->mutex);
+			deque->front = front;
+			deque->back = back;
+			pthread_mutex_unlock(&deque->mutex);
+			return true;
+		}
+	}
+	return false;
+}
+
+// A script between being compiled and being finished.
+typedef struct BatchJob {
+	size_t index;			// Of the script in the batch.
+	BatchResult result;
+	FILE *in;
+	FILE *out;
+	FILE *err;
+	Compiler *compiler;
+} BatchJob;
+
+// Open the buffers of a job and compile its script, writing as the program does for a single
+// script. Return true if the VM of the compiler is ready to run, false if the job is to be finished
+// as it is.
+static bool batch_compile(Batch *batch, BatchJob *job) {
+	const char *filename = batch->filenames[job->index];
+	BatchResult result = { NULL, 0, NULL, 0, -1, true };
+	job->result = result;
+	job->in = NULL;
+	job->compiler = NULL;
+	job->out = open_memstream(&job->result.out, &job->result.out_size);
+	job->err = open_memstream(&job->result.err, &job->result.err_size);
+	if (job->out == NULL || job->err == NULL)
+		return false;
+
+	fprintf(job->out, "%s\n", filename);
+	job->in = fopen(filename, "r");
+	if (job->in == NULL) {
+		fprintf(job->err, "Could not open %s.\n", filename);
+		return false;
+	}
+
+	Compiler *compiler = compiler_new(job->in, false);
+	if (compiler == NULL) {
+		fprintf(job->err, "Compiler is null.\n");
+		return false;
+	}
+	job->compiler = compiler;
+	compiler->out = job->out;
+	compiler->err = job->err;
+	compiler->vm->out = job->out;
+	compiler->vm->engine = batch->engine;
+	compiler->vm->quicken = batch->quicken;
+	compiler->vm->jit = batch->jit;
+
+	if (compiler_parse(compiler) != 0) {
+		// the parse was aborted.
+		if (compiler->compilation_success)
+			job->result.status = 0;
+		return false;
+	}
+	if (!compiler->compilation_success) {
+		fprintf(job->out, "Compilation Failed. Exiting with status -1.\n");
+		return false;
+	}
+	fprintf(job->out, "Compilation successful.\n");
+	fprintf(job->out, "Now running.\n");
+	job->result.status = 0;
+	return true;
+}
+
+// Free what the job holds and hand its result to the calling thread.
+static void batch_finish(Batch *batch, BatchJob *job) {
+	if (job->compiler != NULL)
+		compiler_delete(job->compiler);
+	if (job->in != NULL)
+		fclose(job->in);
+	if (job->out != NULL)
+		fclose(job->out);
+	if (job->err != NULL)
+		fclose(job->err);
+
+	pthread_mutex_lock(&batch->mutex);
+	batch->results[job->index] = job->result;
+	pthread_cond_broadcast(&batch->done);
+	pthread_mutex_unlock(&batch->mutex);
+}
+
+static void batch_done(VM *vm, void *data, void *context) {
+	batch_finish((Batch *) context, (BatchJob *) data);
+	free(data);
+}
+
+// Run the scripts of the deque of the worker in slices, so that a long script does not hold up
+// the short ones behind it. At most BATCH_IN_FLIGHT of them are compiled at once; the next one is
+// taken from the deque as one finishes. Scripts that cannot be run are finished at once.
+static void batch_schedule(Batch *batch, BatchDeque *deque, Scheduler *scheduler) {
+	size_t index = 0;
+	bool more = true;
+	for (;;) {
+		while (more && scheduler_length(scheduler) < BATCH_IN_FLIGHT) {
+			more = batch_pop(deque, &index);
+			if (!more)
+				break;
+			BatchJob *job = (BatchJob *) malloc(sizeof(BatchJob));
+			if (job == NULL) {
+				// no room to hold the script until its turn: run it to the end now.
+				BatchJob stack_job;
+				stack_job.index = index;
+				if (batch_compile(batch, &stack_job))
+					vm_run(stack_job.compiler->vm);
+				batch_finish(batch, &stack_job);
+				continue;
+			}
+			job->index = index;
+			bool ready = batch_compile(batch, job);
+			if (ready && scheduler_add(scheduler, job->compiler->vm, job) == 0)
+				continue;
+			if (ready)
+				vm_run(job->compiler->vm);
+			batch_done(NULL, job, batch);
+		}
+
+		SchedulerTask task;
+		int step = scheduler_step(scheduler, &task);
+		if (step < 0)
+			break;
+		if (step == 1)
+			batch_done(task.vm, task.data, batch);
+	}
+}
+
+static void *batch_worker(void *arg) {
+	BatchWorker *worker = (BatchWorker *) arg;
+	Batch *batch = worker->batch;
+	BatchDeque *deque = &batch->deques[worker->index];
+	Scheduler *scheduler = NULL;
+	if (batch->slice > 0)
+		scheduler = scheduler_new(batch->slice);
+
+	for (;;) {
+		if (scheduler != NULL) {
+			batch_schedule(batch, deque, scheduler);
+			if (batch_steal(batch, worker->index))
+				continue;
+			break;
+		}
+
+		BatchJob job;
+		if (!batch_pop(deque, &job.index)) {
+			if (batch_steal(batch, worker->index))
+				continue;
+			break;
+		}
+		if (batch_compile(batch, &job))
+			vm_run(job.compiler->vm);
+		batch_finish(batch, &job);
+	}
+
+	if (scheduler != NULL)
+		scheduler_delete(scheduler);
+	return NULL;
+}
+
+int batch_run(const char **filenames, size_t count, int workers, Byte engine, Byte quicken, Byte jit, long slice) {
+	if (workers <= 0)
+		workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+	if ((size_t) workers > count)
+		workers = count > 0 ? (int) count : 1;
+
+	Batch batch;
+	batch.filenames = filenames;
+	batch.count = count;
+	batch.workers = workers;
+	batch.engine = engine;
+	batch.quicken = quicken;
+	batch.jit = jit;
+	batch.slice = slice;
+	batch.deques = NULL;
+	batch.results = NULL;
+
+	BatchWorker *threads = NULL;
+	int started = 0;
+	int rval = 0;
+
+	batch.deques = (BatchDeque *) malloc(sizeof(BatchDeque) * workers);
+	if (batch.deques == NULL)
+		goto batch_run_fail;
+	batch.results = (BatchResult *) calloc(count > 0 ? count : 1, sizeof(BatchResult));
+	if (batch.results == NULL)
+		goto batch_run_fail;
+	threads = (BatchWorker *) malloc(sizeof(BatchWorker) * workers);
+	if (threads == NULL)
+		goto batch_run_fail;
+	pthread_mutex_init(&batch.mutex, NULL);
+	pthread_cond_init(&batch.done, NULL);
+
+	// contiguous blocks, so each worker starts on scripts near each other in the output.
+	for (int i = 0; i < workers; i++) {
+		pthread_mutex_init(&batch.deques[i].mutex, NULL);
+		batch.deques[i].front = count * i / workers;
+		batch.deques[i].back = count * (i + 1) / workers;
+	}
+
+	for (int i = 0; i < workers; i++) {
+		threads[i].batch = &batch;
+		threads[i].index = i;
+		if (pthread_create(&threads[i].thread, NULL, batch_worker, &threads[i]) != 0)
+			break;
+		started++;
+	}
+	if (started == 0) {
+		// no thread to run the scripts: run them here.
+		BatchWorker worker = { &batch, 0 };
+		batch_worker(&worker);
+	}
+
+	// write the results in order as they are done.
+	for (size_t i = 0; i < count; i++) {
+		pthread_mutex_lock(&batch.mutex);
+		while (!batch.results[i].done)
+			pthread_cond_wait(&batch.done, &batch.mutex);
+		pthread_mutex_unlock(&batch.mutex);
+
+		BatchResult *result = &batch.results[i];
+		if (result->out != NULL)
+			fwrite(result->out, 1, result->out_size, stdout);
+		if (result->err != NULL)
+			fwrite(result->err, 1, result->err_size, stderr);
+		fflush(stdout);
+		free(result->out);
+		free(result->err);
+		if (result->status != 0)
+			rval = -1;
+	}
+
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i].thread, NULL);
+	for (int i = 0; i < workers; i++)
+		pthread_mutex_destroy(&batch.deques[i].mutex);
+	pthread_mutex_destroy(&batch.mutex);
+	pthread_cond_destroy(&batch.done);
+	free(threads);
+	free(batch.results);
+	free(batch.deques);
+	return rval;
+
+batch_run_fail:
+	if (threads != NULL)
+		free(threads);
+	if (batch.results != NULL)
+		free(batch.results);
+	if (batch.deques != NULL)
+		free(batch.deques);
+	return -1;
+}
@@ -0,0 +1,70 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "vm.h"
+
+/*
+ * Batch mode: compile and run many scripts on a fixed pool of worker threads.
+ *
+ * The scripts are split in contiguous blocks, one per worker. Each worker keeps its block in a
+ * deque of script indices and takes the next script from the front of it; a worker whose deque
+ * is empty steals the back half of the deque of another worker. As the batch is known up front
+ * and nothing is pushed later, a deque is just a range of indices under a lock.
+ *
+ * Each script gets its own compiler and VM, and its output and errors are written to memory
+ * buffers. The calling thread writes the buffers of each script to stdout and stderr in the order
+ * of the scripts as soon as they and all the scripts before them are done, so the output is that
+ * of running the scripts one after the other.
+ *
+ * With a slice, a worker runs the scripts of its deque in turn on a scheduler (see scheduler.h),
+ * slice commands at a time, so short scripts finish soon even behind a long one. It keeps at most
+ * BATCH_IN_FLIGHT scripts compiled at once and takes the next one from its deque as one finishes,
+ * so memory does not grow with the size of the batch and the scripts it has not started can still
+ * be stolen. The output is the same; only the order the scripts finish in changes.
+ */
+
+#define BATCH_IN_FLIGHT 16		// Most scripts a worker runs in turn with a slice.
+
+typedef struct BatchDeque {
+	pthread_mutex_t mutex;
+	size_t front;			// Next script to run.
+	size_t back;			// One past the last script of the deque.
+} BatchDeque;
+
+typedef struct BatchResult {
+	char *out;				// What the script wrote to its output.
+	size_t out_size;
+	char *err;				// What the script wrote to its errors.
+	size_t err_size;
+	int status;				// 0 if the script compiled, -1 if not.
+	bool done;
+} BatchResult;
+
+typedef struct Batch {
+	const char **filenames;	// The scripts to run.
+	size_t count;
+	int workers;
+	Byte engine;			// Options of each VM, as in the VM struct.
+	Byte quicken;
+	Byte jit;
+	long slice;				// Commands per turn of each script, or 0 to run each script to its end.
+
+	BatchDeque *deques;		// One per worker.
+	BatchResult *results;	// One per script, in the order of the scripts.
+	pthread_mutex_t mutex;	// Guards done in results.
+	pthread_cond_t done;	// Signaled when a script is done.
+} Batch;
+
+
+// Public functions:
+
+// Run count scripts on workers threads, or one per online processor if workers is 0.
+// The VM of each script uses the engine, quicken and jit options given. If slice is positive, the
+// scripts of each worker take turns of slice commands.
+// Return 0 if all scripts compiled, -1 if any did not or the batch could not be run.
+int batch_run(const char **filenames, size_t count, int workers, Byte engine, Byte quicken, Byte jit, long slice);
+
+#endif /* __BATCH_H__ */
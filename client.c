@@ -0,0 +1,178 @@
+/*
+ * A client for the daemon mode of the program (see daemon.h).
+ *
+ *     ./client SOCKET [--image] FILE [--bench N]
+ *
+ * Sends the script in FILE, or the image in FILE with --image, to the daemon listening on SOCKET
+ * and writes what the script writes. The exit status is the status of the script.
+ *
+ * With --bench the request is sent N times, one after the other, with the output discarded, and
+ * the latency of each request is measured from connecting to the last frame of the response.
+ */
+#include "daemon.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static int client_send(int fd, const void *data, size_t size) {
+	const Byte *bytes = (const Byte *) data;
+	while (size > 0) {
+		ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return 1;
+		bytes += sent;
+		size -= sent;
+	}
+	return 0;
+}
+
+static int client_receive(int fd, void *data, size_t size) {
+	Byte *bytes = (Byte *) data;
+	while (size > 0) {
+		ssize_t received = recv(fd, bytes, size, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return 1;
+		bytes += received;
+		size -= received;
+	}
+	return 0;
+}
+
+int daemon_request(const char *socket_path, Byte kind, const void *payload, size_t size, FILE *out, FILE *err) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return -1;
+	strcpy(addr.sun_path, socket_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+
+	int32_t status = -1;
+	uint64_t payload_size = size;
+	if (client_send(fd, &kind, sizeof(kind)) != 0
+		|| client_send(fd, &payload_size, sizeof(payload_size)) != 0
+		|| client_send(fd, payload, size) != 0)
+		goto daemon_request_end;
+
+	for (;;) {
+		Byte frame;
+		uint32_t frame_size;
+		if (client_receive(fd, &frame, sizeof(frame)) != 0 || client_receive(fd, &frame_size, sizeof(frame_size)) != 0)
+			break;
+		if (frame == DAEMON_EXIT) {
+			if (frame_size != sizeof(status) || client_receive(fd, &status, sizeof(status)) != 0)
+				status = -1;
+			break;
+		}
+		FILE *to = frame == DAEMON_ERR ? err : out;
+		char buffer[4096];
+		while (frame_size > 0) {
+			size_t chunk = frame_size < sizeof(buffer) ? frame_size : sizeof(buffer);
+			if (client_receive(fd, buffer, chunk) != 0)
+				goto daemon_request_end;
+			fwrite(buffer, 1, chunk, to);
+			frame_size -= chunk;
+		}
+	}
+
+daemon_request_end:
+	close(fd);
+	return status;
+}
+
+static double client_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int client_compare(const void *a, const void *b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, const char **argv) {
+	const char *socket_path = NULL;
+	const char *filename = NULL;
+	Byte kind = DAEMON_SOURCE;
+	long bench = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--image") == 0)
+			kind = DAEMON_IMAGE;
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+			bench = atol(argv[++i]);
+		else if (socket_path == NULL)
+			socket_path = argv[i];
+		else
+			filename = argv[i];
+	}
+	if (socket_path == NULL || filename == NULL) {
+		fprintf(stderr, "Usage: %s SOCKET [--image] FILE [--bench N]\n", argv[0]);
+		return 1;
+	}
+
+	// the whole file is the payload. Images are read in place, so keep it aligned.
+	FILE *in = fopen(filename, "rb");
+	if (in == NULL) {
+		fprintf(stderr, "Could not open %s.\n", filename);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	void *payload = malloc(size > 0 ? size : 1);
+	if (payload == NULL || fread(payload, 1, size, in) != (size_t) size) {
+		fprintf(stderr, "Could not read %s.\n", filename);
+		fclose(in);
+		free(payload);
+		return 1;
+	}
+	fclose(in);
+
+	if (bench <= 0) {
+		int status = daemon_request(socket_path, kind, payload, size, stdout, stderr);
+		free(payload);
+		return status;
+	}
+
+	FILE *null = fopen("/dev/null", "w");
+	double *latencies = (double *) malloc(sizeof(double) * bench);
+	if (null == NULL || latencies == NULL) {
+		fprintf(stderr, "Could not run the benchmark.\n");
+		return 1;
+	}
+	int failures = 0;
+	double start = client_now();
+	for (long i = 0; i < bench; i++) {
+		double t = client_now();
+		if (daemon_request(socket_path, kind, payload, size, null, null) != 0)
+			failures++;
+		latencies[i] = client_now() - t;
+	}
+	double total = client_now() - start;
+
+	qsort(latencies, bench, sizeof(double), client_compare);
+	printf("requests %ld, failed %d, %.0f requests/s\n", bench, failures, bench / total);
+	printf("p50 %.1f us, p99 %.1f us, max %.1f us\n",
+		latencies[bench / 2] * 1e6, latencies[bench * 99 / 100] * 1e6, latencies[bench - 1] * 1e6);
+	free(latencies);
+	free(payload);
+	fclose(null);
+	return 0;
+}
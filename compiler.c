@@ -0,0 +1,201 @@
+#include "compiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+Compiler *compiler_new(FILE *in, bool interactive_mode) {
+	VM *vm = vm_new();
+	if (vm == NULL)
+		return NULL;
+	Compiler *compiler = compiler_new_for(vm, in, interactive_mode);
+	if (compiler == NULL)
+		vm_delete(vm);
+	return compiler;
+}
+
+Compiler *compiler_new_for(VM *vm, FILE *in, bool interactive_mode) {
+	Compiler *compiler = NULL;
+	Array *stack_scope = NULL;
+	Array *frame_stack = NULL;
+	Array *identifiers_scope = NULL;
+	Array *identifier_stack = NULL;
+	Array *temps = NULL;
+	Array *free_temps = NULL;
+	Array *slot_types = NULL;
+	Array *control_stack = NULL;
+	Array *call_args = NULL;
+	Map *variables = NULL;
+	Map *globals = NULL;
+	MapArray *labels = NULL;
+	Array *strings = NULL;
+
+	compiler = (Compiler*) malloc(sizeof(Compiler));
+	if (compiler == NULL)
+		goto compiler_new_fail;
+	stack_scope = array_new(sizeof(size_t), 0);
+	if (stack_scope == NULL)
+		goto compiler_new_fail;
+	frame_stack = array_new(sizeof(size_t), 0);
+	if (frame_stack == NULL)
+		goto compiler_new_fail;
+	identifiers_scope = array_new(sizeof(size_t), 0);
+	if (identifiers_scope == NULL)
+		goto compiler_new_fail;
+	identifier_stack = array_new(sizeof(char *), 0);
+	if (identifier_stack == NULL)
+		goto compiler_new_fail;
+	temps = array_new(sizeof(Byte), 0);
+	if (temps == NULL)
+		goto compiler_new_fail;
+	free_temps = array_new(sizeof(Addr), 0);
+	if (free_temps == NULL)
+		goto compiler_new_fail;
+	slot_types = array_new(sizeof(Byte), 0);
+	if (slot_types == NULL)
+		goto compiler_new_fail;
+	control_stack = array_new(sizeof(Addr), 0);
+	if (control_stack == NULL)
+		goto compiler_new_fail;
+	call_args = array_new(sizeof(Addr), 0);
+	if (call_args == NULL)
+		goto compiler_new_fail;
+	variables = map_new(2);
+	if (variables == NULL)
+		goto compiler_new_fail;
+	globals = map_new(2);
+	if (globals == NULL)
+		goto compiler_new_fail;
+	labels = map_array_new(2, sizeof(Addr), 0);
+	if (labels == NULL)
+		goto compiler_new_fail;
+	strings = array_new(sizeof(char *), 0);
+	if (strings == NULL)
+		goto compiler_new_fail;
+
+	// the null pointer is the first value of the stack, and its type is known.
+	Byte null_type = TYPE_INT;
+	Addr null_addr = vm_push_int(vm, 0);
+	if (null_addr < 0 || array_push(slot_types, &null_type) < 0)
+		goto compiler_new_fail;
+
+	compiler->vm = vm;
+	compiler->in = in;
+	compiler->out = stdout;
+	compiler->err = stderr;
+	compiler->interactive_mode = interactive_mode;
+	compiler->stack_track = 0;
+	compiler->stack_scope = stack_scope;
+	compiler->stack_peak = 0;
+	compiler->frame_stack = frame_stack;
+	compiler->identifiers_scope = identifiers_scope;
+	compiler->identifier_stack = identifier_stack;
+	compiler->temps = temps;
+	compiler->free_temps = free_temps;
+	compiler->slot_types = slot_types;
+	compiler->static_typing = !interactive_mode;
+	compiler->optimize = !interactive_mode;
+	compiler->removed_commands = 0;
+	compiler->hoisted_commands = 0;
+	compiler->control_stack = control_stack;
+	compiler->call_args = call_args;
+	compiler->variables = variables;
+	compiler->globals = globals;
+	compiler->labels = labels;
+	compiler->strings = strings;
+	compiler->line_count = 1;
+	compiler->compilation_success = true;
+	compiler->null_addr = null_addr;
+	return compiler;
+
+compiler_new_fail:
+	if (compiler != NULL)
+		free(compiler);
+	if (stack_scope != NULL)
+		array_delete(stack_scope);
+	if (frame_stack != NULL)
+		array_delete(frame_stack);
+	if (identifiers_scope != NULL)
+		array_delete(identifiers_scope);
+	if (identifier_stack != NULL)
+		array_delete(identifier_stack);
+	if (temps != NULL)
+		array_delete(temps);
+	if (free_temps != NULL)
+		array_delete(free_temps);
+	if (slot_types != NULL)
+		array_delete(slot_types);
+	if (control_stack != NULL)
+		array_delete(control_stack);
+	if (call_args != NULL)
+		array_delete(call_args);
+	if (variables != NULL)
+		map_delete(variables);
+	if (globals != NULL)
+		map_delete(globals);
+	if (labels != NULL)
+		map_array_delete(labels);
+	if (strings != NULL)
+		array_delete(strings);
+	return NULL;
+}
+
+void compiler_delete(Compiler *compiler) {
+	if (compiler->vm != NULL)
+		vm_delete(compiler->vm);
+	array_delete(compiler->stack_scope);
+	array_delete(compiler->frame_stack);
+	array_delete(compiler->identifiers_scope);
+	array_delete(compiler->identifier_stack);
+	array_delete(compiler->temps);
+	array_delete(compiler->free_temps);
+	array_delete(compiler->slot_types);
+	array_delete(compiler->control_stack);
+	array_delete(compiler->call_args);
+	map_delete(compiler->variables);
+	if (compiler->globals != NULL)
+		map_delete(compiler->globals);
+	map_array_delete(compiler->labels);
+
+	for (int i = 0; i < compiler->strings->length; i++) {
+		char *str = NULL;
+		array_get(compiler->strings, i, &str);
+		free(str);
+	}
+	array_delete(compiler->strings);
+	free(compiler);
+}
+
+Addr compiler_declare(Compiler *compiler, const char *name, Byte type) {
+	Register reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.type = type;
+
+	// the name is kept with the identifiers of the source, to be freed with them.
+	char *str = strdup(name);
+	if (str == NULL)
+		return -1;
+	if (array_push(compiler->strings, &str) < 0) {
+		free(str);
+		return -1;
+	}
+
+	Addr addr = vm_push(compiler->vm);
+	if (addr < 0)
+		return -1;
+	vm_set(compiler->vm, addr, reg);
+	compiler->stack_track++;
+	if (array_push(compiler->slot_types, &type) < 0)
+		compiler->static_typing = false;
+
+	CompilerGlobal global = { addr, type };
+	if (array_push(compiler->identifier_stack, &str) < 0
+		|| !map_put(compiler->variables, str, strlen(str), &addr, sizeof(addr))
+		|| !map_put(compiler->globals, str, strlen(str), &global, sizeof(global)))
+		return -1;
+	return addr;
+}
+
+VM *compiler_take_vm(Compiler *compiler) {
+	VM *vm = compiler->vm;
+	compiler->vm = NULL;
+	return vm;
+}
@@ -0,0 +1,99 @@
+#ifndef __COMPILER_H__
+#define __COMPILER_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "array.h"
+#include "hash.h"
+#include "map_array.h"
+#include "vm.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+// A variable declared at the top level of the program, outside any block.
+typedef struct CompilerGlobal {
+	Addr addr;					// its position in the machine stack.
+	Byte type;					// its declared type.
+} CompilerGlobal;
+
+/*
+ * State of one compilation.
+ *
+ * The parser and the scanner are reentrant and keep everything they need here, so each compiler
+ * compiles its own program to its own VM. Different compilers, and the VMs they produce, can be
+ * used from different threads at the same time.
+ */
+typedef struct Compiler {
+	VM *vm;						// the machine the program is compiled to.
+	FILE *in;					// the source, or NULL to read from stdin.
+	FILE *out;					// where compiler messages go. stdout by default.
+	FILE *err;					// where compile errors go. stderr by default.
+	bool interactive_mode;		// when input is from stdin and executing them at once.
+
+	// Scope handling
+	size_t stack_track;			// keep track in compile time of the size of the machine stack.
+	Array *stack_scope;			// keeps track of machine stack positions for each scope level.
+	size_t stack_peak;			// the highest machine stack position used in the current block, to size its frame.
+	Array *frame_stack;			// keeps track, for each enclosing block, of the index of its enter command and of its stack_peak.
+	Array *identifiers_scope;	// keeps track of identifiers positions for each scope level.
+	Array *identifier_stack;	// keeps track of identifiers, that is, variable, labels, function names. All identifiers are in the machine stack.
+	Array *temps;				// 1 for each machine stack position that holds a temporary still to be used, 0 otherwise.
+	Array *free_temps;			// positions of temporaries that were used, to hold the next ones. Those of inner blocks last.
+
+	// Static typing
+	Array *slot_types;			// the type of the value in each machine stack position as known at compile time, or 0 if unknown.
+	bool static_typing;			// emit typed commands. Off in interactive mode and once the program writes the stack with vm commands.
+	bool optimize;				// run the passes of optimize.h on the program once it is parsed, if it is statically typed.
+	long removed_commands;		// the number of commands the passes removed.
+	long hoisted_commands;		// the number of commands the passes moved out of loops.
+
+	// Structured control flow handing
+	Array *control_stack;		// keeps track of the command address where control flow structures begin.
+	Array *call_args;			// the addresses of the arguments of the calls being parsed, those of the innermost call last.
+
+	Map *variables;				// maps variable names with their place in the machine stack. Labels are treated as variables.
+	Map *globals;				// maps the names of top-level variables to their CompilerGlobal, for the host to find them after the program ran.
+	MapArray *labels;			// maps jump labels and the list of their positions in the commands.
+	Array *strings;				// keeps track of all identifiers and string literals in the program. These are strings dynamically allocated at lex level, so we want to keep their pointers to be able to free them.
+	size_t line_count;			// keeps track of source code lines.
+	bool compilation_success;
+
+	// null pointer
+	Addr null_addr;				// the null pointer is an int 0 at the bottom of the stack.
+} Compiler;
+
+
+// Public functions:
+
+// A compiler for the source in, with a new VM to compile to.
+// In interactive mode each sentence is run as soon as it is parsed.
+Compiler *compiler_new(FILE *in, bool interactive_mode);
+
+// A compiler for the source in that compiles to vm, which must be new or reset (see vm_reset).
+// The compiler owns vm as if it had made it. On failure vm is left to the caller.
+Compiler *compiler_new_for(VM *vm, FILE *in, bool interactive_mode);
+
+// Delete the compiler and its VM, unless the VM was taken. Does not close in.
+void compiler_delete(Compiler *compiler);
+
+// Declare a variable of type for the program before it is parsed. Its register is pushed to the
+// stack of the machine now, with a zero value, so the host can set it before the program runs
+// and the program uses it as if it had declared it. Return its address, or -1 on failure.
+Addr compiler_declare(Compiler *compiler, const char *name, Byte type);
+
+// Parse the source and compile it to the VM of the compiler, running each sentence in
+// interactive mode. Return 0 if the parse reached the end of the source; compilation_success
+// tells whether the program had errors.
+int compiler_parse(Compiler *compiler);
+
+// Take the VM out of the compiler, which will no longer delete it.
+VM *compiler_take_vm(Compiler *compiler);
+
+// Close the source, delete the compiler, if any, and exit the process with status_code.
+// Used by the program and by quit in interactive mode.
+void exit_program(Compiler *compiler, int status_code);
+
+#endif /* __COMPILER_H__ */
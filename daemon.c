@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+#include "daemon.h"
+#include "compiler.h"
+#include "image.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+typedef struct Daemon {
+	int socket;				// The listening socket.
+	Byte engine;			// Options of each VM, as in the VM struct.
+	Byte quicken;
+	Byte jit;
+} Daemon;
+
+typedef struct DaemonWorker {
+	Daemon *daemon;
+	VM *vm;					// The warm machine of the worker, reset after each request.
+	Byte *payload;			// The payload of the current request. Kept between requests.
+	size_t capacity;		// Size of payload in bytes.
+	pthread_t thread;
+} DaemonWorker;
+
+// A stream that sends what is written to it as frames of one kind.
+typedef struct DaemonStream {
+	int fd;
+	Byte kind;
+} DaemonStream;
+
+static int daemon_send(int fd, const void *data, size_t size) {
+	const Byte *bytes = (const Byte *) data;
+	while (size > 0) {
+		ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR)
+			continue;
+		if (sent <= 0)
+			return 1;
+		bytes += sent;
+		size -= sent;
+	}
+	return 0;
+}
+
+static int daemon_receive(int fd, void *data, size_t size) {
+	Byte *bytes = (Byte *) data;
+	while (size > 0) {
+		ssize_t received = recv(fd, bytes, size, 0);
+		if (received < 0 && errno == EINTR)
+			continue;
+		if (received <= 0)
+			return 1;
+		bytes += received;
+		size -= received;
+	}
+	return 0;
+}
+
+static int daemon_send_frame(int fd, Byte kind, const void *data, uint32_t size) {
+	Byte header[1 + sizeof(uint32_t)];
+	header[0] = kind;
+	memcpy(header + 1, &size, sizeof(size));
+	if (daemon_send(fd, header, sizeof(header)) != 0)
+		return 1;
+	return daemon_send(fd, data, size);
+}
+
+static ssize_t daemon_stream_write(void *cookie, const char *data, size_t size) {
+	DaemonStream *stream = (DaemonStream *) cookie;
+	// a client that went away does not stop the script.
+	daemon_send_frame(stream->fd, stream->kind, data, size);
+	return size;
+}
+
+static FILE *daemon_stream_open(DaemonStream *stream) {
+	cookie_io_functions_t functions = { NULL, daemon_stream_write, NULL, NULL };
+	return fopencookie(stream, "w", functions);
+}
+
+// Set the options of the daemon on the machine, which an image may have changed.
+static void daemon_prepare(DaemonWorker *worker, FILE *out) {
+	worker->vm->engine = worker->daemon->engine;
+	worker->vm->quicken = worker->daemon->quicken;
+	worker->vm->jit = worker->daemon->jit;
+	worker->vm->out = out;
+}
+
+// Compile and run the source in the payload, writing as the program does for a single script.
+static int daemon_source(DaemonWorker *worker, size_t size, FILE *out, FILE *err) {
+	FILE *in = fmemopen(worker->payload, size, "r");
+	if (in == NULL) {
+		fprintf(err, "Could not read the source.\n");
+		return -1;
+	}
+
+	daemon_prepare(worker, out);
+	Compiler *compiler = compiler_new_for(worker->vm, in, false);
+	if (compiler == NULL) {
+		fprintf(err, "Compiler is null.\n");
+		fclose(in);
+		vm_reset(worker->vm);
+		return -1;
+	}
+	compiler->out = out;
+	compiler->err = err;
+
+	int rval = 0;
+	if (compiler_parse(compiler) != 0) {
+		// the parse was aborted.
+		if (!compiler->compilation_success)
+			rval = -1;
+	}
+	else if (compiler->compilation_success) {
+		fprintf(out, "Compilation successful.\n");
+		fprintf(out, "Now running.\n");
+		if (vm_run(compiler->vm) == VM_FAILED) {
+			fprintf(err, "%s\n", vm_failure(compiler->vm));
+			rval = -1;
+		}
+	}
+	else {
+		fprintf(out, "Compilation Failed. Exiting with status -1.\n");
+		rval = -1;
+	}
+
+	// the machine goes back to the pool.
+	compiler_take_vm(compiler);
+	compiler_delete(compiler);
+	fclose(in);
+	vm_reset(worker->vm);
+	return rval;
+}
+
+// Run the image in the payload.
+static int daemon_image(DaemonWorker *worker, size_t size, FILE *out, FILE *err) {
+	daemon_prepare(worker, out);
+	Image *image = image_open_memory(worker->payload, size);
+	if (image == NULL) {
+		fprintf(err, "Could not load the image.\n");
+		vm_reset(worker->vm);
+		return -1;
+	}
+	// the commands come from the client: image_attach refuses them unless they are safe to run.
+	if (image_attach(image, worker->vm) != 0) {
+		fprintf(err, "The image was refused: its commands could reach outside the memory of the machine.\n");
+		image_close(image);
+		vm_reset(worker->vm);
+		return -1;
+	}
+	fprintf(out, "Now running.\n");
+	int status = vm_run(worker->vm);
+	if (status == VM_FAILED)
+		fprintf(err, "%s\n", vm_failure(worker->vm));
+	// the machine lets go of the commands of the image before the image goes.
+	vm_reset(worker->vm);
+	image_close(image);
+	return status == VM_FAILED ? -1 : 0;
+}
+
+static void daemon_serve(DaemonWorker *worker, int fd) {
+	Byte kind;
+	uint64_t size;
+	if (daemon_receive(fd, &kind, sizeof(kind)) != 0 || daemon_receive(fd, &size, sizeof(size)) != 0)
+		return;
+
+	int32_t status = -1;
+	DaemonStream out_stream = { fd, DAEMON_OUT };
+	DaemonStream err_stream = { fd, DAEMON_ERR };
+	FILE *out = daemon_stream_open(&out_stream);
+	FILE *err = daemon_stream_open(&err_stream);
+	if (out == NULL || err == NULL)
+		goto daemon_serve_end;
+	setvbuf(err, NULL, _IONBF, 0);
+
+	if (size > DAEMON_MAX_REQUEST) {
+		fprintf(err, "Request too large.\n");
+		goto daemon_serve_end;
+	}
+	if (size + 1 > worker->capacity) {
+		Byte *payload = (Byte *) realloc(worker->payload, size + 1);
+		if (payload == NULL) {
+			fprintf(err, "Out of memory.\n");
+			goto daemon_serve_end;
+		}
+		worker->payload = payload;
+		worker->capacity = size + 1;
+	}
+	if (daemon_receive(fd, worker->payload, size) != 0)
+		goto daemon_serve_end;
+
+	switch (kind) {
+	case DAEMON_SOURCE:
+		status = daemon_source(worker, size, out, err);
+		break;
+	case DAEMON_IMAGE:
+		status = daemon_image(worker, size, out, err);
+		break;
+	default:
+		fprintf(err, "Unknown request.\n");
+		break;
+	}
+
+daemon_serve_end:
+	if (out != NULL)
+		fclose(out);
+	if (err != NULL)
+		fclose(err);
+	daemon_send_frame(fd, DAEMON_EXIT, &status, sizeof(status));
+}
+
+static void *daemon_worker(void *arg) {
+	DaemonWorker *worker = (DaemonWorker *) arg;
+	for (;;) {
+		int fd = accept(worker->daemon->socket, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		daemon_serve(worker, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+int daemon_run(const char *socket_path, int workers, Byte engine, Byte quicken, Byte jit) {
+	Daemon daemon;
+	DaemonWorker *threads = NULL;
+	int started = 0;
+	struct sockaddr_un addr;
+
+	if (workers <= 0)
+		workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+	daemon.engine = engine;
+	daemon.quicken = quicken;
+	daemon.jit = jit;
+
+	daemon.socket = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (daemon.socket < 0)
+		goto daemon_run_fail;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		goto daemon_run_fail;
+	strcpy(addr.sun_path, socket_path);
+	unlink(socket_path);
+	if (bind(daemon.socket, (struct sockaddr *) &addr, sizeof(addr)) != 0)
+		goto daemon_run_fail;
+	if (listen(daemon.socket, 128) != 0)
+		goto daemon_run_fail;
+
+	// the pool: one warm machine per worker.
+	threads = (DaemonWorker *) calloc(workers, sizeof(DaemonWorker));
+	if (threads == NULL)
+		goto daemon_run_fail;
+	for (int i = 0; i < workers; i++) {
+		threads[i].daemon = &daemon;
+		threads[i].vm = vm_new();
+		if (threads[i].vm == NULL)
+			goto daemon_run_fail;
+	}
+
+	printf("Listening on %s with %d workers.\n", socket_path, workers);
+	fflush(stdout);
+	for (int i = 0; i < workers; i++) {
+		if (pthread_create(&threads[i].thread, NULL, daemon_worker, &threads[i]) != 0)
+			break;
+		started++;
+	}
+	if (started == 0)
+		goto daemon_run_fail;
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i].thread, NULL);
+
+daemon_run_fail:
+	if (threads != NULL) {
+		for (int i = 0; i < workers; i++) {
+			if (threads[i].vm != NULL)
+				vm_delete(threads[i].vm);
+			free(threads[i].payload);
+		}
+		free(threads);
+	}
+	if (daemon.socket >= 0)
+		close(daemon.socket);
+	return -1;
+}
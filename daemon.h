@@ -0,0 +1,48 @@
+#ifndef __DAEMON_H__
+#define __DAEMON_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "vm.h"
+
+/*
+ * Daemon mode: compile and run scripts sent over a Unix domain socket.
+ *
+ * The daemon keeps a pool of worker threads, each with a VM made when the daemon starts. A worker
+ * accepts a connection, reads one request, compiles the source to its VM or attaches the image to
+ * it, runs it and streams the output back. Then it resets the VM with vm_reset, which keeps the
+ * memory of its arrays, and waits for the next connection.
+ *
+ * A request is a kind byte (DAEMON_SOURCE or DAEMON_IMAGE), the size of the payload as a uint64_t
+ * and the payload: the source of a script or the bytes of an image written by --compile. Any local
+ * client may send an image, so an image is only run once image_attach has checked that its
+ * commands stay in the memory of the machine; a broken one is refused with an error.
+ *
+ * The response is a sequence of frames, each a kind byte, a uint32_t size and that many bytes:
+ * DAEMON_OUT frames carry what the script writes to its output and DAEMON_ERR frames its errors,
+ * as they are written. The last frame is DAEMON_EXIT, with the status of the script as an int32_t.
+ *
+ * Numbers are in the byte order of the machine, as client and daemon run on the same one.
+ */
+
+#define DAEMON_SOURCE 's'	// Request: compile and run the source in the payload.
+#define DAEMON_IMAGE 'i'	// Request: run the image in the payload.
+#define DAEMON_OUT 'o'		// Response frame: output of the script.
+#define DAEMON_ERR 'e'		// Response frame: errors of the script.
+#define DAEMON_EXIT 'x'		// Response frame: the status of the script. The last frame.
+
+#define DAEMON_MAX_REQUEST (64 << 20)	// Largest payload accepted, in bytes.
+
+
+// Public functions:
+
+// Listen on socket_path and serve requests on workers threads, or one per online processor if
+// workers is 0. Each VM uses the engine, quicken and jit options given. Only returns on failure.
+int daemon_run(const char *socket_path, int workers, Byte engine, Byte quicken, Byte jit);
+
+// Send a request to the daemon listening on socket_path and copy the output of the script to out
+// and its errors to err as they arrive. Return the status of the script, or -1 if the daemon
+// could not be reached or the response was cut short.
+int daemon_request(const char *socket_path, Byte kind, const void *payload, size_t size, FILE *out, FILE *err);
+
+#endif /* __DAEMON_H__ */
@@ -105,7 +105,7 @@ int map_put(Map *map,
 
 	while (
 			map->buckets[hash].key != 0 &&
-			memcmp(map->buckets[hash].key, key, klen) != 0
+			(map->buckets[hash].klen != klen || memcmp(map->buckets[hash].key, key, klen) != 0)
 	) {
 		hash = (hash + 1) % map->length;
 		if (hash == home_hash) {
@@ -139,7 +139,7 @@ int map_get(Map *map,
 	uint32_t home_hash = hash;
 	while(
 			map->buckets[hash].key != 0 &&
-			memcmp(map->buckets[hash].key, key, klen) != 0
+			(map->buckets[hash].klen != klen || memcmp(map->buckets[hash].key, key, klen) != 0)
 	){
 
 		hash = (hash + 1) % map->length;
@@ -164,7 +164,7 @@ int map_remove(Map *map,
 	uint32_t home_hash = hash;
 	while(
 			map->buckets[hash].key != 0 &&
-			memcmp(map->buckets[hash].key, key, klen) != 0
+			(map->buckets[hash].klen != klen || memcmp(map->buckets[hash].key, key, klen) != 0)
 	){
 
 		hash = (hash + 1) % map->length;
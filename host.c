@@ -0,0 +1,80 @@
+#include "host.h"
+#include "compiler.h"
+#include <stdlib.h>
+#include <string.h>
+
+HostScript *host_compile(const char *source, size_t size, const HostInput *inputs, size_t input_count, Array *natives, FILE *err) {
+	HostScript *script = NULL;
+	FILE *in = NULL;
+	FILE *null = NULL;
+	Compiler *compiler = NULL;
+	Program *program = NULL;
+
+	script = (HostScript *) malloc(sizeof(HostScript));
+	if (script == NULL)
+		goto host_compile_fail;
+	in = fmemopen((void *) source, size, "r");
+	if (in == NULL)
+		goto host_compile_fail;
+	// what the compiler says while it works is of no use to the host.
+	null = fopen("/dev/null", "w");
+	if (null == NULL)
+		goto host_compile_fail;
+	compiler = compiler_new(in, false);
+	if (compiler == NULL)
+		goto host_compile_fail;
+	compiler->out = null;
+	compiler->err = err != NULL ? err : null;
+	if (natives != NULL)
+		compiler->vm->program->natives = natives;
+
+	for (size_t i = 0; i < input_count; i++) {
+		if (compiler_declare(compiler, inputs[i].name, inputs[i].type) < 0)
+			goto host_compile_fail;
+	}
+	if (compiler_parse(compiler) != 0 || !compiler->compilation_success)
+		goto host_compile_fail;
+	program = vm_take_program(compiler->vm);
+	if (program == NULL)
+		goto host_compile_fail;
+
+	script->program = program;
+	script->globals = compiler->globals;
+	compiler->globals = NULL;
+	compiler_delete(compiler);
+	fclose(null);
+	fclose(in);
+	return script;
+
+host_compile_fail:
+	if (script != NULL)
+		free(script);
+	if (compiler != NULL)
+		compiler_delete(compiler);
+	if (null != NULL)
+		fclose(null);
+	if (in != NULL)
+		fclose(in);
+	return NULL;
+}
+
+void host_delete(HostScript *script) {
+	program_delete(script->program);
+	map_delete(script->globals);
+	free(script);
+}
+
+VM *host_context(HostScript *script) {
+	return vm_new_context(script->program);
+}
+
+HostVariable host_lookup(HostScript *script, const char *name) {
+	HostVariable var = { -1, 0 };
+	CompilerGlobal global;
+	size_t size = 0;
+	if (map_get(script->globals, name, strlen(name), &global, &size)) {
+		var.addr = global.addr;
+		var.type = global.type;
+	}
+	return var;
+}
@@ -0,0 +1,133 @@
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <stdio.h>
+#include "hash.h"
+#include "native.h"
+#include "vm.h"
+
+/*
+ * The host API, for C programs that link liblanguage.a and run scripts in-process.
+ *
+ * host_compile compiles a script once. The host may declare input variables for it first: their
+ * registers are at the bottom of the stack, and the script uses them as if it had declared them.
+ * The outputs are the variables the script declares at its top level, which keep their values
+ * when it ends. The compiled script runs in any number of contexts, one per thread, each reused
+ * from run to run:
+ *
+ *     HostInput inputs[] = { { "x", TYPE_INT } };
+ *     HostScript *script = host_compile(source, strlen(source), inputs, 1, NULL, stderr);
+ *     HostVariable x = host_lookup(script, "x");
+ *     HostVariable y = host_lookup(script, "y");
+ *     VM *vm = host_context(script);
+ *     for (...) {
+ *         vm_restart(vm);
+ *         host_set_int(vm, x, 42);
+ *         vm_run(vm);
+ *         Int result;
+ *         host_get_int(vm, y, &result);
+ *     }
+ *     vm_delete(vm);
+ *     host_delete(script);
+ *
+ * A script can also keep running from event to event as a coroutine, doing its setup once. It
+ * waits for the next event with yield, and the host passes events in and results out through
+ * variables, resuming the script once per event:
+ *
+ *     vm_resume(vm);                          // run the setup, up to the first yield.
+ *     for (...) {
+ *         host_set_int(vm, event, ...);
+ *         if (vm_resume(vm) != VM_YIELDED)    // handle the event, up to the next yield.
+ *             break;
+ *         host_get_int(vm, total, &result);
+ *     }
+ *
+ * Names are looked up once with host_lookup; reading and writing a variable is then a load or a
+ * store of its register in the stack, with no text in between.
+ *
+ * Scripts call C functions of the host by name if they are registered in a table of natives
+ * (see native.h) that the script is compiled with:
+ *
+ *     Array *natives = native_table_new();
+ *     native_register(natives, "clamp", (NativeFunction) clamp, TYPE_INT, 3, (Byte[]) { TYPE_INT, TYPE_INT, TYPE_INT });
+ *     HostScript *script = host_compile(source, strlen(source), inputs, 1, natives, stderr);
+ *
+ * The table must outlive the script and must not change while the script is compiled or run.
+ */
+
+typedef struct HostInput {
+	const char *name;
+	Byte type;				// TYPE_BYTE, TYPE_UINT, TYPE_INT or TYPE_FLOAT.
+} HostInput;
+
+typedef struct HostVariable {
+	Addr addr;				// Position in the stack, or -1 if there is no such variable.
+	Byte type;				// Declared type.
+} HostVariable;
+
+typedef struct HostScript {
+	Program *program;		// The compiled script, shared by its contexts.
+	Map *globals;			// The inputs and the top-level variables, by name. Values are CompilerGlobal.
+} HostScript;
+
+
+// Public functions:
+
+// Compile size bytes of source, declaring the inputs first. The script calls the functions in the
+// table natives, or the builtins if natives is NULL. Compile errors are written to err, or
+// discarded if err is NULL. Return NULL if the script did not compile.
+HostScript *host_compile(const char *source, size_t size, const HostInput *inputs, size_t input_count, Array *natives, FILE *err);
+void host_delete(HostScript *script);	// The contexts of the script must be deleted first.
+
+// A context to run the script, at its start. Its output goes to stdout; set its out field to change it.
+VM *host_context(HostScript *script);
+
+// The input or top-level variable called name.
+HostVariable host_lookup(HostScript *script, const char *name);
+
+// Read and write a variable in a context.
+// A variable exists in the stack once the declaration of it has run; inputs exist from the start.
+// Setters return 0 if the variable does not exist yet. Getters return 0 if it does not exist or
+// does not hold a value of their type.
+
+static inline int host_set_int(VM *vm, HostVariable var, Int value) {
+	if (var.addr < 0 || var.addr >= vm->stack->length)
+		return 0;
+	vm_store_int(vm, var.addr, value);
+	return 1;
+}
+
+static inline int host_set_float(VM *vm, HostVariable var, Float value) {
+	if (var.addr < 0 || var.addr >= vm->stack->length)
+		return 0;
+	vm_store_float(vm, var.addr, value);
+	return 1;
+}
+
+static inline int host_set(VM *vm, HostVariable var, Register reg) {
+	if (var.addr < 0 || var.addr >= vm->stack->length)
+		return 0;
+	vm_store(vm, var.addr, reg);
+	return 1;
+}
+
+static inline int host_get_int(VM *vm, HostVariable var, Int *value) {
+	if (var.addr < 0 || var.addr >= vm->stack->length)
+		return 0;
+	return vm_load_int(vm, var.addr, value);
+}
+
+static inline int host_get_float(VM *vm, HostVariable var, Float *value) {
+	if (var.addr < 0 || var.addr >= vm->stack->length)
+		return 0;
+	return vm_load_float(vm, var.addr, value);
+}
+
+static inline int host_get(VM *vm, HostVariable var, Register *reg) {
+	if (var.addr < 0 || var.addr >= vm->stack->length)
+		return 0;
+	*reg = vm_load(vm, var.addr);
+	return 1;
+}
+
+#endif /* __HOST_H__ */
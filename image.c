@@ -0,0 +1,373 @@
+#include "image.h"
+#include "native.h"
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Round size up to a multiple of 8 bytes, so every section is aligned.
+static size_t image_align(size_t size) {
+	return (size + 7) & ~(size_t) 7;
+}
+
+static uint32_t image_fnv(uint32_t hash, const void *data, size_t size) {
+	const Byte *bytes = (const Byte *) data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+#define IMAGE_FNV_BASIS 2166136261u
+
+int image_write(VM *vm, const char *filename) {
+	ImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+	header.version = IMAGE_VERSION;
+	header.command_count = vm->program->commands->length;
+	header.constant_count = vm->program->constants->length;
+	header.stack_length = vm->stack->length;
+	header.cmd_ptr = vm->cmd_ptr;
+
+	// The stack is written as registers whatever the layout of the machine.
+	Register *stack = (Register*) malloc(header.stack_length * sizeof(Register) + 1);
+	if (stack == NULL)
+		return 1;
+	for (size_t i = 0; i < header.stack_length; i++)
+		stack[i] = vm_get(vm, i);
+
+	// The sections in order, each followed by the padding that aligns the next one.
+	const Byte padding[8] = {0};
+	const void *sections[4] = {vm->program->commands->heap, vm->program->operands->heap, vm->program->constants->heap, stack};
+	size_t sizes[4] = {
+		header.command_count * sizeof(Byte),
+		header.command_count * sizeof(Operands),
+		header.constant_count * sizeof(Constant),
+		header.stack_length * sizeof(Register),
+	};
+
+	uint32_t checksum = IMAGE_FNV_BASIS;
+	for (int i = 0; i < 4; i++) {
+		checksum = image_fnv(checksum, sections[i], sizes[i]);
+		checksum = image_fnv(checksum, padding, image_align(sizes[i]) - sizes[i]);
+	}
+	header.checksum = checksum;
+
+	int rval = 0;
+	FILE *out = fopen(filename, "wb");
+	if (out == NULL) {
+		free(stack);
+		return 1;
+	}
+	if (fwrite(&header, sizeof(header), 1, out) != 1)
+		rval = 1;
+	for (int i = 0; i < 4 && rval == 0; i++) {
+		if (fwrite(sections[i], 1, sizes[i], out) != sizes[i])
+			rval = 1;
+		else if (fwrite(padding, 1, image_align(sizes[i]) - sizes[i], out) != image_align(sizes[i]) - sizes[i])
+			rval = 1;
+	}
+	if (fclose(out) != 0)
+		rval = 1;
+	free(stack);
+	return rval;
+}
+
+// Check the magic, version, size and checksum of the image in data, and point to its sections.
+// Return NULL on failure.
+static Image *image_check(void *data, size_t size) {
+	ImageHeader *header = (ImageHeader *) data;
+	if (size < sizeof(ImageHeader))
+		return NULL;
+	if (memcmp(header->magic, IMAGE_MAGIC, sizeof(header->magic)) != 0 || header->version != IMAGE_VERSION)
+		return NULL;
+
+	// Check the counts before they are used to compute offsets, so a broken header cannot overflow.
+	size_t payload = size - sizeof(ImageHeader);
+	if (header->command_count > payload || header->constant_count > payload || header->stack_length > payload)
+		return NULL;
+	size_t codes_size = image_align(header->command_count * sizeof(Byte));
+	size_t operands_size = image_align(header->command_count * sizeof(Operands));
+	size_t constants_size = image_align(header->constant_count * sizeof(Constant));
+	size_t stack_size = image_align(header->stack_length * sizeof(Register));
+	if (codes_size + operands_size + constants_size + stack_size != payload)
+		return NULL;
+	if (image_fnv(IMAGE_FNV_BASIS, header + 1, payload) != header->checksum)
+		return NULL;
+	if (header->cmd_ptr > header->command_count)
+		return NULL;
+
+	Image *image = (Image*) malloc(sizeof(Image));
+	if (image == NULL)
+		return NULL;
+	image->data = data;
+	image->size = size;
+	image->mapped = 0;
+	image->header = header;
+	image->codes = (Byte *) (header + 1);
+	image->operands = (Operands *) ((char *) image->codes + codes_size);
+	image->constants = (Constant *) ((char *) image->operands + operands_size);
+	image->stack = (Register *) ((char *) image->constants + constants_size);
+	return image;
+}
+
+Image *image_open(const char *filename) {
+	Image *image = NULL;
+	int fd = -1;
+	void *data = MAP_FAILED;
+	struct stat st;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		goto image_open_fail;
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(ImageHeader))
+		goto image_open_fail;
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		goto image_open_fail;
+	close(fd);
+	fd = -1;
+
+	image = image_check(data, st.st_size);
+	if (image == NULL)
+		goto image_open_fail;
+	image->mapped = 1;
+	return image;
+
+image_open_fail:
+	if (data != MAP_FAILED)
+		munmap(data, st.st_size);
+	if (fd >= 0)
+		close(fd);
+	return NULL;
+}
+
+Image *image_open_memory(void *data, size_t size) {
+	// the sections are read in place, so they must be aligned as in the file.
+	if (((uintptr_t) data & 7) != 0)
+		return NULL;
+	return image_check(data, size);
+}
+
+void image_close(Image *image) {
+	if (image->mapped)
+		munmap(image->data, image->size);
+	free(image);
+}
+
+// Check the stack addresses a command reads and writes against length, the registers it is sure
+// to find in the stack. Return true if they are all in it.
+static bool image_check_addresses(VM *vm, Byte code, const Operands *operands, int64_t length) {
+	Addr addresses[NATIVE_MAX_ARGS + 1];
+	int count = 0;
+
+	switch (vm_generic_code(code)) {
+	case CMD_SET_BYTE:
+	case CMD_SET_INT:
+	case CMD_SET_UINT:
+	case CMD_SET_FLOAT:
+	case CMD_PRINT:
+	case CMD_SET_SLEN:
+		addresses[count++] = operands->addr;
+		break;
+	case CMD_ADD:
+	case CMD_SUB:
+	case CMD_MULT:
+	case CMD_DIV:
+	case CMD_AND:
+	case CMD_OR:
+	case CMD_XOR:
+	case CMD_LSHIFT:
+	case CMD_RSHIFT:
+	case CMD_GREATER:
+	case CMD_LESS:
+	case CMD_EQUAL:
+	case CMD_NEQUAL:
+	case CMD_GEQ:
+	case CMD_LEQ:
+		addresses[count++] = operands->raddr;
+		// fall through
+	case CMD_COPY:
+	case CMD_ASSIGN:
+	case CMD_JNOT_GREATER:
+	case CMD_JNOT_LESS:
+	case CMD_JNOT_EQUAL:
+	case CMD_JNOT_NEQUAL:
+	case CMD_JNOT_GEQ:
+	case CMD_JNOT_LEQ:
+		addresses[count++] = operands->addr;
+		addresses[count++] = operands->arg;
+		break;
+	case CMD_NOT:
+		addresses[count++] = operands->addr;
+		addresses[count++] = operands->raddr;
+		break;
+	case CMD_JCOND:
+		addresses[count++] = operands->arg;
+		break;
+	case CMD_CALL_NATIVE: {
+		const Native *native = (const Native *) vm->program->natives->heap + operands->arg;
+		for (int i = 0; i < native->arg_count; i++)
+			addresses[count++] = (Addr) operands->addr + i;
+		addresses[count++] = operands->raddr;
+		break;
+	}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (addresses[i] < 0 || addresses[i] >= length)
+			return false;
+	}
+	return true;
+}
+
+// Check that the commands of the image can be run by the machine without reading or writing out
+// of its memory: every code is a command, every constant and native function exists, every jump
+// lands on a command or at the end, and every stack address is below the length the stack is sure
+// to have there. Return true if they can.
+// The length of the stack before each command is the least it has on any path from the first
+// command, from the initial stack and the pushes, pops and frames on the way. A loop that leaves
+// less stack each time it runs would underflow, and is rejected when the lengths do not settle.
+static bool image_verify(Image *image, VM *vm) {
+	ImageHeader *header = image->header;
+	size_t count = header->command_count;
+	bool valid = false;
+
+	int64_t *depths = (int64_t *) malloc(sizeof(int64_t) * (count + 1));
+	size_t *pending = (size_t *) malloc(sizeof(size_t) * (count + 1));
+	Byte *queued = (Byte *) calloc(count + 1, 1);
+	if (depths == NULL || pending == NULL || queued == NULL)
+		goto image_verify_end;
+	for (size_t i = 0; i <= count; i++)
+		depths[i] = -1;
+
+	// the lengths settle in a pass or two for compiled programs.
+	size_t budget = 16 * (count + 1);
+	size_t pending_count = 0;
+	depths[header->cmd_ptr] = header->stack_length;
+	pending[pending_count++] = header->cmd_ptr;
+	queued[header->cmd_ptr] = 1;
+	while (pending_count > 0) {
+		if (budget-- == 0)
+			goto image_verify_end;
+		size_t i = pending[--pending_count];
+		queued[i] = 0;
+		if (i == count)
+			continue;
+
+		Byte code = image->codes[i];
+		const Operands *operands = &image->operands[i];
+		int64_t depth = depths[i];
+		if (code < CMD_SET_BYTE || code > CMD_YIELD)
+			goto image_verify_end;
+
+		Byte generic = vm_generic_code(code);
+		if ((generic == CMD_SET_INT || generic == CMD_SET_UINT || generic == CMD_SET_FLOAT)
+			&& (operands->arg < 0 || (uint64_t) operands->arg >= header->constant_count))
+			goto image_verify_end;
+		// native calls are by index in the natives of the machine, which must have them all.
+		if (generic == CMD_CALL_NATIVE
+			&& (vm->program->natives == NULL || operands->arg < 0 || operands->arg >= vm->program->natives->length))
+			goto image_verify_end;
+		if (!image_check_addresses(vm, code, operands, depth))
+			goto image_verify_end;
+
+		// the length of the stack after the command, and where it goes next.
+		int64_t next_depth = depth;
+		int64_t target = -1;
+		bool falls_through = true;
+		switch (generic) {
+		case CMD_PUSH:  next_depth = depth + 1; break;
+		case CMD_POP:   next_depth = depth - 1; break;
+		case CMD_ENTER: next_depth = operands->addr < 0 ? -1 : depth + operands->addr; break;
+		case CMD_LEAVE: next_depth = operands->addr < 0 ? -1 : depth - operands->addr; break;
+		case CMD_JUMP:  target = operands->addr; falls_through = false; break;
+		case CMD_JCOND: target = operands->addr; break;
+		case CMD_EXIT:  falls_through = false; break;
+		case CMD_JNOT_GREATER:
+		case CMD_JNOT_LESS:
+		case CMD_JNOT_EQUAL:
+		case CMD_JNOT_NEQUAL:
+		case CMD_JNOT_GEQ:
+		case CMD_JNOT_LEQ:
+			target = operands->raddr;
+			break;
+		}
+		if (next_depth < 0)
+			goto image_verify_end;
+		if (target != -1 && (target < 0 || (uint64_t) target > count))
+			goto image_verify_end;
+
+		size_t successors[2];
+		int successor_count = 0;
+		if (falls_through)
+			successors[successor_count++] = i + 1;
+		if (target != -1)
+			successors[successor_count++] = target;
+		for (int j = 0; j < successor_count; j++) {
+			size_t successor = successors[j];
+			if (depths[successor] >= 0 && depths[successor] <= next_depth)
+				continue;
+			depths[successor] = next_depth;
+			if (!queued[successor]) {
+				queued[successor] = 1;
+				pending[pending_count++] = successor;
+			}
+		}
+	}
+	valid = true;
+
+image_verify_end:
+	free(depths);
+	free(pending);
+	free(queued);
+	return valid;
+}
+
+int image_attach(Image *image, VM *vm) {
+	Array *commands = NULL;
+	Array *operands = NULL;
+	Array *constants = NULL;
+	ImageHeader *header = image->header;
+
+	if (!image_verify(image, vm))
+		goto image_attach_fail;
+
+	commands = array_view(image->codes, sizeof(Byte), header->command_count);
+	if (commands == NULL)
+		goto image_attach_fail;
+	operands = array_view(image->operands, sizeof(Operands), header->command_count);
+	if (operands == NULL)
+		goto image_attach_fail;
+	constants = array_view(image->constants, sizeof(Constant), header->constant_count);
+	if (constants == NULL)
+		goto image_attach_fail;
+	vm_leave(vm, vm->stack->length);
+	if (vm_enter(vm, header->stack_length) != header->stack_length)
+		goto image_attach_fail;
+	for (size_t i = 0; i < header->stack_length; i++)
+		vm_set(vm, i, image->stack[i]);
+
+	array_delete(vm->program->commands);
+	array_delete(vm->program->operands);
+	array_delete(vm->program->constants);
+	vm->program->commands = commands;
+	vm->program->operands = operands;
+	vm->program->constants = constants;
+	vm->cmd_ptr = header->cmd_ptr;
+	vm->quicken = 0;
+	return 0;
+
+image_attach_fail:
+	if (commands != NULL)
+		array_delete(commands);
+	if (operands != NULL)
+		array_delete(operands);
+	if (constants != NULL)
+		array_delete(constants);
+	return 1;
+}
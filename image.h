@@ -0,0 +1,71 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include <stdint.h>
+#include "vm.h"
+
+/*
+ * Binary images of compiled programs.
+ *
+ * An image holds what the machine needs to run a program without parsing it: the command codes,
+ * their operands, the constant pool, the initial stack and the command to start from. It is laid
+ * out so that the codes, operands and constants can be used where they are once the file is
+ * mapped in memory:
+ *
+ *     ImageHeader
+ *     codes       command_count bytes, padded to 8 bytes
+ *     operands    command_count Operands, padded to 8 bytes
+ *     constants   constant_count Constant
+ *     stack       stack_length Register
+ *
+ * Numbers are in the byte order of the machine that wrote the image. The checksum is the 32-bit
+ * FNV-1a hash of everything after the header.
+ */
+
+#define IMAGE_MAGIC "LANGIMG"	// Eight bytes with the terminating zero.
+#define IMAGE_VERSION 4			// Changes whenever the layout or the command set changes.
+
+typedef struct ImageHeader {
+	char magic[8];				// IMAGE_MAGIC.
+	uint32_t version;			// IMAGE_VERSION of the program that wrote the image.
+	uint32_t checksum;			// FNV-1a of the sections after the header.
+	uint64_t command_count;		// Number of commands, and of operands.
+	uint64_t constant_count;	// Number of constants in the pool.
+	uint64_t stack_length;		// Number of registers in the initial stack.
+	uint64_t cmd_ptr;			// The command to start running from.
+} ImageHeader;
+
+// An image mapped read-only in memory.
+typedef struct Image {
+	void *data;					// The mapped file, or the memory given to image_open_memory.
+	size_t size;				// Size of the file in bytes.
+	int mapped;					// If true, data is mapped and unmapped by image_close.
+	ImageHeader *header;		// The header, at the start of data.
+	Byte *codes;				// The sections, inside data.
+	Operands *operands;
+	Constant *constants;
+	Register *stack;
+} Image;
+
+
+// Public functions:
+
+// Write the commands, constants and stack of the machine to filename. Return 0 on success.
+int image_write(VM *vm, const char *filename);
+
+// Map the image in filename and check its magic, version, size and checksum. Return NULL on failure.
+Image *image_open(const char *filename);
+void image_close(Image *image);
+
+// Like image_open, for an image already in memory, which must be aligned to 8 bytes and outlive
+// the image. image_close leaves the memory alone.
+Image *image_open_memory(void *data, size_t size);
+
+// Make the machine run the program of the image. The commands are checked first: an image with
+// a command the machine does not have, or one that could read or write out of the constants, the
+// commands, the natives of the machine or its stack, is refused. The commands and constants are
+// used in place, so the image must stay open until the machine is deleted, and they are
+// read-only: the machine cannot quicken them. The stack is copied. Return 0 on success.
+int image_attach(Image *image, VM *vm);
+
+#endif /* __IMAGE_H__ */
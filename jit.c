@@ -0,0 +1,1162 @@
+#include "jit.h"
+#include "native.h"
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__) && defined(VM_REGISTER_STACK)
+#include <sys/mman.h>
+#include <unistd.h>
+#define JIT_X86_64
+#endif
+
+Jit *jit_new() {
+	Jit *jit = NULL;
+	Array *counters = NULL;
+	Array *functions = NULL;
+	Array *regions = NULL;
+
+	jit = (Jit*) malloc(sizeof(Jit));
+	if (jit == NULL)
+		goto jit_new_fail;
+	counters = array_new(sizeof(uint32_t), 0);
+	if (counters == NULL)
+		goto jit_new_fail;
+	functions = array_new(sizeof(JitFunction), 0);
+	if (functions == NULL)
+		goto jit_new_fail;
+	regions = array_new(sizeof(JitRegion), 0);
+	if (regions == NULL)
+		goto jit_new_fail;
+
+	jit->counters = counters;
+	jit->functions = functions;
+	jit->regions = regions;
+	jit->perf_map = NULL;
+	return jit;
+
+jit_new_fail:
+	if (jit != NULL)
+		free(jit);
+	if (counters != NULL)
+		array_delete(counters);
+	if (functions != NULL)
+		array_delete(functions);
+	if (regions != NULL)
+		array_delete(regions);
+	return NULL;
+}
+
+void jit_delete(Jit *jit) {
+	jit_reset(jit);
+	array_delete(jit->counters);
+	array_delete(jit->functions);
+	array_delete(jit->regions);
+	if (jit->perf_map != NULL)
+		fclose(jit->perf_map);
+	free(jit);
+}
+
+void jit_reset(Jit *jit) {
+#ifdef JIT_X86_64
+	for (int i = 0; i < jit->regions->length; i++) {
+		JitRegion region;
+		array_get(jit->regions, i, &region);
+		munmap(region.code, region.size);
+	}
+#endif
+	jit->counters->length = 0;
+	jit->functions->length = 0;
+	jit->regions->length = 0;
+}
+
+
+#ifdef JIT_X86_64
+
+/*
+ * Code generation.
+ *
+ * Native code keeps the base of the machine stack in rbx and the machine in r12. A register at
+ * address a is at [rbx + a * sizeof(Register)]. Helper calls may grow the stack and move it, so
+ * rbx is loaded again after each one.
+ */
+
+// A rel32 field in the code to be set once its destination is known.
+typedef struct JitFixup {
+	size_t pos;		// Offset of the rel32 field in the code.
+	Addr target;	// Command to jump to.
+} JitFixup;
+
+typedef struct JitBuilder {
+	VM *vm;
+	Addr start;		// First command of the loop.
+	Addr end;		// Last command of the loop, the backward jump.
+	Array *code;	// The machine code. An array of uint8_t.
+	Array *labels;	// Offset in the code of each command of the loop. An array of size_t.
+	Array *jumps;	// Jumps to commands of the loop. An array of JitFixup.
+	Array *exits;	// Jumps back to the interpreter. An array of JitFixup.
+	Array *known;	// Types of registers known at the current point of a trace. An array of JitKnown.
+} JitBuilder;
+
+typedef struct JitKnown {
+	Addr addr;
+	Byte type;
+} JitKnown;
+
+// Condition codes, as in the low nibble of jcc and setcc.
+enum JitCondition {
+	CC_B = 0x2,
+	CC_AE = 0x3,
+	CC_E = 0x4,
+	CC_NE = 0x5,
+	CC_BE = 0x6,
+	CC_A = 0x7,
+	CC_P = 0xA,
+	CC_NP = 0xB,
+	CC_L = 0xC,
+	CC_GE = 0xD,
+	CC_LE = 0xE,
+	CC_G = 0xF
+};
+
+// Largest stack address a template can encode in a 32-bit displacement.
+#define JIT_MAX_SLOT ((Addr) (INT32_MAX / sizeof(Register)) - 1)
+
+#define EMIT(b, ...) {														\
+	uint8_t bytes[] = { __VA_ARGS__ };										\
+	jit_emit(b, bytes, sizeof(bytes));										\
+}
+
+static void jit_emit(JitBuilder *b, const uint8_t *bytes, size_t size) {
+	for (size_t i = 0; i < size; i++)
+		array_push(b->code, (void *) (bytes + i));
+}
+
+static void jit_emit32(JitBuilder *b, uint32_t value) {
+	jit_emit(b, (uint8_t *) &value, sizeof(value));
+}
+
+static void jit_emit64(JitBuilder *b, uint64_t value) {
+	jit_emit(b, (uint8_t *) &value, sizeof(value));
+}
+
+static size_t jit_here(JitBuilder *b) {
+	return b->code->length;
+}
+
+// Set the rel32 field at pos to reach the code offset target.
+static void jit_patch(JitBuilder *b, size_t pos, size_t target) {
+	int32_t rel = (int32_t) (target - (pos + 4));
+	memcpy((uint8_t *) b->code->heap + pos, &rel, sizeof(rel));
+}
+
+// Emit a conditional jump with its destination unset. Return the position of its rel32 field.
+static size_t jit_jcc(JitBuilder *b, Byte cc) {
+	EMIT(b, 0x0F, 0x80 | cc);
+	size_t pos = jit_here(b);
+	jit_emit32(b, 0);
+	return pos;
+}
+
+// Emit an unconditional jump with its destination unset. Return the position of its rel32 field.
+static size_t jit_jmp(JitBuilder *b) {
+	EMIT(b, 0xE9);
+	size_t pos = jit_here(b);
+	jit_emit32(b, 0);
+	return pos;
+}
+
+// Send the jump at pos back to the interpreter, to continue from target.
+static void jit_exit(JitBuilder *b, size_t pos, Addr target) {
+	JitFixup fixup = { pos, target };
+	array_push(b->exits, &fixup);
+}
+
+// Send the jump at pos to a command: inside the native code if it is in the loop, otherwise
+// back to the interpreter.
+static void jit_branch(JitBuilder *b, size_t pos, Addr target) {
+	JitFixup fixup = { pos, target };
+	if (target >= b->start && target <= b->end)
+		array_push(b->jumps, &fixup);
+	else
+		jit_exit(b, pos, target);
+}
+
+static int jit_fits(Addr addr) {
+	return addr >= 0 && addr <= JIT_MAX_SLOT;
+}
+
+static int32_t jit_type_disp(Addr addr) {
+	return (int32_t) (addr * sizeof(Register) + offsetof(Register, type));
+}
+
+static int32_t jit_value_disp(Addr addr) {
+	return (int32_t) (addr * sizeof(Register) + offsetof(Register, int_value));
+}
+
+// mov rbx, [r12 + stack]; mov rbx, [rbx + heap]
+static void jit_load_base(JitBuilder *b) {
+	EMIT(b, 0x49, 0x8B, 0x9C, 0x24);
+	jit_emit32(b, offsetof(VM, stack));
+	EMIT(b, 0x48, 0x8B, 0x9B);
+	jit_emit32(b, offsetof(Array, heap));
+}
+
+// cmp byte [type of addr], type
+static void jit_cmp_type(JitBuilder *b, Addr addr, Byte type) {
+	EMIT(b, 0x80, 0xBB);
+	jit_emit32(b, jit_type_disp(addr));
+	EMIT(b, type);
+}
+
+// mov byte [type of addr], type
+static void jit_set_type(JitBuilder *b, Addr addr, Byte type) {
+	EMIT(b, 0xC6, 0x83);
+	jit_emit32(b, jit_type_disp(addr));
+	EMIT(b, type);
+}
+
+// mov reg, [rbx + disp], where reg is a register below r8: 0 for rax, 1 for rcx and so on.
+static void jit_load(JitBuilder *b, int reg, int32_t disp) {
+	EMIT(b, 0x48, 0x8B, 0x83 | (reg << 3));
+	jit_emit32(b, disp);
+}
+
+// mov [rbx + disp], reg, where reg is 0 for rax and 1 for rcx.
+static void jit_store(JitBuilder *b, int reg, int32_t disp) {
+	EMIT(b, 0x48, 0x89, 0x83 | (reg << 3));
+	jit_emit32(b, disp);
+}
+
+// movsd xmm, [value of addr]
+static void jit_load_float(JitBuilder *b, int xmm, Addr addr) {
+	EMIT(b, 0xF2, 0x0F, 0x10, 0x83 | (xmm << 3));
+	jit_emit32(b, jit_value_disp(addr));
+}
+
+// movsd [value of addr], xmm0
+static void jit_store_float(JitBuilder *b, Addr addr) {
+	EMIT(b, 0xF2, 0x0F, 0x11, 0x83);
+	jit_emit32(b, jit_value_disp(addr));
+}
+
+// Run one command with the interpreter, on behalf of the native code.
+static void jit_execute(VM *vm, Addr pc) {
+	vm->cmd_ptr = pc;
+	vm_execute(vm, vm_get_cmd(vm, pc));
+}
+
+// Call a native function with its arguments straight from the registers of the stack, where the
+// ABI wants them: ints in rdi, rsi and rdx, floats in xmm0 to xmm2. Store its result in raddr.
+// The compiler made the arguments of the types of the parameters. Return 0 if a register is out
+// of reach.
+static int jit_native(JitBuilder *b, const Operands *ops) {
+	static const int int_registers[NATIVE_MAX_ARGS] = { 7, 6, 2 };
+	const Native *native = (Native *) b->vm->program->natives->heap + ops->arg;
+	int ints = 0;
+	int floats = 0;
+	if (!jit_fits(ops->addr) || !jit_fits(ops->addr + native->arg_count) || !jit_fits(ops->raddr))
+		return 0;
+
+	for (int i = 0; i < native->arg_count; i++) {
+		if (native->args[i] == TYPE_FLOAT)
+			jit_load_float(b, floats++, ops->addr + i);
+		else
+			jit_load(b, int_registers[ints++], jit_value_disp(ops->addr + i));
+	}
+	EMIT(b, 0x48, 0xB8);						// mov rax, function
+	jit_emit64(b, (uint64_t) (uintptr_t) native->function);
+	EMIT(b, 0xFF, 0xD0);						// call rax
+	if (native->result == TYPE_FLOAT)
+		jit_store_float(b, ops->raddr);
+	else
+		jit_store(b, 0, jit_value_disp(ops->raddr));
+	jit_set_type(b, ops->raddr, native->result);
+	return 1;
+}
+
+// Call jit_execute for the command at pc, then reload the stack base.
+static void jit_call_execute(JitBuilder *b, Addr pc) {
+	EMIT(b, 0x4C, 0x89, 0xE7);					// mov rdi, r12
+	EMIT(b, 0xBE);								// mov esi, pc
+	jit_emit32(b, (uint32_t) pc);
+	EMIT(b, 0x48, 0xB8);						// mov rax, jit_execute
+	jit_emit64(b, (uint64_t) (uintptr_t) jit_execute);
+	EMIT(b, 0xFF, 0xD0);						// call rax
+	jit_load_base(b);
+}
+
+// Set al to the truth of a comparison of xmm0 with xmm1, with the unordered cases false.
+static void jit_float_relation(JitBuilder *b, Byte relation) {
+	switch (relation) {
+	case CMD_GREATER:
+		EMIT(b, 0x66, 0x0F, 0x2E, 0xC1);		// ucomisd xmm0, xmm1
+		EMIT(b, 0x0F, 0x90 | CC_A, 0xC0);		// seta al
+		break;
+	case CMD_GEQ:
+		EMIT(b, 0x66, 0x0F, 0x2E, 0xC1);		// ucomisd xmm0, xmm1
+		EMIT(b, 0x0F, 0x90 | CC_AE, 0xC0);		// setae al
+		break;
+	case CMD_LESS:
+		EMIT(b, 0x66, 0x0F, 0x2E, 0xC8);		// ucomisd xmm1, xmm0
+		EMIT(b, 0x0F, 0x90 | CC_A, 0xC0);		// seta al
+		break;
+	case CMD_LEQ:
+		EMIT(b, 0x66, 0x0F, 0x2E, 0xC8);		// ucomisd xmm1, xmm0
+		EMIT(b, 0x0F, 0x90 | CC_AE, 0xC0);		// setae al
+		break;
+	case CMD_EQUAL:
+		EMIT(b, 0x66, 0x0F, 0x2E, 0xC1);		// ucomisd xmm0, xmm1
+		EMIT(b, 0x0F, 0x90 | CC_E, 0xC0);		// sete al
+		EMIT(b, 0x0F, 0x90 | CC_NP, 0xC1);		// setnp cl
+		EMIT(b, 0x20, 0xC8);					// and al, cl
+		break;
+	case CMD_NEQUAL:
+		EMIT(b, 0x66, 0x0F, 0x2E, 0xC1);		// ucomisd xmm0, xmm1
+		EMIT(b, 0x0F, 0x90 | CC_NE, 0xC0);		// setne al
+		EMIT(b, 0x0F, 0x90 | CC_P, 0xC1);		// setp cl
+		EMIT(b, 0x08, 0xC8);					// or al, cl
+		break;
+	}
+}
+
+// Condition code of an int comparison command.
+static Byte jit_int_condition(Byte relation) {
+	switch (relation) {
+	case CMD_GREATER: return CC_G;
+	case CMD_LESS: return CC_L;
+	case CMD_EQUAL: return CC_E;
+	case CMD_NEQUAL: return CC_NE;
+	case CMD_GEQ: return CC_GE;
+	case CMD_LEQ: default: return CC_LE;
+	}
+}
+
+// Relation tested by a fused compare-and-branch command.
+static Byte jit_jnot_relation(Byte code) {
+	switch (code) {
+	case CMD_JNOT_GREATER: return CMD_GREATER;
+	case CMD_JNOT_LESS: return CMD_LESS;
+	case CMD_JNOT_EQUAL: return CMD_EQUAL;
+	case CMD_JNOT_NEQUAL: return CMD_NEQUAL;
+	case CMD_JNOT_GEQ: return CMD_GEQ;
+	case CMD_JNOT_LEQ: default: return CMD_LEQ;
+	}
+}
+
+/*
+ * Arithmetic and comparison commands. Pairs of ints and pairs of floats run natively, with the
+ * same result types as the interpreter. Other operands go through jit_execute. Int division is
+ * always left to the interpreter.
+ */
+static void jit_binary(JitBuilder *b, Addr pc, Byte code, const Operands *ops) {
+	Addr lval = ops->addr;
+	Addr rval = ops->arg;
+	Addr result = ops->raddr;
+	size_t to_slow[3];
+	size_t to_next[2];
+	int slows = 0;
+	int nexts = 0;
+
+	if (code != CMD_DIV) {
+		jit_cmp_type(b, lval, TYPE_INT);
+		size_t to_float = jit_jcc(b, CC_NE);
+		jit_cmp_type(b, rval, TYPE_INT);
+		to_slow[slows++] = jit_jcc(b, CC_NE);
+		jit_load(b, 0, jit_value_disp(lval));
+		jit_load(b, 1, jit_value_disp(rval));
+		switch (code) {
+		case CMD_ADD:
+			EMIT(b, 0x48, 0x01, 0xC8);			// add rax, rcx
+			break;
+		case CMD_SUB:
+			EMIT(b, 0x48, 0x29, 0xC8);			// sub rax, rcx
+			break;
+		case CMD_MULT:
+			EMIT(b, 0x48, 0x0F, 0xAF, 0xC1);	// imul rax, rcx
+			break;
+		default:
+			EMIT(b, 0x48, 0x39, 0xC8);			// cmp rax, rcx
+			EMIT(b, 0x0F, 0x90 | jit_int_condition(code), 0xC0);	// setcc al
+			EMIT(b, 0x0F, 0xB6, 0xC0);			// movzx eax, al
+			break;
+		}
+		jit_store(b, 0, jit_value_disp(result));
+		jit_set_type(b, result, TYPE_INT);
+		to_next[nexts++] = jit_jmp(b);
+		jit_patch(b, to_float, jit_here(b));
+	}
+
+	jit_cmp_type(b, lval, TYPE_FLOAT);
+	to_slow[slows++] = jit_jcc(b, CC_NE);
+	jit_cmp_type(b, rval, TYPE_FLOAT);
+	to_slow[slows++] = jit_jcc(b, CC_NE);
+	jit_load_float(b, 0, lval);
+	jit_load_float(b, 1, rval);
+	switch (code) {
+	case CMD_ADD:
+		EMIT(b, 0xF2, 0x0F, 0x58, 0xC1);		// addsd xmm0, xmm1
+		break;
+	case CMD_SUB:
+		EMIT(b, 0xF2, 0x0F, 0x5C, 0xC1);		// subsd xmm0, xmm1
+		break;
+	case CMD_MULT:
+		EMIT(b, 0xF2, 0x0F, 0x59, 0xC1);		// mulsd xmm0, xmm1
+		break;
+	case CMD_DIV:
+		EMIT(b, 0xF2, 0x0F, 0x5E, 0xC1);		// divsd xmm0, xmm1
+		break;
+	default:
+		jit_float_relation(b, code);
+		EMIT(b, 0x0F, 0xB6, 0xC0);				// movzx eax, al
+		EMIT(b, 0xF2, 0x48, 0x0F, 0x2A, 0xC0);	// cvtsi2sd xmm0, rax
+		break;
+	}
+	jit_store_float(b, result);
+	jit_set_type(b, result, TYPE_FLOAT);
+	to_next[nexts++] = jit_jmp(b);
+
+	for (int i = 0; i < slows; i++)
+		jit_patch(b, to_slow[i], jit_here(b));
+	jit_call_execute(b, pc);
+
+	for (int i = 0; i < nexts; i++)
+		jit_patch(b, to_next[i], jit_here(b));
+}
+
+/*
+ * Fused compare-and-branch. Pairs of ints and pairs of floats branch natively; other operands
+ * leave the native code so the interpreter runs the command. A branch to pc would be a branch to
+ * this very command, inside the loop.
+ */
+static void jit_jnot(JitBuilder *b, Addr pc, Byte code, const Operands *ops) {
+	Addr lval = ops->addr;
+	Addr rval = ops->arg;
+	Byte relation = jit_jnot_relation(code);
+
+	jit_cmp_type(b, lval, TYPE_INT);
+	size_t to_float = jit_jcc(b, CC_NE);
+	jit_cmp_type(b, rval, TYPE_INT);
+	jit_exit(b, jit_jcc(b, CC_NE), pc);
+	jit_load(b, 0, jit_value_disp(lval));
+	EMIT(b, 0x48, 0x3B, 0x83);					// cmp rax, [rval]
+	jit_emit32(b, jit_value_disp(rval));
+	jit_branch(b, jit_jcc(b, jit_int_condition(relation) ^ 1), ops->raddr);
+	size_t to_next = jit_jmp(b);
+
+	jit_patch(b, to_float, jit_here(b));
+	jit_cmp_type(b, lval, TYPE_FLOAT);
+	jit_exit(b, jit_jcc(b, CC_NE), pc);
+	jit_cmp_type(b, rval, TYPE_FLOAT);
+	jit_exit(b, jit_jcc(b, CC_NE), pc);
+	jit_load_float(b, 0, lval);
+	jit_load_float(b, 1, rval);
+	jit_float_relation(b, relation);
+	EMIT(b, 0x84, 0xC0);						// test al, al
+	jit_branch(b, jit_jcc(b, CC_E), ops->raddr);
+
+	jit_patch(b, to_next, jit_here(b));
+}
+
+/*
+ * Assignment between registers of the same numeric type copies the value natively. Conversions
+ * go through jit_execute.
+ */
+static void jit_assign(JitBuilder *b, Addr pc, const Operands *ops) {
+	EMIT(b, 0x8A, 0x83);						// mov al, [type of addr]
+	jit_emit32(b, jit_type_disp(ops->addr));
+	EMIT(b, 0x3A, 0x83);						// cmp al, [type of addr_arg]
+	jit_emit32(b, jit_type_disp(ops->arg));
+	size_t to_slow = jit_jcc(b, CC_NE);
+	EMIT(b, 0x2C, 0x01);						// sub al, 1
+	EMIT(b, 0x3C, TYPE_BYTE - 1);				// cmp al, TYPE_BYTE - 1
+	size_t to_slow_type = jit_jcc(b, CC_A);
+	jit_load(b, 0, jit_value_disp(ops->arg));
+	jit_store(b, 0, jit_value_disp(ops->addr));
+	size_t to_next = jit_jmp(b);
+
+	jit_patch(b, to_slow, jit_here(b));
+	jit_patch(b, to_slow_type, jit_here(b));
+	jit_call_execute(b, pc);
+	jit_patch(b, to_next, jit_here(b));
+}
+
+/*
+ * Frame commands change the length of the stack in place; a push is an enter of one register. An
+ * enter that needs the stack to grow its capacity, and a leave of more registers than the stack
+ * has, leave the native code for the interpreter, which grows the stack or stops the machine.
+ */
+static void jit_frame(JitBuilder *b, Addr pc, Byte code, Addr size) {
+	EMIT(b, 0x49, 0x8B, 0x84, 0x24);			// mov rax, [r12 + stack]
+	jit_emit32(b, offsetof(VM, stack));
+	if (code == CMD_LEAVE) {
+		EMIT(b, 0x48, 0x81, 0xB8);				// cmp qword [rax + length], size
+		jit_emit32(b, offsetof(Array, length));
+		jit_emit32(b, (uint32_t) size);
+		jit_exit(b, jit_jcc(b, CC_B), pc);
+		EMIT(b, 0x48, 0x81, 0xA8);				// sub qword [rax + length], size
+		jit_emit32(b, offsetof(Array, length));
+		jit_emit32(b, (uint32_t) size);
+		return;
+	}
+	EMIT(b, 0x48, 0x8B, 0x88);					// mov rcx, [rax + length]
+	jit_emit32(b, offsetof(Array, length));
+	EMIT(b, 0x48, 0x81, 0xC1);					// add rcx, size
+	jit_emit32(b, (uint32_t) size);
+	EMIT(b, 0x48, 0x3B, 0x88);					// cmp rcx, [rax + capacity]
+	jit_emit32(b, offsetof(Array, capacity));
+	jit_exit(b, jit_jcc(b, CC_A), pc);
+	EMIT(b, 0x48, 0x89, 0x88);					// mov [rax + length], rcx
+	jit_emit32(b, offsetof(Array, length));
+}
+
+static void jit_command(JitBuilder *b, Addr pc) {
+	Byte code = vm_generic_code(((Byte *) b->vm->program->commands->heap)[pc]);
+	const Operands *ops = (Operands *) b->vm->program->operands->heap + pc;
+	const Constant *constants = (Constant *) b->vm->program->constants->heap;
+
+	switch (code) {
+	case CMD_COPY:
+		if (!jit_fits(ops->addr) || !jit_fits(ops->arg))
+			break;
+		jit_load(b, 0, ops->arg * sizeof(Register));
+		jit_load(b, 1, ops->arg * sizeof(Register) + 8);
+		jit_store(b, 0, ops->addr * sizeof(Register));
+		jit_store(b, 1, ops->addr * sizeof(Register) + 8);
+		return;
+
+	case CMD_ASSIGN:
+		if (!jit_fits(ops->addr) || !jit_fits(ops->arg))
+			break;
+		jit_assign(b, pc, ops);
+		return;
+
+	case CMD_ENTER:
+	case CMD_LEAVE:
+		if (ops->addr < 0 || ops->addr > INT32_MAX)
+			break;
+		jit_frame(b, pc, code, ops->addr);
+		return;
+
+	case CMD_PUSH:
+		jit_frame(b, pc, CMD_ENTER, 1);
+		return;
+
+	case CMD_SET_BYTE:
+		if (!jit_fits(ops->addr))
+			break;
+		EMIT(b, 0xC6, 0x83);					// mov byte [value], arg
+		jit_emit32(b, jit_value_disp(ops->addr));
+		EMIT(b, (Byte) ops->arg);
+		jit_set_type(b, ops->addr, TYPE_BYTE);
+		return;
+
+	case CMD_SET_UINT:
+	case CMD_SET_INT:
+	case CMD_SET_FLOAT:
+		if (!jit_fits(ops->addr))
+			break;
+		EMIT(b, 0x48, 0xB8);					// mov rax, constant
+		jit_emit64(b, constants[ops->arg].uint_value);
+		jit_store(b, 0, jit_value_disp(ops->addr));
+		jit_set_type(b, ops->addr,
+			code == CMD_SET_UINT ? TYPE_UINT : code == CMD_SET_INT ? TYPE_INT : TYPE_FLOAT);
+		return;
+
+	case CMD_ADD:
+	case CMD_SUB:
+	case CMD_MULT:
+	case CMD_DIV:
+	case CMD_GREATER:
+	case CMD_LESS:
+	case CMD_EQUAL:
+	case CMD_NEQUAL:
+	case CMD_GEQ:
+	case CMD_LEQ:
+		if (!jit_fits(ops->addr) || !jit_fits(ops->arg) || !jit_fits(ops->raddr))
+			break;
+		jit_binary(b, pc, code, ops);
+		return;
+
+	case CMD_JUMP:
+		jit_branch(b, jit_jmp(b), ops->addr);
+		return;
+
+	case CMD_JCOND:
+		if (!jit_fits(ops->arg)) {
+			jit_exit(b, jit_jmp(b), pc);
+			return;
+		}
+		jit_cmp_type(b, ops->arg, TYPE_INT);
+		jit_exit(b, jit_jcc(b, CC_NE), pc);
+		EMIT(b, 0x48, 0x83, 0xBB);				// cmp qword [value], 0
+		jit_emit32(b, jit_value_disp(ops->arg));
+		EMIT(b, 0x00);
+		jit_branch(b, jit_jcc(b, CC_NE), ops->addr);
+		return;
+
+	case CMD_JNOT_GREATER:
+	case CMD_JNOT_LESS:
+	case CMD_JNOT_EQUAL:
+	case CMD_JNOT_NEQUAL:
+	case CMD_JNOT_GEQ:
+	case CMD_JNOT_LEQ:
+		if (!jit_fits(ops->addr) || !jit_fits(ops->arg)) {
+			jit_exit(b, jit_jmp(b), pc);
+			return;
+		}
+		jit_jnot(b, pc, code, ops);
+		return;
+
+	case CMD_EXIT:
+	case CMD_YIELD:
+		// back to the interpreter, which runs the command itself: a branch to pc would be a
+		// branch into the loop, to this very jump.
+		jit_exit(b, jit_jmp(b), pc);
+		return;
+
+	case CMD_CALL_NATIVE:
+		if (jit_native(b, ops))
+			return;
+		break;
+	}
+
+	// no template: let the interpreter run it.
+	jit_call_execute(b, pc);
+}
+
+// Write a line for the code to the perf map of the process.
+static void jit_perf_map(Jit *jit, void *code, size_t size, const char *kind, Addr start, Addr end) {
+	if (jit->perf_map == NULL) {
+		char path[64];
+		snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int) getpid());
+		jit->perf_map = fopen(path, "a");
+		if (jit->perf_map == NULL)
+			return;
+	}
+	fprintf(jit->perf_map, "%lx %lx vm_%s_%ld_%ld\n", (unsigned long) code, (unsigned long) size, kind, start, end);
+	fflush(jit->perf_map);
+}
+
+// Set up a builder for the loop from start to end. Return 0 on success.
+static int jit_builder_init(JitBuilder *b, VM *vm, Addr start, Addr end) {
+	b->vm = vm;
+	b->start = start;
+	b->end = end;
+	b->code = array_new(sizeof(uint8_t), 0);
+	b->labels = array_new(sizeof(size_t), 0);
+	b->jumps = array_new(sizeof(JitFixup), 0);
+	b->exits = array_new(sizeof(JitFixup), 0);
+	b->known = array_new(sizeof(JitKnown), 0);
+	if (b->code == NULL || b->labels == NULL || b->jumps == NULL || b->exits == NULL || b->known == NULL)
+		return 1;
+	return end >= (Addr) INT32_MAX;
+}
+
+static void jit_builder_free(JitBuilder *b) {
+	if (b->code != NULL)
+		array_delete(b->code);
+	if (b->labels != NULL)
+		array_delete(b->labels);
+	if (b->jumps != NULL)
+		array_delete(b->jumps);
+	if (b->exits != NULL)
+		array_delete(b->exits);
+	if (b->known != NULL)
+		array_delete(b->known);
+}
+
+// Save the registers the native code uses and load the machine and the stack base.
+// r13 is pushed only to keep the stack aligned for helper calls.
+static void jit_prologue(JitBuilder *b) {
+	EMIT(b, 0x53);								// push rbx
+	EMIT(b, 0x41, 0x54);						// push r12
+	EMIT(b, 0x41, 0x55);						// push r13
+	EMIT(b, 0x49, 0x89, 0xFC);					// mov r12, rdi
+	jit_load_base(b);
+}
+
+/*
+ * Emit the epilogue and the exits, resolve the jumps, and copy the code to executable pages.
+ * Return the native function, or NULL if the pages could not be set up.
+ */
+static JitFunction jit_install(JitBuilder *b, const char *kind) {
+	size_t epilogue = jit_here(b);
+	EMIT(b, 0x41, 0x5D);						// pop r13
+	EMIT(b, 0x41, 0x5C);						// pop r12
+	EMIT(b, 0x5B);								// pop rbx
+	EMIT(b, 0xC3);								// ret
+
+	// exits return the command to continue from.
+	for (int i = 0; i < b->exits->length; i++) {
+		JitFixup fixup;
+		array_get(b->exits, i, &fixup);
+		jit_patch(b, fixup.pos, jit_here(b));
+		EMIT(b, 0xB8);							// mov eax, target
+		jit_emit32(b, (uint32_t) fixup.target);
+		jit_patch(b, jit_jmp(b), epilogue);
+	}
+
+	for (int i = 0; i < b->jumps->length; i++) {
+		JitFixup fixup;
+		size_t label;
+		array_get(b->jumps, i, &fixup);
+		array_get(b->labels, fixup.target - b->start, &label);
+		jit_patch(b, fixup.pos, label);
+	}
+
+	long page = sysconf(_SC_PAGESIZE);
+	size_t size = (b->code->length + page - 1) / page * page;
+	void *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+		return NULL;
+	memcpy(code, b->code->heap, b->code->length);
+	if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+		munmap(code, size);
+		return NULL;
+	}
+
+	JitRegion region = { code, size };
+	array_push(b->vm->jit_state->regions, &region);
+	jit_perf_map(b->vm->jit_state, code, b->code->length, kind, b->start, b->end);
+	return (JitFunction) code;
+}
+
+// Translate commands start to end to native code. Return NULL if it could not be done.
+static JitFunction jit_compile(VM *vm, Addr start, Addr end) {
+	JitFunction function = NULL;
+	JitBuilder b;
+	if (jit_builder_init(&b, vm, start, end))
+		goto jit_compile_end;
+
+	jit_prologue(&b);
+	for (Addr pc = start; pc <= end; pc++) {
+		size_t label = jit_here(&b);
+		array_push(b.labels, &label);
+		jit_command(&b, pc);
+	}
+	jit_branch(&b, jit_jmp(&b), end + 1);
+	function = jit_install(&b, "loop");
+
+jit_compile_end:
+	jit_builder_free(&b);
+	return function;
+}
+
+
+/*
+ * Trace recording and compilation.
+ */
+
+// A command run while recording, with the types its operands had and where it went next.
+typedef struct JitStep {
+	Addr pc;
+	Byte code;			// Generic command code.
+	Operands ops;
+	Byte ltype;			// Type of the register at addr, for commands that read it.
+	Byte rtype;			// Type of the register at addr_arg.
+	Addr next;			// Command run after this one.
+} JitStep;
+
+// True if the command reads registers at addr and addr_arg.
+static int jit_reads_both(Byte code) {
+	return code == CMD_ASSIGN
+		|| (code >= CMD_ADD && code <= CMD_DIV)
+		|| (code >= CMD_GREATER && code <= CMD_LEQ)
+		|| (code >= CMD_JNOT_GREATER && code <= CMD_JNOT_LEQ);
+}
+
+static Byte jit_type_at(VM *vm, Addr addr) {
+	if (addr < 0 || addr >= vm->stack->length)
+		return 0;
+	return vm_load(vm, addr).type;
+}
+
+/*
+ * Run one iteration of the loop at start in the interpreter and record it in trace.
+ * Set next to the command the interpreter continues from.
+ * Return 1 if the iteration came back to start, 0 if it has to stay interpreted.
+ */
+static int jit_record(VM *vm, Addr start, Array *trace, Addr *next) {
+	Addr pc = start;
+	do {
+		if (trace->length >= JIT_MAX_TRACE) {
+			*next = pc;
+			return 0;
+		}
+
+		JitStep step;
+		Command cmd = vm_get_cmd(vm, pc);
+		if (cmd.code == CMD_YIELD) {
+			// the interpreter may have to stop there.
+			*next = pc;
+			return 0;
+		}
+		step.pc = pc;
+		step.code = vm_generic_code(cmd.code);
+		step.ops = ((Operands *) vm->program->operands->heap)[pc];
+		step.ltype = 0;
+		step.rtype = 0;
+		if (jit_reads_both(step.code)) {
+			step.ltype = jit_type_at(vm, cmd.addr);
+			step.rtype = jit_type_at(vm, cmd.addr_arg);
+		}
+		else if (step.code == CMD_JCOND) {
+			step.rtype = jit_type_at(vm, cmd.addr_arg);
+		}
+
+		vm->cmd_ptr = pc;
+		if (vm_execute(vm, cmd) < 0 && (step.code == CMD_ENTER || step.code == CMD_LEAVE || step.code == CMD_PUSH)) {
+			// the frame or push failed and changed nothing: the interpreter runs it again and stops there.
+			*next = pc;
+			return 0;
+		}
+		pc = vm->cmd_ptr + 1;
+		step.next = pc;
+		array_push(trace, &step);
+
+		// the end of the program, or a jump back that is not the loop's own.
+		if (pc >= vm->program->commands->length || (pc <= step.pc && pc != start)) {
+			*next = pc;
+			return 0;
+		}
+	} while (pc != start);
+
+	*next = start;
+	return 1;
+}
+
+// Type the trace knows the register at addr has, or 0.
+static Byte jit_known(JitBuilder *b, Addr addr) {
+	JitKnown *known = (JitKnown *) b->known->heap;
+	for (int i = 0; i < b->known->length; i++)
+		if (known[i].addr == addr)
+			return known[i].type;
+	return 0;
+}
+
+static void jit_learn(JitBuilder *b, Addr addr, Byte type) {
+	JitKnown *known = (JitKnown *) b->known->heap;
+	for (int i = 0; i < b->known->length; i++) {
+		if (known[i].addr == addr) {
+			known[i].type = type;
+			return;
+		}
+	}
+	JitKnown fact = { addr, type };
+	array_push(b->known, &fact);
+}
+
+// Leave the trace at pc unless the register at addr has type. Nothing is emitted if the trace
+// already knows it.
+static void jit_guard(JitBuilder *b, Addr addr, Byte type, Addr pc) {
+	if (jit_known(b, addr) == type)
+		return;
+	jit_cmp_type(b, addr, type);
+	jit_exit(b, jit_jcc(b, CC_NE), pc);
+	jit_learn(b, addr, type);
+}
+
+// Write the type of a result, unless the register is known to have it already.
+static void jit_result_type(JitBuilder *b, Addr addr, Byte type) {
+	if (jit_known(b, addr) == type)
+		return;
+	jit_set_type(b, addr, type);
+	jit_learn(b, addr, type);
+}
+
+// Arithmetic or comparison on the types recorded. Return 0 if there is no native path for them.
+static int jit_trace_binary(JitBuilder *b, const JitStep *step) {
+	Addr lval = step->ops.addr;
+	Addr rval = step->ops.arg;
+	Addr result = step->ops.raddr;
+	Byte code = step->code;
+	if (step->ltype != step->rtype || (step->ltype != TYPE_INT && step->ltype != TYPE_FLOAT))
+		return 0;
+	if (step->ltype == TYPE_INT && code == CMD_DIV)
+		return 0;
+
+	jit_guard(b, lval, step->ltype, step->pc);
+	jit_guard(b, rval, step->rtype, step->pc);
+	if (step->ltype == TYPE_INT) {
+		jit_load(b, 0, jit_value_disp(lval));
+		jit_load(b, 1, jit_value_disp(rval));
+		switch (code) {
+		case CMD_ADD:
+			EMIT(b, 0x48, 0x01, 0xC8);			// add rax, rcx
+			break;
+		case CMD_SUB:
+			EMIT(b, 0x48, 0x29, 0xC8);			// sub rax, rcx
+			break;
+		case CMD_MULT:
+			EMIT(b, 0x48, 0x0F, 0xAF, 0xC1);	// imul rax, rcx
+			break;
+		default:
+			EMIT(b, 0x48, 0x39, 0xC8);			// cmp rax, rcx
+			EMIT(b, 0x0F, 0x90 | jit_int_condition(code), 0xC0);	// setcc al
+			EMIT(b, 0x0F, 0xB6, 0xC0);			// movzx eax, al
+			break;
+		}
+		jit_store(b, 0, jit_value_disp(result));
+		jit_result_type(b, result, TYPE_INT);
+		return 1;
+	}
+
+	jit_load_float(b, 0, lval);
+	jit_load_float(b, 1, rval);
+	switch (code) {
+	case CMD_ADD:
+		EMIT(b, 0xF2, 0x0F, 0x58, 0xC1);		// addsd xmm0, xmm1
+		break;
+	case CMD_SUB:
+		EMIT(b, 0xF2, 0x0F, 0x5C, 0xC1);		// subsd xmm0, xmm1
+		break;
+	case CMD_MULT:
+		EMIT(b, 0xF2, 0x0F, 0x59, 0xC1);		// mulsd xmm0, xmm1
+		break;
+	case CMD_DIV:
+		EMIT(b, 0xF2, 0x0F, 0x5E, 0xC1);		// divsd xmm0, xmm1
+		break;
+	default:
+		jit_float_relation(b, code);
+		EMIT(b, 0x0F, 0xB6, 0xC0);				// movzx eax, al
+		EMIT(b, 0xF2, 0x48, 0x0F, 0x2A, 0xC0);	// cvtsi2sd xmm0, rax
+		break;
+	}
+	jit_store_float(b, result);
+	jit_result_type(b, result, TYPE_FLOAT);
+	return 1;
+}
+
+// Branch of the trace: leave it where the branch goes if it does not go the way recorded.
+static int jit_trace_branch(JitBuilder *b, const JitStep *step) {
+	Addr pc = step->pc;
+	const Operands *ops = &step->ops;
+
+	if (step->code == CMD_JCOND) {
+		if (step->rtype != TYPE_INT)
+			return 0;
+		jit_guard(b, ops->arg, TYPE_INT, pc);
+		EMIT(b, 0x48, 0x83, 0xBB);				// cmp qword [value], 0
+		jit_emit32(b, jit_value_disp(ops->arg));
+		EMIT(b, 0x00);
+		if (step->next == ops->addr)
+			jit_exit(b, jit_jcc(b, CC_E), pc + 1);
+		else
+			jit_exit(b, jit_jcc(b, CC_NE), ops->addr);
+		return 1;
+	}
+
+	// fused compare-and-branch. It falls through when the relation holds.
+	Byte relation = jit_jnot_relation(step->code);
+	int held = step->next != ops->raddr;
+	if (step->ltype != step->rtype || (step->ltype != TYPE_INT && step->ltype != TYPE_FLOAT))
+		return 0;
+	jit_guard(b, ops->addr, step->ltype, pc);
+	jit_guard(b, ops->arg, step->rtype, pc);
+	if (step->ltype == TYPE_INT) {
+		jit_load(b, 0, jit_value_disp(ops->addr));
+		EMIT(b, 0x48, 0x3B, 0x83);				// cmp rax, [rval]
+		jit_emit32(b, jit_value_disp(ops->arg));
+		Byte cc = jit_int_condition(relation);
+		if (held)
+			jit_exit(b, jit_jcc(b, cc ^ 1), ops->raddr);
+		else
+			jit_exit(b, jit_jcc(b, cc), pc + 1);
+		return 1;
+	}
+	jit_load_float(b, 0, ops->addr);
+	jit_load_float(b, 1, ops->arg);
+	jit_float_relation(b, relation);
+	EMIT(b, 0x84, 0xC0);						// test al, al
+	if (held)
+		jit_exit(b, jit_jcc(b, CC_E), ops->raddr);
+	else
+		jit_exit(b, jit_jcc(b, CC_NE), pc + 1);
+	return 1;
+}
+
+/*
+ * Compile a recorded iteration. Each iteration starts knowing nothing about types, and the last
+ * step, the backward jump, goes back to the start of the trace.
+ * Return NULL if a branch was recorded with types that have no native path.
+ */
+static JitFunction jit_compile_trace(VM *vm, Addr start, Array *trace) {
+	JitFunction function = NULL;
+	JitBuilder b;
+	JitStep *steps = (JitStep *) trace->heap;
+	if (jit_builder_init(&b, vm, start, steps[trace->length - 1].pc))
+		goto jit_compile_trace_end;
+
+	jit_prologue(&b);
+	size_t head = jit_here(&b);
+	for (int i = 0; i < trace->length; i++) {
+		JitStep *step = steps + i;
+		const Operands *ops = &step->ops;
+		int fits = jit_fits(ops->addr) && jit_fits(ops->arg) && jit_fits(ops->raddr);
+
+		switch (step->code) {
+		case CMD_JUMP:
+			continue;
+
+		case CMD_JCOND:
+		case CMD_JNOT_GREATER:
+		case CMD_JNOT_LESS:
+		case CMD_JNOT_EQUAL:
+		case CMD_JNOT_NEQUAL:
+		case CMD_JNOT_GEQ:
+		case CMD_JNOT_LEQ:
+			if (!fits || !jit_trace_branch(&b, step))
+				goto jit_compile_trace_end;
+			continue;
+
+		case CMD_EXIT:
+		case CMD_YIELD:
+			goto jit_compile_trace_end;
+
+		case CMD_ADD:
+		case CMD_SUB:
+		case CMD_MULT:
+		case CMD_DIV:
+		case CMD_GREATER:
+		case CMD_LESS:
+		case CMD_EQUAL:
+		case CMD_NEQUAL:
+		case CMD_GEQ:
+		case CMD_LEQ:
+			if (fits && jit_trace_binary(&b, step))
+				continue;
+			break;
+
+		case CMD_ASSIGN:
+			// the register assigned keeps its type.
+			if (fits && step->ltype == step->rtype && (step->ltype == TYPE_INT || step->ltype == TYPE_FLOAT)) {
+				jit_guard(&b, ops->addr, step->ltype, step->pc);
+				jit_guard(&b, ops->arg, step->rtype, step->pc);
+				jit_load(&b, 0, jit_value_disp(ops->arg));
+				jit_store(&b, 0, jit_value_disp(ops->addr));
+				continue;
+			}
+			break;
+
+		case CMD_COPY:
+			if (fits) {
+				jit_command(&b, step->pc);
+				jit_learn(&b, ops->addr, jit_known(&b, ops->arg));
+				continue;
+			}
+			break;
+
+		case CMD_SET_BYTE:
+		case CMD_SET_UINT:
+		case CMD_SET_INT:
+		case CMD_SET_FLOAT:
+			if (fits) {
+				jit_command(&b, step->pc);
+				jit_learn(&b, ops->addr,
+					step->code == CMD_SET_BYTE ? TYPE_BYTE : step->code == CMD_SET_UINT ? TYPE_UINT :
+					step->code == CMD_SET_INT ? TYPE_INT : TYPE_FLOAT);
+				continue;
+			}
+			break;
+
+		case CMD_ENTER:
+		case CMD_LEAVE:
+		case CMD_PUSH:
+			// resizing the stack leaves the types of the registers as they were.
+			jit_command(&b, step->pc);
+			continue;
+
+		case CMD_CALL_NATIVE:
+			// a native call writes only its result, of the type of its signature.
+			if (jit_native(&b, ops)) {
+				jit_learn(&b, ops->raddr, ((Native *) vm->program->natives->heap)[ops->arg].result);
+				continue;
+			}
+			break;
+		}
+
+		// no native path: let the interpreter run it, which may change any register.
+		jit_call_execute(&b, step->pc);
+		b.known->length = 0;
+	}
+	jit_patch(&b, jit_jmp(&b), head);
+	function = jit_install(&b, "trace");
+
+jit_compile_trace_end:
+	jit_builder_free(&b);
+	return function;
+}
+
+/*
+ * Record an iteration of the loop at start and compile it.
+ * Set next to the command the interpreter continues from. Return NULL if the loop was not traced.
+ */
+static JitFunction jit_trace(VM *vm, Addr start, Addr *next) {
+	JitFunction function = NULL;
+	Array *trace = array_new(sizeof(JitStep), 0);
+	if (trace == NULL) {
+		*next = JIT_MISS;
+		return NULL;
+	}
+	if (jit_record(vm, start, trace, next))
+		function = jit_compile_trace(vm, start, trace);
+	array_delete(trace);
+	return function;
+}
+
+#else
+
+static JitFunction jit_compile(VM *vm, Addr start, Addr end) {
+	return NULL;
+}
+
+static JitFunction jit_trace(VM *vm, Addr start, Addr *next) {
+	*next = JIT_MISS;
+	return NULL;
+}
+
+#endif /* JIT_X86_64 */
+
+
+Addr jit_loop(VM *vm, Addr start, Addr end) {
+	if (vm->jit_state == NULL) {
+		vm->jit_state = jit_new();
+		if (vm->jit_state == NULL)
+			return JIT_MISS;
+	}
+	Jit *jit = vm->jit_state;
+
+	// make room for counters and functions of new commands.
+	size_t length = jit->counters->length;
+	if (length < vm->program->commands->length) {
+		if (array_resize(jit->counters, vm->program->commands->length) || array_resize(jit->functions, vm->program->commands->length))
+			return JIT_MISS;
+		memset((uint32_t *) jit->counters->heap + length, 0, (vm->program->commands->length - length) * sizeof(uint32_t));
+		memset((JitFunction *) jit->functions->heap + length, 0, (vm->program->commands->length - length) * sizeof(JitFunction));
+	}
+
+	JitFunction function = ((JitFunction *) jit->functions->heap)[start];
+	if (function == NULL) {
+		// compile once, when the count reaches the threshold. If that fails, keep interpreting.
+		uint32_t *counter = (uint32_t *) jit->counters->heap + start;
+		if (*counter > JIT_HOT_LOOP)
+			return JIT_MISS;
+		if (++*counter <= JIT_HOT_LOOP)
+			return JIT_MISS;
+
+		if (vm->jit == JIT_TRACE) {
+			// recording runs an iteration, so the interpreter goes on from where it stopped.
+			Addr next = JIT_MISS;
+			function = jit_trace(vm, start, &next);
+			if (function == NULL)
+				return next;
+		}
+		else {
+			function = jit_compile(vm, start, end);
+			if (function == NULL)
+				return JIT_MISS;
+		}
+		((JitFunction *) jit->functions->heap)[start] = function;
+	}
+	return function(vm);
+}
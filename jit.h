@@ -0,0 +1,67 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "array.h"
+#include "vm.h"
+
+/*
+ * Template JIT for x86-64 Linux.
+ *
+ * The threaded engine counts the backward jumps taken to each command. When a loop gets hot, the
+ * commands from the jump target to the backward jump are translated to native code by stitching
+ * a machine-code template per command, and from then on the loop runs natively.
+ *
+ * Templates test the types of their operands inline. Int and float operands run natively; any
+ * other type, and any command without a template, is handed to vm_execute through a helper call.
+ * Branches whose operands do not have a native path leave the native code and let the
+ * interpreter carry on from that command.
+ *
+ * In trace mode (JIT_TRACE) the hot loop instead runs one iteration in the interpreter while the
+ * commands it executes, the branches it takes and the types of the operands are recorded. That
+ * single path is compiled with a type guard on the first use of each register; later uses of a
+ * register whose type the trace already knows are not checked again. A guard that fails, or a
+ * branch that goes the other way, leaves the native code at that command and the interpreter
+ * carries on. If the recorded iteration reaches the end of the program, jumps back into an inner
+ * loop or runs too many commands, the loop is not traced and stays interpreted.
+ *
+ * Each compiled loop is listed in /tmp/perf-PID.map so perf can name it.
+ * On other platforms, and with a packed stack layout (VM_SOA_STACK, VM_NAN_BOXING), jit_loop
+ * never compiles and the interpreter runs everything.
+ */
+
+#define JIT_HOT_LOOP 64			// Backward jumps to a command before its loop is compiled.
+#define JIT_MAX_TRACE 1024		// Commands in a recorded iteration before recording gives up.
+#define JIT_MISS ((Addr) -1)	// Returned by jit_loop when the loop was not run natively.
+
+// Native code of a loop. Runs from the start of the loop and returns the command to continue from.
+typedef Addr (*JitFunction)(VM *vm);
+
+typedef struct JitRegion {
+	void *code;		// Executable pages.
+	size_t size;	// Size of the pages in bytes.
+} JitRegion;
+
+typedef struct Jit {
+	Array *counters;	// Backward jumps taken to each command. An array of uint32_t.
+	Array *functions;	// Native code of the loop starting at each command, or NULL. An array of JitFunction.
+	Array *regions;		// Executable pages in use. An array of JitRegion.
+	FILE *perf_map;		// The /tmp/perf-PID.map file, opened at the first compilation.
+} Jit;
+
+
+// Public functions:
+
+Jit *jit_new();
+void jit_delete(Jit *jit);
+
+// Forget all native code and counters. Called when commands already compiled change.
+void jit_reset(Jit *jit);
+
+// Called on a backward jump from command end to command start.
+// Count the jump and, once the loop is hot, compile it and run it natively.
+// Return the command to continue from, or JIT_MISS if the loop was not run natively.
+Addr jit_loop(VM *vm, Addr start, Addr end);
+
+#endif /* __JIT_H__ */
@@ -0,0 +1,179 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+#include "compiler.h"
+#include "aot.h"
+#include "image.h"
+#include "batch.h"
+#include "daemon.h"
+
+const char *emit_c_filename;	// when set, the compiled program is written to this file as C instead of run.
+const char *compile_filename;	// when set, the compiled program is written to this file as an image instead of run.
+
+int main(int argc, const char **argv) {
+	// arguments
+	const char *filename = NULL;
+	const char *image_filename = NULL;
+	const char *socket_path = NULL;
+	Byte engine = ENGINE_THREADED;
+	bool quicken = false;
+	Byte jit = JIT_OFF;
+	bool batch = false;
+	int workers = 0;
+	long slice = 0;
+	bool optimize = true;
+	const char **filenames = (const char **) malloc(sizeof(const char *) * argc);
+	size_t filename_count = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--engine=switch") == 0)
+			engine = ENGINE_SWITCH;
+		else if (strcmp(argv[i], "--engine=threaded") == 0)
+			engine = ENGINE_THREADED;
+		else if (strcmp(argv[i], "--quicken") == 0)
+			quicken = true;
+		else if (strcmp(argv[i], "--jit") == 0 || strcmp(argv[i], "--jit=template") == 0)
+			jit = JIT_TEMPLATE;
+		else if (strcmp(argv[i], "--jit=trace") == 0)
+			jit = JIT_TRACE;
+		else if (strcmp(argv[i], "--emit-c") == 0 && i + 1 < argc)
+			emit_c_filename = argv[++i];
+		else if (strcmp(argv[i], "--compile") == 0 && i + 1 < argc)
+			compile_filename = argv[++i];
+		else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+			image_filename = argv[++i];
+		else if (strcmp(argv[i], "--daemon") == 0 && i + 1 < argc)
+			socket_path = argv[++i];
+		else if (strcmp(argv[i], "--batch") == 0)
+			batch = true;
+		else if (strncmp(argv[i], "--workers=", 10) == 0)
+			workers = atoi(argv[i] + 10);
+		else if (strncmp(argv[i], "--slice=", 8) == 0)
+			slice = atol(argv[i] + 8);
+		else if (strcmp(argv[i], "--no-optimize") == 0)
+			optimize = false;
+		else {
+			filename = argv[i];
+			if (filenames != NULL)
+				filenames[filename_count++] = filename;
+		}
+	}
+
+	if (socket_path != NULL) {
+		// Serve scripts sent to the socket until killed.
+		free(filenames);
+		daemon_run(socket_path, workers, engine, quicken, jit);
+		printf("Could not listen on %s. Exiting with status -1.\n", socket_path);
+		exit_program(NULL, -1);
+	}
+
+	if (batch) {
+		// Run every script given on a pool of threads.
+		if (filenames == NULL) {
+			printf("Could not run batch. Exiting with status -1.\n");
+			exit_program(NULL, -1);
+		}
+		int rval = batch_run(filenames, filename_count, workers, engine, quicken, jit, slice);
+		free(filenames);
+		exit_program(NULL, rval);
+	}
+	free(filenames);
+
+	if (image_filename != NULL) {
+		// Run a compiled image: no source is parsed.
+		printf("%s\n", image_filename);
+		VM *vm = vm_new();
+		if (vm == NULL) {
+			printf("vm is null.\n");
+			exit_program(NULL, 1);
+		}
+		vm->engine = engine;
+		vm->quicken = quicken;
+		vm->jit = jit;
+
+		Image *image = image_open(image_filename);
+		if (image == NULL || image_attach(image, vm) != 0) {
+			printf("Could not load image %s. Exiting with status -1.\n", image_filename);
+			if (image != NULL)
+				image_close(image);
+			vm_delete(vm);
+			exit_program(NULL, -1);
+		}
+		printf("Now running.\n");
+		int status = vm_run(vm);
+		if (status == VM_FAILED)
+			printf("%s Exiting with status -1.\n", vm_failure(vm));
+		// The machine uses the commands of the image in place.
+		vm_delete(vm);
+		image_close(image);
+		exit_program(NULL, status == VM_FAILED ? -1 : 0);
+	}
+
+	FILE *in = NULL;
+	bool interactive_mode = false;
+	if (filename != NULL) {
+		printf("%s\n", filename);
+		in = fopen(filename, "r");
+	}
+	else {
+		interactive_mode = true;
+		printf("Interactive mode.\n");
+	}
+
+	Compiler *compiler = compiler_new(in, interactive_mode);
+	if (compiler == NULL) {
+		printf("Compiler is null.\n");
+		if (in != NULL)
+			fclose(in);
+		exit_program(NULL, 1);
+	}
+	compiler->vm->engine = engine;
+	compiler->vm->quicken = quicken;
+	compiler->vm->jit = jit;
+	compiler->optimize = compiler->optimize && optimize;
+
+	int rval = 0;
+	if (compiler_parse(compiler) != 0) {
+		// the parse was aborted.
+		if (!compiler->compilation_success)
+			rval = -1;
+	}
+	else if (!interactive_mode) {
+		if (compiler->compilation_success) {
+			printf("Compilation successful.\n");
+			if (emit_c_filename != NULL) {
+				FILE *out = fopen(emit_c_filename, "w");
+				if (out == NULL || aot_emit_c(compiler->vm, out) != 0) {
+					printf("Could not write %s. Exiting with status -1.\n", emit_c_filename);
+					if (out != NULL)
+						fclose(out);
+					exit_program(compiler, -1);
+				}
+				fclose(out);
+				printf("Written to %s.\n", emit_c_filename);
+			}
+			else if (compile_filename != NULL) {
+				if (image_write(compiler->vm, compile_filename) != 0) {
+					printf("Could not write %s. Exiting with status -1.\n", compile_filename);
+					exit_program(compiler, -1);
+				}
+				printf("Written to %s.\n", compile_filename);
+			}
+			else {
+				printf("Now running.\n");
+				if (vm_run(compiler->vm) == VM_FAILED) {
+					printf("%s Exiting with status -1.\n", vm_failure(compiler->vm));
+					rval = -1;
+				}
+			}
+		}
+		else {
+			printf("Compilation Failed. Exiting with status -1.\n");
+			rval = -1;
+		}
+	}
+
+	exit_program(compiler, rval);
+	return rval;
+}
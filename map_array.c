@@ -25,7 +25,7 @@ map_array_new_exception:
 void map_array_delete(MapArray *map) {
 	for (int i = 0; i < map->map->length; i++) {
 		if (map->map->buckets[i].key != 0) {
-			Array *array = (Array*) map->map->buckets[i].value;
+			Array *array = *(Array**) map->map->buckets[i].value;
 			array_delete(array);
 		}
 	}
@@ -0,0 +1,108 @@
+#include "native.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+
+typedef struct NativeBuiltin {
+	const char *name;
+	NativeFunction function;
+	Byte result;
+	int arg_count;
+	Byte args[NATIVE_MAX_ARGS];
+} NativeBuiltin;
+
+// The builtins, in the order of their indexes. Only ever append to this list: images and
+// compiled programs refer to builtins by index.
+static const NativeBuiltin native_builtin_list[] = {
+	{ "sqrt", (NativeFunction) sqrt, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "sin", (NativeFunction) sin, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "cos", (NativeFunction) cos, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "tan", (NativeFunction) tan, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "atan2", (NativeFunction) atan2, TYPE_FLOAT, 2, { TYPE_FLOAT, TYPE_FLOAT } },
+	{ "exp", (NativeFunction) exp, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "log", (NativeFunction) log, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "pow", (NativeFunction) pow, TYPE_FLOAT, 2, { TYPE_FLOAT, TYPE_FLOAT } },
+	{ "floor", (NativeFunction) floor, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "ceil", (NativeFunction) ceil, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "fabs", (NativeFunction) fabs, TYPE_FLOAT, 1, { TYPE_FLOAT } },
+	{ "fmod", (NativeFunction) fmod, TYPE_FLOAT, 2, { TYPE_FLOAT, TYPE_FLOAT } },
+	{ "hypot", (NativeFunction) hypot, TYPE_FLOAT, 2, { TYPE_FLOAT, TYPE_FLOAT } },
+	{ "labs", (NativeFunction) labs, TYPE_INT, 1, { TYPE_INT } },
+};
+
+static Array *native_builtin_table = NULL;
+static pthread_once_t native_builtin_once = PTHREAD_ONCE_INIT;
+
+static void native_builtins_init() {
+	native_builtin_table = native_table_new();
+}
+
+Array *native_builtins() {
+	pthread_once(&native_builtin_once, native_builtins_init);
+	return native_builtin_table;
+}
+
+Array *native_table_new() {
+	Array *table = array_new(sizeof(Native), 0);
+	if (table == NULL)
+		return NULL;
+	size_t count = sizeof(native_builtin_list) / sizeof(native_builtin_list[0]);
+	for (size_t i = 0; i < count; i++) {
+		const NativeBuiltin *builtin = native_builtin_list + i;
+		long index = native_register(table, builtin->name, builtin->function, builtin->result, builtin->arg_count, builtin->args);
+		if (index < 0) {
+			array_delete(table);
+			return NULL;
+		}
+		// builtins are functions of the C library, which generated C can call by name.
+		((Native *) table->heap)[index].symbol = builtin->name;
+	}
+	return table;
+}
+
+void native_table_delete(Array *table) {
+	array_delete(table);
+}
+
+static int native_type(Byte type) {
+	return type == TYPE_INT || type == TYPE_FLOAT;
+}
+
+long native_register(Array *table, const char *name, NativeFunction function, Byte result, int arg_count, const Byte *args) {
+	Native native;
+	memset(&native, 0, sizeof(native));
+	if (strlen(name) >= NATIVE_NAME_SIZE || function == NULL || native_find(table, name, NULL) >= 0)
+		return -1;
+	if (arg_count < 0 || arg_count > NATIVE_MAX_ARGS || !native_type(result))
+		return -1;
+
+	int float_args = 0;
+	for (int i = 0; i < arg_count; i++) {
+		if (!native_type(args[i]))
+			return -1;
+		native.args[i] = args[i];
+		if (args[i] == TYPE_FLOAT)
+			float_args |= 1 << i;
+	}
+	strcpy(native.name, name);
+	native.function = function;
+	native.symbol = NULL;
+	native.result = result;
+	native.arg_count = arg_count;
+	native.shape = NATIVE_SHAPE(result == TYPE_FLOAT, arg_count, float_args);
+	return array_push(table, &native);
+}
+
+long native_find(Array *table, const char *name, Native *native) {
+	if (table == NULL)
+		return -1;
+	Native *natives = (Native *) table->heap;
+	for (size_t i = 0; i < table->length; i++) {
+		if (strcmp(natives[i].name, name) == 0) {
+			if (native != NULL)
+				*native = natives[i];
+			return i;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,110 @@
+#ifndef __NATIVE_H__
+#define __NATIVE_H__
+
+#include "array.h"
+#include "vm.h"
+
+/*
+ * Native functions: C functions that scripts call with CMD_CALL_NATIVE.
+ *
+ * A native is registered in a table with its signature: the types of its arguments and of its
+ * result, each TYPE_INT or TYPE_FLOAT. Scripts call it by name, f(x, y), and the compiler resolves
+ * the name to its index in the table of the program, so the call itself carries the index and
+ * never looks up a name.
+ *
+ * The arguments of a call are in consecutive registers, each of the type of its parameter, which
+ * the compiler makes sure of. The call reads them from the stack as C values, calls the function
+ * directly through a pointer of the right type and stores the result in the result register:
+ * nothing is boxed or converted on the way.
+ *
+ * Every table starts with the builtins, the functions of math.h below, so their indexes are the
+ * same in any table and programs that use only builtins run anywhere, from images too. A table
+ * is read-only once programs are compiled against it, and may then be shared by any number of
+ * programs and threads.
+ */
+
+#define NATIVE_MAX_ARGS 3		// Most arguments a native function takes.
+#define NATIVE_NAME_SIZE 32		// Longest name of a native function, with the terminating zero.
+
+// A pointer to a native function, cast to its signature when it is called.
+typedef void (*NativeFunction)(void);
+
+typedef struct Native {
+	char name[NATIVE_NAME_SIZE];	// The name scripts call it by.
+	NativeFunction function;
+	const char *symbol;			// The C name of the function, for --emit-c, or NULL if it has none.
+	Byte result;				// The type of the result, TYPE_INT or TYPE_FLOAT.
+	Byte arg_count;
+	Byte args[NATIVE_MAX_ARGS];	// The type of each argument, TYPE_INT or TYPE_FLOAT.
+	Byte shape;					// The signature as a case of native_call. See NATIVE_SHAPE.
+} Native;
+
+// A signature as one number: the argument count in the low two bits, then one bit per argument
+// that is a float, then one bit if the result is a float.
+#define NATIVE_SHAPE(result_float, arg_count, float_args) (((result_float) << 5) | ((float_args) << 2) | (arg_count))
+
+
+// Public functions:
+
+// The table of the builtins, shared by every program that was not given its own table.
+// Return NULL if it could not be made.
+Array *native_builtins();
+
+// A new table with the builtins, for the host to register its own functions in.
+Array *native_table_new();
+void native_table_delete(Array *table);
+
+// Register function under name with the signature given, as in
+//     native_register(table, "hypot", (NativeFunction) hypot, TYPE_FLOAT, 2, (Byte[]) { TYPE_FLOAT, TYPE_FLOAT });
+// Return its index in the table, or -1 if the name is taken or too long or the signature is not
+// supported.
+long native_register(Array *table, const char *name, NativeFunction function, Byte result, int arg_count, const Byte *args);
+
+// Find the function called name. Return its index and copy it to native, or return -1.
+long native_find(Array *table, const char *name, Native *native);
+
+// Call native with the arguments in the registers from args on and store its result in raddr.
+static inline void native_call(VM *vm, const Native *native, Addr args, Addr raddr) {
+#define NATIVE_I(i) vm_load(vm, args + (i)).int_value
+#define NATIVE_F(i) vm_load(vm, args + (i)).float_value
+#define NATIVE_INT(type, call) { vm_store_int(vm, raddr, ((Int (*) type) native->function) call); break; }
+#define NATIVE_FLOAT(type, call) { vm_store_float(vm, raddr, ((Float (*) type) native->function) call); break; }
+	switch (native->shape) {
+	case NATIVE_SHAPE(0, 0, 0): NATIVE_INT((void), ());
+	case NATIVE_SHAPE(0, 1, 0): NATIVE_INT((Int), (NATIVE_I(0)));
+	case NATIVE_SHAPE(0, 1, 1): NATIVE_INT((Float), (NATIVE_F(0)));
+	case NATIVE_SHAPE(0, 2, 0): NATIVE_INT((Int, Int), (NATIVE_I(0), NATIVE_I(1)));
+	case NATIVE_SHAPE(0, 2, 1): NATIVE_INT((Float, Int), (NATIVE_F(0), NATIVE_I(1)));
+	case NATIVE_SHAPE(0, 2, 2): NATIVE_INT((Int, Float), (NATIVE_I(0), NATIVE_F(1)));
+	case NATIVE_SHAPE(0, 2, 3): NATIVE_INT((Float, Float), (NATIVE_F(0), NATIVE_F(1)));
+	case NATIVE_SHAPE(0, 3, 0): NATIVE_INT((Int, Int, Int), (NATIVE_I(0), NATIVE_I(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(0, 3, 1): NATIVE_INT((Float, Int, Int), (NATIVE_F(0), NATIVE_I(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(0, 3, 2): NATIVE_INT((Int, Float, Int), (NATIVE_I(0), NATIVE_F(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(0, 3, 3): NATIVE_INT((Float, Float, Int), (NATIVE_F(0), NATIVE_F(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(0, 3, 4): NATIVE_INT((Int, Int, Float), (NATIVE_I(0), NATIVE_I(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(0, 3, 5): NATIVE_INT((Float, Int, Float), (NATIVE_F(0), NATIVE_I(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(0, 3, 6): NATIVE_INT((Int, Float, Float), (NATIVE_I(0), NATIVE_F(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(0, 3, 7): NATIVE_INT((Float, Float, Float), (NATIVE_F(0), NATIVE_F(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(1, 0, 0): NATIVE_FLOAT((void), ());
+	case NATIVE_SHAPE(1, 1, 0): NATIVE_FLOAT((Int), (NATIVE_I(0)));
+	case NATIVE_SHAPE(1, 1, 1): NATIVE_FLOAT((Float), (NATIVE_F(0)));
+	case NATIVE_SHAPE(1, 2, 0): NATIVE_FLOAT((Int, Int), (NATIVE_I(0), NATIVE_I(1)));
+	case NATIVE_SHAPE(1, 2, 1): NATIVE_FLOAT((Float, Int), (NATIVE_F(0), NATIVE_I(1)));
+	case NATIVE_SHAPE(1, 2, 2): NATIVE_FLOAT((Int, Float), (NATIVE_I(0), NATIVE_F(1)));
+	case NATIVE_SHAPE(1, 2, 3): NATIVE_FLOAT((Float, Float), (NATIVE_F(0), NATIVE_F(1)));
+	case NATIVE_SHAPE(1, 3, 0): NATIVE_FLOAT((Int, Int, Int), (NATIVE_I(0), NATIVE_I(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(1, 3, 1): NATIVE_FLOAT((Float, Int, Int), (NATIVE_F(0), NATIVE_I(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(1, 3, 2): NATIVE_FLOAT((Int, Float, Int), (NATIVE_I(0), NATIVE_F(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(1, 3, 3): NATIVE_FLOAT((Float, Float, Int), (NATIVE_F(0), NATIVE_F(1), NATIVE_I(2)));
+	case NATIVE_SHAPE(1, 3, 4): NATIVE_FLOAT((Int, Int, Float), (NATIVE_I(0), NATIVE_I(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(1, 3, 5): NATIVE_FLOAT((Float, Int, Float), (NATIVE_F(0), NATIVE_I(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(1, 3, 6): NATIVE_FLOAT((Int, Float, Float), (NATIVE_I(0), NATIVE_F(1), NATIVE_F(2)));
+	case NATIVE_SHAPE(1, 3, 7): NATIVE_FLOAT((Float, Float, Float), (NATIVE_F(0), NATIVE_F(1), NATIVE_F(2)));
+	}
+#undef NATIVE_I
+#undef NATIVE_F
+#undef NATIVE_INT
+#undef NATIVE_FLOAT
+}
+
+#endif /* __NATIVE_H__ */
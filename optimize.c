@@ -0,0 +1,1288 @@
+#include "optimize.h"
+#include "vm_ops.h"
+#include "native.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define OPTIMIZE_MAX_SLOTS (1 << 20)	// Programs that address more registers are left alone.
+#define OPTIMIZE_ROUNDS 8				// Most times the passes run over the program.
+#define OPTIMIZE_LOOP_SLOTS 64			// Registers the frames of loops may grow by, for the commands moved out.
+
+// How a command uses the registers.
+typedef struct Effect {
+	Addr reads[NATIVE_MAX_ARGS + 1];	// The registers read.
+	int read_count;
+	Addr write;			// The register written, or -1.
+	Byte kills;			// The write sets the whole register, whatever it held before.
+	Byte pure;			// The command does nothing but its write, so it may go if the write is dead.
+	Byte reads_all;		// Every register is read, as by the stack command.
+	Byte observes;		// The observable registers are read, as the program ends or yields.
+} Effect;
+
+typedef struct Optimizer {
+	VM *vm;
+	Command *cmds;			// The commands, decoded.
+	Byte *removed;			// 1 for each command taken out.
+	Byte *leader;			// 1 for each command that starts a basic block.
+	Byte *target;			// 1 for each command a jump lands on.
+	Byte *reached;			// 1 for each command a path from the first one reaches.
+	Addr *work;				// The commands still to follow from, while finding those reached.
+	Addr length;			// Of cmds.
+	Addr slots;				// 1 + the highest address used, and room for the registers loops are given.
+	const Addr *observable;
+	size_t observable_count;
+
+	// What is known of the registers at a point of a basic block, for constant folding.
+	Byte *known;			// 1 if the value of the register is in value.
+	Register *value;
+	Addr *copy;				// The register this one holds a copy of, or -1.
+	Addr *touched;			// The registers with something known, to forget them at the next block.
+	size_t touched_count;
+	Byte *is_touched;
+
+	// Liveness, a bitset of registers for each basic block.
+	Addr *block;			// The basic block of each command.
+	Addr *block_start;		// The first command of each basic block, and length at the end.
+	Addr block_count;
+	Addr max_blocks;		// The most basic blocks the commands can have.
+	size_t words;			// In a bitset.
+	uint64_t *live_in;		// Registers live at the start of each block.
+	uint64_t *live;			// Scratch set.
+	uint64_t *observed;		// The observable registers.
+
+	// Loop-invariant code motion.
+	Addr stack_length;		// Of the machine, as the program starts.
+	Addr *depth;			// The length of the stack before each command.
+	Addr *writes;			// The times the loop writes each register.
+	Byte *hoist;			// 1 for each command moved before the loop.
+	Byte *done;				// 1 for each jump back whose loop was seen, and each command moved out of one.
+	Addr *index;			// The new index of each command, as they are moved or taken out.
+	Command *moved;			// The commands in their new order.
+} Optimizer;
+
+static bool optimize_is_jump(Byte code) {
+	Byte generic = vm_generic_code(code);
+	return generic == CMD_JUMP || generic == CMD_JCOND || (generic >= CMD_JNOT_GREATER && generic <= CMD_JNOT_LEQ);
+}
+
+// The argument of a jump that holds its target.
+static Addr *optimize_jump_target(Command *cmd) {
+	Byte generic = vm_generic_code(cmd->code);
+	return generic == CMD_JUMP || generic == CMD_JCOND ? &cmd->addr : &cmd->raddr;
+}
+
+// True for the typed commands, which do not check the types of their operands.
+static bool optimize_is_typed(Byte code) {
+	return code >= CMD_ADD_INT && code <= CMD_ASSIGN_FLOAT_FROM_INT;
+}
+
+// The type of the operands of a typed arithmetic or comparison command.
+static Byte optimize_typed_kind(Byte code) {
+	return (code - CMD_ADD_INT) % 2 == 0 ? TYPE_INT : TYPE_FLOAT;
+}
+
+static bool optimize_is_binary(Byte generic) {
+	return (generic >= CMD_ADD && generic <= CMD_DIV) || (generic >= CMD_AND && generic <= CMD_LEQ && generic != CMD_NOT);
+}
+
+static void optimize_read(Effect *effect, Addr addr) {
+	effect->reads[effect->read_count++] = addr;
+}
+
+// Fill effect for cmd. Return 0, or -1 if the command is one the passes do not handle.
+static int optimize_effect(Optimizer *o, const Command *cmd, Effect *effect) {
+	memset(effect, 0, sizeof(Effect));
+	effect->write = -1;
+	Byte generic = vm_generic_code(cmd->code);
+	bool typed = optimize_is_typed(cmd->code);
+
+	if (optimize_is_binary(generic)) {
+		optimize_read(effect, cmd->addr);
+		optimize_read(effect, cmd->addr_arg);
+		effect->write = cmd->raddr;
+		// a generic command leaves its result alone if the operands are not numbers.
+		effect->kills = typed;
+		if (!typed)
+			optimize_read(effect, cmd->raddr);
+		// an integer division may fail.
+		effect->pure = generic != CMD_DIV || cmd->code == CMD_DIV_FLOAT || cmd->code == CMD_DIV_FLOAT_FLOAT;
+		return 0;
+	}
+
+	switch (generic) {
+	case CMD_SET_BYTE:
+	case CMD_SET_INT:
+	case CMD_SET_UINT:
+	case CMD_SET_FLOAT:
+		effect->write = cmd->addr;
+		effect->kills = 1;
+		effect->pure = 1;
+		break;
+	case CMD_NOT:
+		optimize_read(effect, cmd->addr);
+		optimize_read(effect, cmd->raddr);
+		effect->write = cmd->raddr;
+		effect->pure = 1;
+		break;
+	case CMD_COPY:
+		optimize_read(effect, cmd->addr_arg);
+		effect->write = cmd->addr;
+		effect->kills = 1;
+		effect->pure = 1;
+		break;
+	case CMD_ASSIGN:
+		// a generic assignment converts to the type the left value has.
+		optimize_read(effect, cmd->addr_arg);
+		if (!typed)
+			optimize_read(effect, cmd->addr);
+		effect->write = cmd->addr;
+		effect->kills = typed;
+		effect->pure = 1;
+		break;
+	case CMD_JCOND:
+		optimize_read(effect, cmd->addr_arg);
+		break;
+	case CMD_JNOT_GREATER:
+	case CMD_JNOT_LESS:
+	case CMD_JNOT_EQUAL:
+	case CMD_JNOT_NEQUAL:
+	case CMD_JNOT_GEQ:
+	case CMD_JNOT_LEQ:
+		optimize_read(effect, cmd->addr);
+		optimize_read(effect, cmd->addr_arg);
+		break;
+	case CMD_PRINT:
+		optimize_read(effect, cmd->addr);
+		break;
+	case CMD_STACK:
+		effect->reads_all = 1;
+		break;
+	case CMD_EXIT:
+	case CMD_YIELD:
+		effect->observes = 1;
+		break;
+	case CMD_SET_SLEN:
+		effect->write = cmd->addr;
+		effect->kills = 1;
+		break;
+	case CMD_CALL_NATIVE:
+		{
+		Array *natives = o->vm->program->natives;
+		if (natives == NULL || cmd->addr_arg < 0 || cmd->addr_arg >= natives->length)
+			return -1;
+		Native native;
+		array_get(natives, cmd->addr_arg, &native);
+		for (int i = 0; i < native.arg_count && i < NATIVE_MAX_ARGS; i++)
+			optimize_read(effect, cmd->addr + i);
+		effect->write = cmd->raddr;
+		effect->kills = 1;
+		break;
+		}
+	case CMD_JUMP:
+	case CMD_PUSH:
+	case CMD_POP:
+	case CMD_ENTER:
+	case CMD_LEAVE:
+	case CMD_MALLOC:
+	case CMD_FREE:
+		break;
+	default:
+		// the commands command shows the commands as they were compiled.
+		return -1;
+	}
+	return 0;
+}
+
+// Decode the commands. Return 0, or -1 if the program cannot be optimized.
+static int optimize_load(Optimizer *o) {
+	o->slots = 1;
+	for (size_t i = 0; i < o->observable_count; i++) {
+		if (o->observable[i] < 0 || o->observable[i] >= OPTIMIZE_MAX_SLOTS)
+			return -1;
+		if (o->observable[i] >= o->slots)
+			o->slots = o->observable[i] + 1;
+	}
+
+	// each jump or exit ends a block and may start another one.
+	o->max_blocks = 1;
+	for (Addr i = 0; i < o->length; i++) {
+		Command *cmd = &o->cmds[i];
+		*cmd = vm_get_cmd(o->vm, i);
+
+		Effect effect;
+		if (optimize_effect(o, cmd, &effect) != 0)
+			return -1;
+		if (effect.write >= 0)
+			optimize_read(&effect, effect.write);
+		for (int j = 0; j < effect.read_count; j++) {
+			Addr addr = effect.reads[j];
+			if (addr < 0 || addr >= OPTIMIZE_MAX_SLOTS)
+				return -1;
+			if (addr >= o->slots)
+				o->slots = addr + 1;
+		}
+
+		if (optimize_is_jump(cmd->code)) {
+			Addr *target = optimize_jump_target(cmd);
+			if (*target < 0)
+				return -1;
+			// past the last command the program ends, wherever it jumps.
+			if (*target > o->length)
+				*target = o->length;
+		}
+		if (optimize_is_jump(cmd->code) || cmd->code == CMD_EXIT)
+			o->max_blocks += 2;
+	}
+	if (o->max_blocks > o->length)
+		o->max_blocks = o->length;
+	return 0;
+}
+
+// Find the basic blocks of the commands kept.
+static void optimize_blocks(Optimizer *o) {
+	memset(o->leader, 0, (size_t) o->length);
+	memset(o->target, 0, (size_t) o->length);
+	o->leader[0] = 1;
+	for (Addr i = 0; i < o->length; i++) {
+		Command *cmd = &o->cmds[i];
+		if (o->removed[i])
+			continue;
+		if (optimize_is_jump(cmd->code)) {
+			Addr target = *optimize_jump_target(cmd);
+			if (target < o->length)
+				o->leader[target] = o->target[target] = 1;
+		}
+		if ((optimize_is_jump(cmd->code) || cmd->code == CMD_EXIT) && i + 1 < o->length)
+			o->leader[i + 1] = 1;
+	}
+
+	o->block_count = 0;
+	for (Addr i = 0; i < o->length; i++) {
+		if (o->leader[i])
+			o->block_start[o->block_count++] = i;
+		o->block[i] = o->block_count - 1;
+	}
+	o->block_start[o->block_count] = o->length;
+}
+
+// The first command kept from index on, or length if there is none.
+static Addr optimize_next(Optimizer *o, Addr index) {
+	while (index < o->length && o->removed[index])
+		index++;
+	return index;
+}
+
+// Point each jump at the command it ends up running: the next one kept, through the unconditional
+// jumps it lands on. A jump to the command after it is removed, and a jump to an exit becomes the
+// exit. Return true if anything changed.
+static bool optimize_thread_pass(Optimizer *o) {
+	bool changed = false;
+	for (Addr i = 0; i < o->length; i++) {
+		Command *cmd = &o->cmds[i];
+		if (o->removed[i] || !optimize_is_jump(cmd->code))
+			continue;
+
+		Addr *target = optimize_jump_target(cmd);
+		Addr final = optimize_next(o, *target);
+		// a loop of jumps never ends anyway: stop anywhere in it.
+		for (Addr steps = 0; final < o->length && o->cmds[final].code == CMD_JUMP && steps < o->length; steps++)
+			final = optimize_next(o, o->cmds[final].addr);
+		if (final != *target) {
+			*target = final;
+			changed = true;
+		}
+
+		if (final == optimize_next(o, i + 1)) {
+			// the condition of a conditional jump has no effect of its own.
+			o->removed[i] = 1;
+			changed = true;
+		}
+		else if (cmd->code == CMD_JUMP && final < o->length && o->cmds[final].code == CMD_EXIT) {
+			cmd->code = CMD_EXIT;
+			cmd->addr = 0;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// Remove the commands no path from the first one reaches. Return true if any was removed.
+static bool optimize_unreachable_pass(Optimizer *o) {
+	for (Addr i = 0; i < o->length; i++)
+		o->reached[i] = 0;
+	size_t count = 0;
+	o->work[count++] = optimize_next(o, 0);
+	while (count > 0) {
+		Addr i = o->work[--count];
+		if (i >= o->length || o->reached[i])
+			continue;
+		o->reached[i] = 1;
+
+		Command *cmd = &o->cmds[i];
+		if (optimize_is_jump(cmd->code))
+			o->work[count++] = optimize_next(o, *optimize_jump_target(cmd));
+		if (cmd->code != CMD_JUMP && cmd->code != CMD_EXIT)
+			o->work[count++] = optimize_next(o, i + 1);
+	}
+
+	bool removed = false;
+	for (Addr i = 0; i < o->length; i++) {
+		if (!o->removed[i] && !o->reached[i]) {
+			o->removed[i] = 1;
+			removed = true;
+		}
+	}
+	return removed;
+}
+
+// Forget what is known of the registers, as a basic block starts.
+static void optimize_forget(Optimizer *o) {
+	for (size_t i = 0; i < o->touched_count; i++) {
+		Addr addr = o->touched[i];
+		o->known[addr] = 0;
+		o->copy[addr] = -1;
+		o->is_touched[addr] = 0;
+	}
+	o->touched_count = 0;
+}
+
+static void optimize_touch(Optimizer *o, Addr addr) {
+	if (!o->is_touched[addr]) {
+		o->is_touched[addr] = 1;
+		o->touched[o->touched_count++] = addr;
+	}
+}
+
+// The register at addr is written: what was known of it, and the copies of it, no longer hold.
+static void optimize_kill(Optimizer *o, Addr addr) {
+	o->known[addr] = 0;
+	o->copy[addr] = -1;
+	for (size_t i = 0; i < o->touched_count; i++) {
+		if (o->copy[o->touched[i]] == addr)
+			o->copy[o->touched[i]] = -1;
+	}
+}
+
+static const Register *optimize_known(Optimizer *o, Addr addr) {
+	return o->known[addr] ? &o->value[addr] : NULL;
+}
+
+// Replace cmd by a set of value to addr.
+static void optimize_set(Command *cmd, Addr addr, const Register *value) {
+	Command set = { 0 };
+	set.addr = addr;
+	switch (value->type) {
+	case TYPE_BYTE:  set.code = CMD_SET_BYTE;  set.byte_arg = value->byte_value; break;
+	case TYPE_UINT:  set.code = CMD_SET_UINT;  set.uint_arg = value->uint_value; break;
+	case TYPE_INT:   set.code = CMD_SET_INT;   set.int_arg = value->int_value; break;
+	case TYPE_FLOAT: set.code = CMD_SET_FLOAT; set.float_arg = value->float_value; break;
+	}
+	*cmd = set;
+}
+
+// True if a generic division of lval by rval does not fail.
+static bool optimize_safe_division(const Register *lval, const Register *rval) {
+	if (lval->type == TYPE_FLOAT || rval->type == TYPE_FLOAT)
+		return true;
+	if (VM_AS(rval, UInt) == 0)
+		return false;
+	// only INT_MIN / -1 overflows, where both are ints.
+	return !(lval->type == TYPE_INT && rval->type == TYPE_INT && lval->int_value == INT64_MIN && rval->int_value == -1);
+}
+
+static void optimize_generic_op(Byte generic, Register *result, const Register *lval, const Register *rval) {
+	switch (generic) {
+	case CMD_ADD:     vm_op_add(result, lval, rval); break;
+	case CMD_SUB:     vm_op_sub(result, lval, rval); break;
+	case CMD_MULT:    vm_op_mult(result, lval, rval); break;
+	case CMD_DIV:     vm_op_div(result, lval, rval); break;
+	case CMD_AND:     vm_op_and(result, lval, rval); break;
+	case CMD_OR:      vm_op_or(result, lval, rval); break;
+	case CMD_XOR:     vm_op_xor(result, lval, rval); break;
+	case CMD_GREATER: vm_op_greater(result, lval, rval); break;
+	case CMD_LESS:    vm_op_less(result, lval, rval); break;
+	case CMD_EQUAL:   vm_op_equal(result, lval, rval); break;
+	case CMD_NEQUAL:  vm_op_nequal(result, lval, rval); break;
+	case CMD_GEQ:     vm_op_geq(result, lval, rval); break;
+	case CMD_LEQ:     vm_op_leq(result, lval, rval); break;
+	}
+}
+
+// Compute in result what the typed command computes from lval and rval, as the machine does.
+// Return false if the command may fail.
+static bool optimize_typed_op(Byte code, Register *result, const Register *lval, const Register *rval) {
+	Byte generic = vm_generic_code(code);
+	if (optimize_typed_kind(code) == TYPE_INT) {
+		Int a = lval->int_value;
+		Int b = rval->int_value;
+		result->type = TYPE_INT;
+		switch (generic) {
+		case CMD_ADD:     result->int_value = (Int) ((UInt) a + (UInt) b); break;
+		case CMD_SUB:     result->int_value = (Int) ((UInt) a - (UInt) b); break;
+		case CMD_MULT:    result->int_value = (Int) ((UInt) a * (UInt) b); break;
+		case CMD_DIV:
+			if (b == 0 || (a == INT64_MIN && b == -1))
+				return false;
+			result->int_value = a / b;
+			break;
+		default:          result->int_value = VM_RELATION(generic, a, b); break;
+		}
+	}
+	else {
+		Float a = lval->float_value;
+		Float b = rval->float_value;
+		result->type = TYPE_FLOAT;
+		switch (generic) {
+		case CMD_ADD:     result->float_value = a + b; break;
+		case CMD_SUB:     result->float_value = a - b; break;
+		case CMD_MULT:    result->float_value = a * b; break;
+		case CMD_DIV:     result->float_value = a / b; break;
+		default:          result->float_value = VM_RELATION(generic, a, b); break;
+		}
+	}
+	return true;
+}
+
+// If the operands of cmd are known, compute its result in result. Return true if it was.
+static bool optimize_fold(Optimizer *o, const Command *cmd, Register *result) {
+	Byte generic = vm_generic_code(cmd->code);
+
+	if (optimize_is_binary(generic)) {
+		const Register *lval = optimize_known(o, cmd->addr);
+		const Register *rval = optimize_known(o, cmd->addr_arg);
+		if (lval == NULL || rval == NULL)
+			return false;
+		if (optimize_is_typed(cmd->code)) {
+			Byte kind = optimize_typed_kind(cmd->code);
+			if (lval->type != kind || rval->type != kind)
+				return false;
+			return optimize_typed_op(cmd->code, result, lval, rval);
+		}
+		if (vm_type_rank(lval->type) == 0 || vm_type_rank(rval->type) == 0)
+			return false;
+		if (generic == CMD_LSHIFT || generic == CMD_RSHIFT)
+			return false;
+		if (generic == CMD_DIV && !optimize_safe_division(lval, rval))
+			return false;
+		optimize_generic_op(generic, result, lval, rval);
+		return true;
+	}
+
+	switch (cmd->code) {
+	case CMD_NOT:
+		{
+		const Register *lval = optimize_known(o, cmd->addr);
+		if (lval == NULL || vm_type_rank(lval->type) == 0)
+			return false;
+		vm_op_not(result, lval);
+		return true;
+		}
+	case CMD_COPY:
+		{
+		const Register *rval = optimize_known(o, cmd->addr_arg);
+		if (rval == NULL)
+			return false;
+		*result = *rval;
+		return true;
+		}
+	case CMD_ASSIGN:
+		{
+		const Register *lval = optimize_known(o, cmd->addr);
+		const Register *rval = optimize_known(o, cmd->addr_arg);
+		if (lval == NULL || rval == NULL || vm_type_rank(lval->type) == 0 || vm_type_rank(rval->type) == 0)
+			return false;
+		*result = *lval;
+		vm_op_assign(result, rval);
+		return true;
+		}
+	case CMD_ASSIGN_INT:
+	case CMD_ASSIGN_FLOAT_FROM_INT:
+		{
+		const Register *rval = optimize_known(o, cmd->addr_arg);
+		if (rval == NULL || rval->type != TYPE_INT)
+			return false;
+		result->type = cmd->code == CMD_ASSIGN_INT ? TYPE_INT : TYPE_FLOAT;
+		if (cmd->code == CMD_ASSIGN_INT)
+			result->int_value = rval->int_value;
+		else
+			result->float_value = (Float) rval->int_value;
+		return true;
+		}
+	case CMD_ASSIGN_FLOAT:
+	case CMD_ASSIGN_INT_FROM_FLOAT:
+		{
+		const Register *rval = optimize_known(o, cmd->addr_arg);
+		if (rval == NULL || rval->type != TYPE_FLOAT)
+			return false;
+		result->type = cmd->code == CMD_ASSIGN_FLOAT ? TYPE_FLOAT : TYPE_INT;
+		if (cmd->code == CMD_ASSIGN_FLOAT)
+			result->float_value = rval->float_value;
+		else
+			result->int_value = (Int) rval->float_value;
+		return true;
+		}
+	}
+	return false;
+}
+
+static bool optimize_is_int(const Register *reg, Int value) {
+	return reg != NULL && reg->type == TYPE_INT && reg->int_value == value;
+}
+
+static bool optimize_is_float(const Register *reg, Float value, bool negative) {
+	return reg != NULL && reg->type == TYPE_FLOAT && reg->float_value == value && (signbit(reg->float_value) != 0) == negative;
+}
+
+// Rewrite a typed arithmetic command with an operand that leaves the other one as it is, such
+// as x + 0, to an assignment, and x * 0 to a set. Return true if cmd was rewritten.
+static bool optimize_identity(Optimizer *o, Command *cmd) {
+	if (cmd->code < CMD_ADD_INT || cmd->code > CMD_DIV_FLOAT)
+		return false;
+	Byte generic = vm_generic_code(cmd->code);
+	Byte kind = optimize_typed_kind(cmd->code);
+	const Register *lval = optimize_known(o, cmd->addr);
+	const Register *rval = optimize_known(o, cmd->addr_arg);
+	Addr source = -1;
+
+	if (kind == TYPE_INT) {
+		if (generic == CMD_MULT && (optimize_is_int(lval, 0) || optimize_is_int(rval, 0))) {
+			Register zero;
+			zero.type = TYPE_INT;
+			zero.int_value = 0;
+			optimize_set(cmd, cmd->raddr, &zero);
+			return true;
+		}
+		if ((generic == CMD_ADD || generic == CMD_SUB) && optimize_is_int(rval, 0))
+			source = cmd->addr;
+		else if (generic == CMD_ADD && optimize_is_int(lval, 0))
+			source = cmd->addr_arg;
+		else if ((generic == CMD_MULT || generic == CMD_DIV) && optimize_is_int(rval, 1))
+			source = cmd->addr;
+		else if (generic == CMD_MULT && optimize_is_int(lval, 1))
+			source = cmd->addr_arg;
+	}
+	else {
+		// x + 0.0 is not x where x is -0.0, but x + -0.0 and x - 0.0 are.
+		if ((generic == CMD_ADD && optimize_is_float(rval, 0.0, true))
+			|| (generic == CMD_SUB && optimize_is_float(rval, 0.0, false)))
+			source = cmd->addr;
+		else if (generic == CMD_ADD && optimize_is_float(lval, 0.0, true))
+			source = cmd->addr_arg;
+		else if ((generic == CMD_MULT || generic == CMD_DIV) && optimize_is_float(rval, 1.0, false))
+			source = cmd->addr;
+		else if (generic == CMD_MULT && optimize_is_float(lval, 1.0, false))
+			source = cmd->addr_arg;
+	}
+	if (source < 0)
+		return false;
+
+	Command assign = { 0 };
+	assign.code = kind == TYPE_INT ? CMD_ASSIGN_INT : CMD_ASSIGN_FLOAT;
+	assign.addr = cmd->raddr;
+	assign.addr_arg = source;
+	*cmd = assign;
+	return true;
+}
+
+// Which operands of a command, addr on the left and addr_arg on the right, are registers it only
+// reads, so that it may read another register there.
+static void optimize_operands(Byte code, bool *left, bool *right) {
+	Byte generic = vm_generic_code(code);
+	*left = *right = false;
+	if (optimize_is_binary(generic) || (generic >= CMD_JNOT_GREATER && generic <= CMD_JNOT_LEQ))
+		*left = *right = true;
+	else if (generic == CMD_NOT)
+		*left = true;
+	else if (generic == CMD_JCOND || generic == CMD_COPY || generic == CMD_ASSIGN)
+		*right = true;
+}
+
+// Make the operands of cmd read the registers they are copies of.
+static void optimize_propagate(Optimizer *o, Command *cmd) {
+	bool left;
+	bool right;
+	optimize_operands(cmd->code, &left, &right);
+	if (left && o->copy[cmd->addr] >= 0)
+		cmd->addr = o->copy[cmd->addr];
+	if (right && o->copy[cmd->addr_arg] >= 0)
+		cmd->addr_arg = o->copy[cmd->addr_arg];
+}
+
+// True if cmd copies or assigns a register to itself.
+static bool optimize_is_self_assign(const Command *cmd) {
+	bool assign = cmd->code == CMD_COPY || cmd->code == CMD_ASSIGN || cmd->code == CMD_ASSIGN_INT || cmd->code == CMD_ASSIGN_FLOAT;
+	return assign && cmd->addr == cmd->addr_arg;
+}
+
+// Fold constants and propagate copies within each basic block. Return true if anything changed.
+static bool optimize_fold_pass(Optimizer *o) {
+	bool changed = false;
+	optimize_forget(o);
+	for (Addr i = 0; i < o->length; i++) {
+		if (o->leader[i])
+			optimize_forget(o);
+		if (o->removed[i])
+			continue;
+
+		Command *cmd = &o->cmds[i];
+		Command before = *cmd;
+		optimize_propagate(o, cmd);
+
+		Register result;
+		memset(&result, 0, sizeof(result));
+		if (optimize_fold(o, cmd, &result)) {
+			Addr addr = optimize_is_binary(vm_generic_code(cmd->code)) || cmd->code == CMD_NOT ? cmd->raddr : cmd->addr;
+			optimize_set(cmd, addr, &result);
+		}
+		else {
+			optimize_identity(o, cmd);
+		}
+		if (before.code != cmd->code || before.addr != cmd->addr || before.uint_arg != cmd->uint_arg || before.raddr != cmd->raddr)
+			changed = true;
+
+		if (optimize_is_self_assign(cmd)) {
+			o->removed[i] = 1;
+			changed = true;
+			continue;
+		}
+
+		Effect effect;
+		optimize_effect(o, cmd, &effect);
+		if (cmd->code == CMD_YIELD) {
+			// the host may change the observable registers before it resumes the program.
+			for (size_t j = 0; j < o->observable_count; j++)
+				optimize_kill(o, o->observable[j]);
+		}
+		if (effect.write < 0)
+			continue;
+
+		Addr write = effect.write;
+		optimize_kill(o, write);
+		switch (cmd->code) {
+		case CMD_SET_BYTE:
+		case CMD_SET_UINT:
+		case CMD_SET_INT:
+		case CMD_SET_FLOAT:
+			{
+			// the register as the set command stores it.
+			Register *value = &o->value[write];
+			memset(value, 0, sizeof(Register));
+			switch (cmd->code) {
+			case CMD_SET_BYTE:  value->type = TYPE_BYTE;  value->byte_value = cmd->byte_arg; break;
+			case CMD_SET_UINT:  value->type = TYPE_UINT;  value->uint_value = cmd->uint_arg; break;
+			case CMD_SET_INT:   value->type = TYPE_INT;   value->int_value = cmd->int_arg; break;
+			case CMD_SET_FLOAT: value->type = TYPE_FLOAT; value->float_value = cmd->float_arg; break;
+			}
+			o->known[write] = 1;
+			optimize_touch(o, write);
+			break;
+			}
+		case CMD_COPY:
+		case CMD_ASSIGN_INT:
+		case CMD_ASSIGN_FLOAT:
+			// a typed assignment of a register of its own type copies it.
+			o->copy[write] = cmd->addr_arg;
+			optimize_touch(o, write);
+			break;
+		}
+	}
+	optimize_forget(o);
+	return changed;
+}
+
+#define OPTIMIZE_BIT(set, addr) ((set)[(addr) / 64] & (1UL << ((addr) % 64)))
+#define OPTIMIZE_SET_BIT(set, addr) ((set)[(addr) / 64] |= (1UL << ((addr) % 64)))
+#define OPTIMIZE_CLEAR_BIT(set, addr) ((set)[(addr) / 64] &= ~(1UL << ((addr) % 64)))
+
+// Update live, the registers live after cmd, to those live before it.
+static void optimize_transfer(Optimizer *o, const Effect *effect, uint64_t *live) {
+	if (effect->reads_all) {
+		memset(live, 0xff, o->words * sizeof(uint64_t));
+		return;
+	}
+	if (effect->write >= 0 && effect->kills)
+		OPTIMIZE_CLEAR_BIT(live, effect->write);
+	for (int i = 0; i < effect->read_count; i++)
+		OPTIMIZE_SET_BIT(live, effect->reads[i]);
+	if (effect->observes) {
+		for (size_t i = 0; i < o->words; i++)
+			live[i] |= o->observed[i];
+	}
+}
+
+// Set o->live to the registers live at the end of block b.
+static void optimize_live_out(Optimizer *o, Addr b) {
+	uint64_t *live = o->live;
+	memset(live, 0, o->words * sizeof(uint64_t));
+
+	Addr last = o->block_start[b + 1] - 1;
+	while (last >= o->block_start[b] && o->removed[last])
+		last--;
+	Command *cmd = last >= o->block_start[b] ? &o->cmds[last] : NULL;
+	bool falls = cmd == NULL || (vm_generic_code(cmd->code) != CMD_JUMP && cmd->code != CMD_EXIT);
+
+	Addr successors[2];
+	int count = 0;
+	if (falls)
+		successors[count++] = o->block_start[b + 1];
+	if (cmd != NULL && optimize_is_jump(cmd->code))
+		successors[count++] = *optimize_jump_target(cmd);
+
+	for (int i = 0; i < count; i++) {
+		const uint64_t *in = successors[i] < o->length ? &o->live_in[o->block[successors[i]] * o->words] : o->observed;
+		for (size_t j = 0; j < o->words; j++)
+			live[j] |= in[j];
+	}
+}
+
+// Find the registers live at the start of each block.
+static void optimize_liveness(Optimizer *o) {
+	memset(o->live_in, 0, o->block_count * o->words * sizeof(uint64_t));
+
+	// the registers live at the start of each block, until they no longer change.
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (Addr b = o->block_count - 1; b >= 0; b--) {
+			optimize_live_out(o, b);
+			for (Addr i = o->block_start[b + 1] - 1; i >= o->block_start[b]; i--) {
+				if (o->removed[i])
+					continue;
+				Effect effect;
+				optimize_effect(o, &o->cmds[i], &effect);
+				optimize_transfer(o, &effect, o->live);
+			}
+			uint64_t *in = &o->live_in[b * o->words];
+			if (memcmp(in, o->live, o->words * sizeof(uint64_t)) != 0) {
+				memcpy(in, o->live, o->words * sizeof(uint64_t));
+				changed = true;
+			}
+		}
+	}
+}
+
+// Remove the commands whose only effect is to write a register that is not read before it is
+// written again. Return true if any was removed.
+static bool optimize_dead_store_pass(Optimizer *o) {
+	optimize_liveness(o);
+	bool removed = false;
+	for (Addr b = 0; b < o->block_count; b++) {
+		optimize_live_out(o, b);
+		for (Addr i = o->block_start[b + 1] - 1; i >= o->block_start[b]; i--) {
+			if (o->removed[i])
+				continue;
+			Effect effect;
+			optimize_effect(o, &o->cmds[i], &effect);
+			if (effect.pure && effect.write >= 0 && !OPTIMIZE_BIT(o->live, effect.write)) {
+				o->removed[i] = 1;
+				removed = true;
+				continue;
+			}
+			optimize_transfer(o, &effect, o->live);
+		}
+	}
+	return removed;
+}
+
+// Remove a push followed by a pop, and an enter or leave of no registers. Return true if any
+// was removed.
+static bool optimize_peephole_pass(Optimizer *o) {
+	bool removed = false;
+	for (Addr i = 0; i < o->length; i++) {
+		if (o->removed[i])
+			continue;
+		Command *cmd = &o->cmds[i];
+		if ((cmd->code == CMD_ENTER || cmd->code == CMD_LEAVE) && cmd->addr == 0) {
+			o->removed[i] = 1;
+			removed = true;
+			continue;
+		}
+		if (cmd->code != CMD_PUSH)
+			continue;
+
+		// the pop must not be reached by a jump, which would not have pushed.
+		Addr next = i + 1;
+		bool reached = false;
+		while (next < o->length && o->removed[next])
+			reached |= o->target[next++];
+		if (next < o->length && o->cmds[next].code == CMD_POP && !reached && !o->target[next]) {
+			o->removed[i] = o->removed[next] = 1;
+			removed = true;
+		}
+	}
+	return removed;
+}
+
+// Take out the removed commands and renumber the jumps. Return the number of commands removed.
+static long optimize_compact(Optimizer *o) {
+	// a removed command is replaced by the next one kept, where its jumps land.
+	Addr length = 0;
+	for (Addr i = 0; i < o->length; i++) {
+		o->index[i] = length;
+		if (!o->removed[i])
+			length++;
+	}
+	o->index[o->length] = length;
+
+	length = 0;
+	for (Addr i = 0; i < o->length; i++) {
+		if (o->removed[i])
+			continue;
+		Command cmd = o->cmds[i];
+		if (optimize_is_jump(cmd.code)) {
+			Addr *target = optimize_jump_target(&cmd);
+			*target = o->index[*target];
+		}
+		o->cmds[length++] = cmd;
+	}
+	memset(o->removed, 0, (size_t) o->length);
+
+	long removed = o->length - length;
+	o->length = length;
+	return removed;
+}
+
+// Find the length of the stack before each command. Return 0, or -1 if it is not the same on all
+// paths to a command, or a command reads it.
+static int optimize_depths(Optimizer *o) {
+	for (Addr i = 0; i < o->length; i++)
+		o->depth[i] = -1;
+	size_t count = 0;
+	o->depth[0] = o->stack_length;
+	o->work[count++] = 0;
+	while (count > 0) {
+		Addr i = o->work[--count];
+		Command *cmd = &o->cmds[i];
+		Addr depth = o->depth[i];
+		switch (cmd->code) {
+		case CMD_PUSH:  depth++; break;
+		case CMD_POP:   depth--; break;
+		case CMD_ENTER: depth += cmd->addr; break;
+		case CMD_LEAVE: depth -= cmd->addr; break;
+		case CMD_SET_SLEN: return -1;
+		}
+		if (depth < 0)
+			return -1;
+
+		Addr successors[2];
+		int successor_count = 0;
+		if (optimize_is_jump(cmd->code))
+			successors[successor_count++] = *optimize_jump_target(cmd);
+		if (cmd->code != CMD_JUMP && cmd->code != CMD_EXIT)
+			successors[successor_count++] = i + 1;
+		for (int j = 0; j < successor_count; j++) {
+			Addr next = successors[j];
+			if (next >= o->length)
+				continue;
+			if (o->depth[next] < 0) {
+				o->depth[next] = depth;
+				o->work[count++] = next;
+			}
+			else if (o->depth[next] != depth) {
+				return -1;
+			}
+		}
+	}
+	return 0;
+}
+
+// Find the condition of the loop from head to the jump back at back: the only jump out of the
+// loop, to the command after back, with nothing before it that changes the stack. No jump may
+// enter the loop other than at head, and the stack command must not show it. Return the index of
+// the condition, or -1 if there is none.
+static Addr optimize_loop_exit(Optimizer *o, Addr head, Addr back) {
+	Addr exit = -1;
+	for (Addr i = 0; i < o->length; i++) {
+		Command *cmd = &o->cmds[i];
+		bool inside = i >= head && i <= back;
+		if (inside && cmd->code == CMD_STACK)
+			return -1;
+		if (!optimize_is_jump(cmd->code))
+			continue;
+		Addr target = *optimize_jump_target(cmd);
+		if (!inside) {
+			if (target > head && target <= back)
+				return -1;
+			continue;
+		}
+		if (target >= head && target <= back)
+			continue;
+		if (target != back + 1 || cmd->code == CMD_JUMP || exit >= 0)
+			return -1;
+		exit = i;
+	}
+
+	for (Addr i = head; i < exit; i++) {
+		Byte code = o->cmds[i].code;
+		if (code == CMD_PUSH || code == CMD_POP || code == CMD_ENTER || code == CMD_LEAVE)
+			return -1;
+	}
+	return exit;
+}
+
+// The argument of a command that holds the register it writes.
+static Addr *optimize_write_target(Command *cmd) {
+	Byte generic = vm_generic_code(cmd->code);
+	return optimize_is_binary(generic) || generic == CMD_NOT ? &cmd->raddr : &cmd->addr;
+}
+
+// Make the command at i write fresh instead of the register it writes, and the commands that read
+// what it wrote read fresh. They must be in its block, before the register is written again, and
+// read it through their operands. Return true if it was done.
+static bool optimize_rename(Optimizer *o, Addr i, Addr fresh) {
+	Effect effect;
+	optimize_effect(o, &o->cmds[i], &effect);
+	Addr write = effect.write;
+	for (int j = 0; j < effect.read_count; j++) {
+		if (effect.reads[j] == write)
+			return false;
+	}
+
+	// the readers are kept in work, to change them once all are found.
+	size_t count = 0;
+	bool written = false;
+	Addr end = o->block_start[o->block[i] + 1];
+	for (Addr j = i + 1; j < end && !written; j++) {
+		Command *cmd = &o->cmds[j];
+		optimize_effect(o, cmd, &effect);
+		if (effect.reads_all || (effect.observes && OPTIMIZE_BIT(o->observed, write)))
+			return false;
+
+		int reads = 0;
+		for (int k = 0; k < effect.read_count; k++)
+			reads += effect.reads[k] == write;
+		if (reads > 0) {
+			bool left;
+			bool right;
+			optimize_operands(cmd->code, &left, &right);
+			if ((left && cmd->addr == write) + (right && cmd->addr_arg == write) != reads)
+				return false;
+			o->work[count++] = j;
+		}
+		if (effect.write == write) {
+			if (!effect.kills)
+				return false;
+			written = true;
+		}
+	}
+	if (!written) {
+		optimize_live_out(o, o->block[i]);
+		if (OPTIMIZE_BIT(o->live, write))
+			return false;
+	}
+
+	for (size_t j = 0; j < count; j++) {
+		Command *cmd = &o->cmds[o->work[j]];
+		bool left;
+		bool right;
+		optimize_operands(cmd->code, &left, &right);
+		if (left && cmd->addr == write)
+			cmd->addr = fresh;
+		if (right && cmd->addr_arg == write)
+			cmd->addr_arg = fresh;
+	}
+	*optimize_write_target(&o->cmds[i]) = fresh;
+	return true;
+}
+
+// Put the commands marked in hoist before the loop from head to the jump back at back, whose
+// condition is at exit. If the body enters a frame of frame registers, enter size registers before
+// the loop instead, and leave them after it.
+static void optimize_move(Optimizer *o, Addr head, Addr exit, Addr back, Addr frame, Addr size) {
+	Command *moved = o->moved;
+	Addr *origin = o->work;
+	Addr length = 0;
+	Command enter = { 0 };
+	enter.code = CMD_ENTER;
+	enter.addr = size;
+	Command leave = { 0 };
+	leave.code = CMD_LEAVE;
+	leave.addr = size;
+
+	for (Addr i = 0; i < head; i++) {
+		o->index[i] = length;
+		origin[length] = i;
+		moved[length++] = o->cmds[i];
+	}
+	Addr preheader = length;
+	if (frame > 0) {
+		origin[length] = -1;
+		moved[length++] = enter;
+	}
+	for (Addr i = head; i <= back; i++) {
+		if (o->hoist[i]) {
+			origin[length] = i;
+			moved[length++] = o->cmds[i];
+		}
+	}
+	// a jump to a command moved out lands on the next one in the loop.
+	for (Addr i = head; i <= back; i++) {
+		o->index[i] = length;
+		if (o->hoist[i] || (frame > 0 && (i == exit + 1 || i == back - 1)))
+			continue;
+		origin[length] = i;
+		moved[length++] = o->cmds[i];
+	}
+	Addr after = length;
+	if (frame > 0) {
+		origin[length] = -1;
+		moved[length++] = leave;
+	}
+	for (Addr i = back + 1; i < o->length; i++) {
+		o->index[i] = length;
+		origin[length] = i;
+		moved[length++] = o->cmds[i];
+	}
+	o->index[o->length] = length;
+
+	// the loop is entered through the commands moved, and left through the frame.
+	for (Addr i = 0; i < length; i++) {
+		Command *cmd = &moved[i];
+		o->reached[i] = origin[i] >= 0 && o->done[origin[i]];
+		if (!optimize_is_jump(cmd->code))
+			continue;
+		bool inside = origin[i] >= head && origin[i] <= back;
+		Addr *target = optimize_jump_target(cmd);
+		if (*target == head && !inside)
+			*target = preheader;
+		else if (*target == back + 1 && inside)
+			*target = after;
+		else
+			*target = o->index[*target];
+	}
+	memcpy(o->cmds, moved, sizeof(Command) * (size_t) length);
+	memcpy(o->done, o->reached, (size_t) length);
+}
+
+// Move the commands of the loop from head to the jump back at back which compute the same value
+// on every iteration before the loop. Return the number of commands moved out of a loop for the
+// first time.
+static long optimize_hoist_loop(Optimizer *o, Addr head, Addr back) {
+	Addr exit = optimize_loop_exit(o, head, back);
+	if (exit < 0)
+		return 0;
+	Addr frame = 0;
+	Command *enter = &o->cmds[exit + 1];
+	Command *leave = &o->cmds[back - 1];
+	if (exit + 1 < back - 1 && enter->code == CMD_ENTER && leave->code == CMD_LEAVE && enter->addr == leave->addr)
+		frame = enter->addr;
+
+	// how many times the loop writes each register, and the first one it does not use.
+	memset(o->writes, 0, sizeof(Addr) * (size_t) o->slots);
+	Addr fresh = o->depth[head] + frame;
+	for (Addr i = head; i <= back; i++) {
+		Effect effect;
+		optimize_effect(o, &o->cmds[i], &effect);
+		if (effect.write >= 0) {
+			o->writes[effect.write]++;
+			optimize_read(&effect, effect.write);
+		}
+		for (int j = 0; j < effect.read_count; j++) {
+			if (effect.reads[j] >= fresh)
+				fresh = effect.reads[j] + 1;
+		}
+		// the host may write the observable registers at a yield.
+		if (o->cmds[i].code == CMD_YIELD) {
+			for (size_t j = 0; j < o->observable_count; j++)
+				o->writes[o->observable[j]]++;
+		}
+	}
+
+	// without a frame to grow, only the registers there before the loop can be written.
+	const uint64_t *live = &o->live_in[o->block[head] * o->words];
+	Addr top = o->depth[head] + frame;
+	Addr limit = frame > 0 ? o->slots : o->depth[head];
+	long count = 0;
+	long first = 0;
+	memset(o->hoist, 0, (size_t) o->length);
+	bool found = true;
+	while (found) {
+		found = false;
+		for (Addr i = exit + 1; i < back; i++) {
+			if (o->hoist[i] || (frame > 0 && (i == exit + 1 || i == back - 1)))
+				continue;
+			Effect effect;
+			optimize_effect(o, &o->cmds[i], &effect);
+			if (!effect.pure || !effect.kills || effect.write < 0 || effect.write >= limit)
+				continue;
+			bool invariant = true;
+			for (int j = 0; j < effect.read_count && invariant; j++)
+				invariant = o->writes[effect.reads[j]] == 0 && effect.reads[j] < limit;
+			if (!invariant)
+				continue;
+
+			// the register must hold what the command writes wherever the loop reads it.
+			Addr write = effect.write;
+			if (o->writes[write] > 1 || OPTIMIZE_BIT(live, write)) {
+				if (frame == 0 || fresh >= o->slots || !optimize_rename(o, i, fresh))
+					continue;
+				o->writes[write]--;
+				write = fresh++;
+				o->writes[write] = 1;
+			}
+			o->writes[write]--;
+			if (write >= top)
+				top = write + 1;
+			o->hoist[i] = 1;
+			first += !o->done[i];
+			o->done[i] = 1;
+			count++;
+			found = true;
+		}
+	}
+
+	if (count > 0)
+		optimize_move(o, head, exit, back, frame, top - o->depth[head]);
+	return first;
+}
+
+// Move the invariant commands out of each loop, the innermost first. Return the number of commands
+// moved.
+static long optimize_hoist_pass(Optimizer *o) {
+	long hoisted = 0;
+	memset(o->done, 0, (size_t) o->length);
+	for (;;) {
+		// the shortest loop left is not around any other.
+		Addr back = -1;
+		for (Addr i = 0; i < o->length; i++) {
+			Command *cmd = &o->cmds[i];
+			if (cmd->code != CMD_JUMP || cmd->addr > i || o->done[i])
+				continue;
+			if (back < 0 || i - cmd->addr < back - o->cmds[back].addr)
+				back = i;
+		}
+		if (back < 0)
+			break;
+		o->done[back] = 1;
+
+		optimize_blocks(o);
+		if (optimize_depths(o) != 0)
+			break;
+		optimize_liveness(o);
+		hoisted += optimize_hoist_loop(o, o->cmds[back].addr, back);
+	}
+	return hoisted;
+}
+
+// Put the commands back in the machine. Return 0, or -1 if the program was left as it was.
+static int optimize_store(Optimizer *o) {
+	size_t constants = 0;
+	for (Addr i = 0; i < o->length; i++) {
+		Byte code = o->cmds[i].code;
+		if (code == CMD_SET_INT || code == CMD_SET_UINT || code == CMD_SET_FLOAT)
+			constants++;
+	}
+
+	// with room for all constants, pushing the commands back cannot fail.
+	Array *pool = o->vm->program->constants;
+	if (array_resize(pool, constants) != 0)
+		return -1;
+	pool->length = 0;
+	vm_truncate_commands(o->vm, 0);
+	for (Addr i = 0; i < o->length; i++)
+		vm_push_cmd(o->vm, o->cmds[i]);
+	return 0;
+}
+
+long optimize_program(VM *vm, const Addr *observable, size_t count, long *hoisted) {
+	Program *program = vm->program;
+	Addr length = program->commands->length;
+	if (!vm->owns_program || program->shared || vm->cmd_ptr != 0)
+		return -1;
+	if (length <= 0)
+		return 0;
+
+	Optimizer o;
+	memset(&o, 0, sizeof(o));
+	o.vm = vm;
+	o.length = length;
+	o.stack_length = vm->stack->length;
+	o.observable = observable;
+	o.observable_count = count;
+	long rval = -1;
+
+	o.cmds = (Command *) malloc(sizeof(Command) * length);
+	o.removed = (Byte *) calloc(length, 1);
+	o.leader = (Byte *) calloc(length, 1);
+	o.target = (Byte *) calloc(length, 1);
+	o.reached = (Byte *) calloc(length, 1);
+	o.work = (Addr *) malloc(sizeof(Addr) * (2 * length + 1));
+	o.block = (Addr *) malloc(sizeof(Addr) * length);
+	o.block_start = (Addr *) malloc(sizeof(Addr) * (length + 1));
+	o.index = (Addr *) malloc(sizeof(Addr) * (length + 1));
+	o.depth = (Addr *) malloc(sizeof(Addr) * length);
+	o.hoist = (Byte *) calloc(length, 1);
+	o.done = (Byte *) calloc(length, 1);
+	o.moved = (Command *) malloc(sizeof(Command) * length);
+	if (o.cmds == NULL || o.removed == NULL || o.leader == NULL || o.target == NULL || o.reached == NULL
+		|| o.work == NULL || o.block == NULL || o.block_start == NULL || o.index == NULL || o.depth == NULL
+		|| o.hoist == NULL || o.done == NULL || o.moved == NULL)
+		goto optimize_program_end;
+	if (optimize_load(&o) != 0)
+		goto optimize_program_end;
+
+	// with room for the registers the frames of loops grow by.
+	o.slots += OPTIMIZE_LOOP_SLOTS;
+	o.known = (Byte *) calloc(o.slots, 1);
+	o.value = (Register *) malloc(sizeof(Register) * o.slots);
+	o.copy = (Addr *) malloc(sizeof(Addr) * o.slots);
+	o.touched = (Addr *) malloc(sizeof(Addr) * o.slots);
+	o.is_touched = (Byte *) calloc(o.slots, 1);
+	o.writes = (Addr *) malloc(sizeof(Addr) * o.slots);
+	o.words = (o.slots + 63) / 64;
+	o.live_in = (uint64_t *) malloc(sizeof(uint64_t) * o.words * o.max_blocks);
+	o.live = (uint64_t *) malloc(sizeof(uint64_t) * o.words);
+	o.observed = (uint64_t *) calloc(o.words, sizeof(uint64_t));
+	if (o.known == NULL || o.value == NULL || o.copy == NULL || o.touched == NULL || o.is_touched == NULL
+		|| o.writes == NULL || o.live_in == NULL || o.live == NULL || o.observed == NULL)
+		goto optimize_program_end;
+	for (Addr i = 0; i < o.slots; i++)
+		o.copy[i] = -1;
+	for (size_t i = 0; i < count; i++)
+		OPTIMIZE_SET_BIT(o.observed, observable[i]);
+
+	bool changed = true;
+	for (int round = 0; changed && round < OPTIMIZE_ROUNDS; round++) {
+		changed = optimize_thread_pass(&o);
+		changed |= optimize_unreachable_pass(&o);
+		optimize_blocks(&o);
+		changed |= optimize_fold_pass(&o);
+		changed |= optimize_dead_store_pass(&o);
+		changed |= optimize_peephole_pass(&o);
+	}
+	long removed = optimize_compact(&o);
+	long moved = optimize_hoist_pass(&o);
+	if (optimize_store(&o) != 0)
+		goto optimize_program_end;
+	if (hoisted != NULL)
+		*hoisted = moved;
+	rval = removed;
+
+optimize_program_end:
+	free(o.cmds);
+	free(o.removed);
+	free(o.leader);
+	free(o.target);
+	free(o.reached);
+	free(o.work);
+	free(o.block);
+	free(o.block_start);
+	free(o.index);
+	free(o.depth);
+	free(o.hoist);
+	free(o.done);
+	free(o.moved);
+	free(o.known);
+	free(o.value);
+	free(o.copy);
+	free(o.touched);
+	free(o.is_touched);
+	free(o.writes);
+	free(o.live_in);
+	free(o.live);
+	free(o.observed);
+	return rval;
+}
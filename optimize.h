@@ -0,0 +1,52 @@
+#ifndef __OPTIMIZE_H__
+#define __OPTIMIZE_H__
+
+#include <stddef.h>
+#include "vm.h"
+
+/*
+ * Optimization of a compiled program, after it is parsed and before it runs.
+ *
+ * The compiler emits each expression as it parses it: a literal is set to a temporary, an
+ * operator computes a new temporary, an assignment copies the last one. The passes here rewrite
+ * the commands of the machine in place:
+ *
+ * - Constant folding. A command whose operands were set to literals earlier in its basic block
+ *   becomes a set of its result, computed as the machine computes it. Integer divisions by zero
+ *   are left to fail at run time.
+ * - Identities of typed commands: x + 0, x - 0, x * 1 and x / 1 become assignments of x, and
+ *   x * 0 a set of 0. Assignments are propagated, so that the commands after them read their
+ *   source.
+ * - Dead store elimination. A command that only writes a register, which is written again or
+ *   never read after it on any path, is removed. Liveness is computed over the control flow graph.
+ * - Peephole: a push followed by a pop, a copy or assignment of a register to itself and an
+ *   enter or leave of no registers are removed.
+ * - Jump threading. A jump that lands on an unconditional jump goes straight to where that one
+ *   goes, and one that lands on an exit becomes an exit. A jump to the next command is removed.
+ * - Unreachable code elimination: commands that no path from the first command reaches, such as
+ *   those after an exit or a goto, are removed.
+ *
+ * The passes run again until they find nothing more. Then the removed commands are taken out and
+ * the jumps are renumbered.
+ *
+ * - Loop-invariant code motion. A loop is found from the jump back to its head. A command of its
+ *   body that only writes a register from registers the loop does not write, such as the set of a
+ *   literal, moves before the loop and runs once. The register must not be read in the loop before
+ *   the command writes it. If the register is reused for other values in the loop, the command
+ *   writes a new register and its readers read that one. The frame the body enters on every
+ *   iteration is entered once before the loop instead, with room for the new registers, and left
+ *   after it. Inner loops are done first, so what they move out may move out of the outer ones.
+ *
+ * The program prints, and leaves at the observable addresses, the same values as it did. Other
+ * registers may hold other values when it ends, or when a slice runs out.
+ */
+
+// Optimize the commands of vm, which must own its program and not have run yet.
+// The count registers at observable are read when the program ends or yields, and the host may
+// write them at a yield, such as the globals of the program.
+// Return the number of commands removed, or -1 if the program was left as it was: it has commands
+// the passes do not handle, such as the commands command, or memory ran out. The number of commands
+// moved out of loops is put in hoisted, if not NULL.
+long optimize_program(VM *vm, const Addr *observable, size_t count, long *hoisted);
+
+#endif /* __OPTIMIZE_H__ */
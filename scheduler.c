@@ -0,0 +1,77 @@
+#include "scheduler.h"
+
+Scheduler *scheduler_new(long budget) {
+	Scheduler *scheduler = NULL;
+	Array *queue = NULL;
+
+	scheduler = (Scheduler *) malloc(sizeof(Scheduler));
+	if (scheduler == NULL)
+		goto scheduler_new_fail;
+	queue = array_new(sizeof(SchedulerTask), 0);
+	if (queue == NULL)
+		goto scheduler_new_fail;
+
+	scheduler->queue = queue;
+	scheduler->head = 0;
+	scheduler->budget = budget > 0 ? budget : 1;
+	return scheduler;
+
+scheduler_new_fail:
+	if (scheduler != NULL)
+		free(scheduler);
+	if (queue != NULL)
+		array_delete(queue);
+	return NULL;
+}
+
+void scheduler_delete(Scheduler *scheduler) {
+	array_delete(scheduler->queue);
+	free(scheduler);
+}
+
+int scheduler_add(Scheduler *scheduler, VM *vm, void *data) {
+	SchedulerTask task = { vm, data };
+	return array_push(scheduler->queue, &task) < 0;
+}
+
+size_t scheduler_length(Scheduler *scheduler) {
+	return scheduler->queue->length - scheduler->head;
+}
+
+// Take the task at the front of the queue.
+static SchedulerTask scheduler_pop(Scheduler *scheduler) {
+	SchedulerTask task = ((SchedulerTask *) scheduler->queue->heap)[scheduler->head++];
+
+	// the queue only grows at the back: once the front half is spent, move the rest down.
+	size_t length = scheduler_length(scheduler);
+	if (scheduler->head > length) {
+		SchedulerTask *tasks = (SchedulerTask *) scheduler->queue->heap;
+		memmove(tasks, tasks + scheduler->head, length * sizeof(SchedulerTask));
+		scheduler->queue->length = length;
+		scheduler->head = 0;
+	}
+	return task;
+}
+
+int scheduler_step(Scheduler *scheduler, SchedulerTask *task) {
+	if (scheduler_length(scheduler) == 0)
+		return -1;
+	SchedulerTask front = scheduler_pop(scheduler);
+	int status = vm_run_slice(front.vm, scheduler->budget);
+	if (status == VM_FINISHED || status == VM_FAILED) {
+		*task = front;
+		return 1;
+	}
+	// the task was just taken out, so there is room for it at the back.
+	array_push(scheduler->queue, &front);
+	return 0;
+}
+
+void scheduler_run(Scheduler *scheduler, SchedulerDone done, void *context) {
+	SchedulerTask task;
+	int step;
+	while ((step = scheduler_step(scheduler, &task)) >= 0) {
+		if (step == 1 && done != NULL)
+			done(task.vm, task.data, context);
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "array.h"
+#include "vm.h"
+
+/*
+ * A run queue of machines sharing one thread.
+ *
+ * The scheduler runs the machine at the front of the queue for one slice of at most budget
+ * commands (see vm_run_slice) and puts it at the back unless it finished, so every machine gets
+ * its turn however long the others run. A script can give up the rest of its slice early with
+ * yield.
+ *
+ *     Scheduler *scheduler = scheduler_new(10000);
+ *     scheduler_add(scheduler, vm, data);
+ *     ...
+ *     scheduler_run(scheduler, done, context);
+ *     scheduler_delete(scheduler);
+ *
+ * Machines are not deleted by the scheduler; done is called for each one as it finishes, or fails
+ * (see VM_FAILED).
+ */
+
+typedef struct SchedulerTask {
+	VM *vm;
+	void *data;				// Anything the caller wants back with the machine.
+} SchedulerTask;
+
+typedef struct Scheduler {
+	Array *queue;			// The tasks, an array of SchedulerTask. The front is at head.
+	size_t head;			// Index of the front of the queue.
+	long budget;			// Commands per slice.
+} Scheduler;
+
+// Called when the machine of a task finishes.
+typedef void (*SchedulerDone)(VM *vm, void *data, void *context);
+
+
+// Public functions:
+
+Scheduler *scheduler_new(long budget);
+void scheduler_delete(Scheduler *scheduler);
+
+// Put a machine at the back of the queue. Return 0 on success.
+int scheduler_add(Scheduler *scheduler, VM *vm, void *data);
+
+// Number of machines in the queue.
+size_t scheduler_length(Scheduler *scheduler);
+
+// Run one slice of the machine at the front of the queue. Return 1 if it finished or failed, in
+// which case it is out of the queue and *task is set to it, 0 if it went to the back, or -1 if the
+// queue is empty.
+int scheduler_step(Scheduler *scheduler, SchedulerTask *task);
+
+// Run the machines in turn until all of them have finished, calling done as each one does.
+void scheduler_run(Scheduler *scheduler, SchedulerDone done, void *context);
+
+#endif /* __SCHEDULER_H__ */
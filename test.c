@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "hash.h"
 #include "array.h"
 #include "map_array.h"
@@ -184,6 +185,46 @@ int main(void){
 	}
 #endif
 
+	// arrays over borrowed memory
+#if true
+	{
+		int memory[4] = {10, 20, 30, 0};
+		Array array;
+		array_init_view(&array, memory, sizeof(int), 3, 4);
+
+		// the view fills its capacity in place.
+		int in = 40;
+		array_push(&array, &in);
+		printf("view: heap is memory %d, borrowed %d, length %zu, capacity %zu\n", array.heap == memory, array.borrowed, array.length, array.capacity);
+
+		// growing past it copies the elements out to a heap of its own.
+		in = 50;
+		long rval = array_push(&array, &in);
+		int out = 0;
+		array_get(&array, 0, &out);
+		printf("grown: rval %ld, heap is memory %d, borrowed %d, length %zu, capacity %zu, first %d\n", rval, array.heap == memory, array.borrowed, array.length, array.capacity, out);
+		printf("memory left as it was: %d %d %d %d\n", memory[0], memory[1], memory[2], memory[3]);
+
+		// a length too large to allocate fails and leaves the array as it was.
+		int failed = array_resize(&array, SIZE_MAX);
+		printf("resize to SIZE_MAX: rval %d, length %zu, capacity %zu\n", failed, array.length, array.capacity);
+
+		array_release(&array);
+
+		// clearing a view lets go of the memory without freeing it, and the array grows on a heap
+		// of its own after.
+		array_init_view(&array, memory, sizeof(int), 4, 4);
+		array_clear(&array);
+		printf("cleared: heap %p, borrowed %d, length %zu, capacity %zu\n", array.heap, array.borrowed, array.length, array.capacity);
+		in = 60;
+		rval = array_push(&array, &in);
+		printf("pushed: rval %ld, heap is memory %d, borrowed %d, memory left as it was: %d %d %d %d\n", rval, array.heap == memory, array.borrowed, memory[0], memory[1], memory[2], memory[3]);
+
+		array_release(&array);
+		printf("Done\n");
+	}
+#endif
+
 	// maps & arrays
 #if false
 	{
@@ -8,246 +8,461 @@
 #include "hash.h"
 #include "map_array.h"
 #include "vm.h"
+#include "vm_ops.h"
+#include "compiler.h"
+#include "native.h"
+#include "optimize.h"
 #include "types.h"
 
-extern FILE *yyin;
-
-// Virtual machine
-VM *vm;
-bool interactive_mode;		// when input is from stdin and executing them at once.
-
-// Scope handling
-size_t stack_track;			// keep track in compile time of the size of the machine stack.
-Array *stack_scope;			// keeps track of machine stack positions for each scope level.
-Array *identifiers_scope;	// keeps track of identifiers positions for each scope level.
-Array *identifier_stack;	// keeps track of identifiers, that is, variable, labels, function names. All identifiers are in the machine stack.
-
-// Structured control flow handing
-Array *control_stack;		// keeps track of the command address where control flow structures begin.
-
-Map *variables;				// maps variable names with their place in the machine stack. Labels are treated as variables.
-MapArray *labels;			// maps jump labels and the list of their positions in the commands.
-Array *strings;				// keeps track of all identifiers and string literals in the program. These are strings dynamically allocated at lex level, so we want to keep their pointers to be able to free them.
-size_t line_count;			// keeps track of source code lines.
-bool compilation_success;
-
-// null pointer
-Addr null_addr;				// the null pointer is an int 0 at the bottom of the stack.
-
-void dump() {
+void dump(Compiler *compiler) {
 	// print scope stack
-	printf("stack_scope: %lu {", stack_scope->length);
-	for (int i = 0; i < stack_scope->length; i++) {
+	fprintf(compiler->out, "stack_scope: %lu {", compiler->stack_scope->length);
+	for (int i = 0; i < compiler->stack_scope->length; i++) {
 		Addr addr;
-		array_get(stack_scope, i, &addr);
-		printf(" %lu", addr);
+		array_get(compiler->stack_scope, i, &addr);
+		fprintf(compiler->out, " %lu", addr);
 	}
-	printf(" }\n");
+	fprintf(compiler->out, " }\n");
 
-	printf("identifiers_scope: %lu {", identifiers_scope->length);
-	for (int i = 0; i < identifiers_scope->length; i++) {
+	fprintf(compiler->out, "identifiers_scope: %lu {", compiler->identifiers_scope->length);
+	for (int i = 0; i < compiler->identifiers_scope->length; i++) {
 		Addr addr;
-		array_get(identifiers_scope, i, &addr);
-		printf(" %lu", addr);
+		array_get(compiler->identifiers_scope, i, &addr);
+		fprintf(compiler->out, " %lu", addr);
 	}
-	printf(" }\n");
+	fprintf(compiler->out, " }\n");
 
 	// print identifiers
-	printf("identifier_stack: %lu\n", identifier_stack->length);
-	for (int i = 0; i < identifier_stack->length; i++) {
+	fprintf(compiler->out, "identifier_stack: %lu\n", compiler->identifier_stack->length);
+	for (int i = 0; i < compiler->identifier_stack->length; i++) {
 		
 		char *vname = NULL;
-		array_get(identifier_stack, i, &vname);
+		array_get(compiler->identifier_stack, i, &vname);
 
 		Addr addr;
 		size_t addr_size;
-		if (!map_get(variables,
+		if (!map_get(compiler->variables,
 			vname, strlen(vname),
 			&addr, &addr_size
 		))
 		{
-			printf("Identifier '%s' undeclared.\n", vname);
+			fprintf(compiler->out, "Identifier '%s' undeclared.\n", vname);
 			goto dump_end;
 		}
 
-		Register reg = vm_get(vm, addr);
+		Register reg = vm_get(compiler->vm, addr);
 
-		if (array_contains(identifiers_scope, &i))
-			printf("_ %4d: ", i);
+		if (array_contains(compiler->identifiers_scope, &i))
+			fprintf(compiler->out, "_ %4d: ", i);
 		else
-			printf("  %4d: ", i);
+			fprintf(compiler->out, "  %4d: ", i);
 
-		printf("#%-4li ", addr); 
+		fprintf(compiler->out, "#%-4li ", addr); 
 		switch (reg.type) {
 		case TYPE_BYTE:
-			printf("(byte)    %-15s %10d\n", vname, reg.byte_value);
+			fprintf(compiler->out, "(byte)    %-15s %10d\n", vname, reg.byte_value);
 			break;
 		case TYPE_UINT:
-			printf("(uint)    %-15s %10lu\n", vname, reg.uint_value);
+			fprintf(compiler->out, "(uint)    %-15s %10lu\n", vname, reg.uint_value);
 			break;
 		case TYPE_INT:
-			printf("(int)     %-15s %10ld\n", vname, reg.int_value);
+			fprintf(compiler->out, "(int)     %-15s %10ld\n", vname, reg.int_value);
 			break;
 		case TYPE_FLOAT:
-			printf("(float)   %-15s %10f\n", vname, reg.float_value);
+			fprintf(compiler->out, "(float)   %-15s %10f\n", vname, reg.float_value);
 			break;
 		default:
-			printf("default\n");
+			fprintf(compiler->out, "default\n");
 			break;
 		}
 
 	}
 dump_end:
-	printf("dump end\n");
+	fprintf(compiler->out, "dump end\n");
 }
 
-void exit_program(int status_code) {
-	if (variables != NULL)
-		map_delete(variables);
-	if (vm != NULL)
-		vm_delete(vm);
-	if (stack_scope != NULL)
-		array_delete(stack_scope);
-	if (identifiers_scope != NULL)
-		array_delete(identifiers_scope);
-	if (identifier_stack != NULL)
-		array_delete(identifier_stack);
-	if (labels != NULL)
-		map_array_delete(labels);
-	if (control_stack != NULL)
-		array_delete(control_stack);
-
-	if (strings != NULL) {
-		for (int i = 0; i < strings->length; i++) {
-			char *str = NULL;
-			array_get(strings, i, &str);
-			free(str);
-		}
-		array_delete(strings);
+void exit_program(Compiler *compiler, int status_code) {
+	if (compiler != NULL) {
+		if (compiler->in != NULL)
+			fclose(compiler->in);
+		compiler_delete(compiler);
 	}
-
-	fclose(yyin);
 	printf("Good bye.\n");
 	exit(status_code);
 }
 
-int yyparse();
+int yyparse(yyscan_t scanner, Compiler *compiler);
 int yylex();
+int yylex_init_extra(Compiler *compiler, yyscan_t *scanner);
+int yylex_destroy(yyscan_t scanner);
+void yyset_in(FILE *in, yyscan_t scanner);
+Compiler *yyget_extra(yyscan_t scanner);
 
-void yyerror(const char *str) {
-	fprintf(stderr, "YYError: %s. Line %lu.\n", str, line_count);
+void yyerror(yyscan_t scanner, Compiler *compiler, const char *str) {
+	fprintf(compiler->err, "YYError: %s. Line %lu.\n", str, compiler->line_count);
 }
 
 #define PRINT_ERROR(...) {													\
-	fprintf(stderr, "Error (line %lu): ", line_count);						\
-	fprintf(stderr, __VA_ARGS__);											\
-	fprintf(stderr, "\n");													\
-	compilation_success = false;											\
+	fprintf(compiler->err, "Error (line %lu): ", compiler->line_count);			\
+	fprintf(compiler->err, __VA_ARGS__);											\
+	fprintf(compiler->err, "\n");													\
+	compiler->compilation_success = false;									\
 }
 
+// Abort the parse. Only for grammar actions.
 #define CRITICAL_ERROR(...) {												\
-	fprintf(stderr, "Critical Error (line %lu): ", line_count);				\
-	fprintf(stderr, __VA_ARGS__);											\
-	fprintf(stderr, "\n");													\
-	fprintf(stderr, "Exiting program with status code -1.\n");				\
-	exit_program(-1);														\
+	fprintf(compiler->err, "Critical Error (line %lu): ", compiler->line_count);	\
+	fprintf(compiler->err, __VA_ARGS__);											\
+	fprintf(compiler->err, "\n");													\
+	fprintf(compiler->err, "Exiting program with status code -1.\n");				\
+	compiler->compilation_success = false;									\
+	YYABORT;																\
 }
 
-// This function is called when finished reading from yyin. Execute code if it was a file.
-int yywrap() { 
-	printf("wrapping up.\n");
+// This function is called when finished reading from the input of the scanner.
+int yywrap(yyscan_t scanner) {
+	Compiler *compiler = yyget_extra(scanner);
+	fprintf(compiler->out, "wrapping up.\n");
 	return 1; 
 }
 
-int main(int argc, const char **argv) {
-	// arguments
-	if (argc > 1) {
-		printf("%s\n", argv[1]);
-		yyin = fopen(argv[1], "r");
-		interactive_mode = false;
-	}
-	else {
-		interactive_mode = true;
-		printf("Interactive mode.\n");
+// True if the slots of the current block are reserved all at once by its enter command,
+// instead of being pushed one by one.
+// In interactive mode each sentence runs as soon as it is parsed, before the size of the
+// block is known, so slots are always pushed.
+bool in_frame(Compiler *compiler) {
+	return compiler->stack_scope->length > 0 && !compiler->interactive_mode;
+}
+
+// True if addr holds a temporary that is still to be used.
+bool is_temp(Compiler *compiler, Addr addr) {
+	Byte temp = 0;
+	if (addr >= 0 && addr < compiler->temps->length)
+		array_get(compiler->temps, addr, &temp);
+	return temp;
+}
+
+void set_temp(Compiler *compiler, Addr addr, Byte temp) {
+	Byte none = 0;
+	while (compiler->temps->length <= addr) {
+		// without the mark, the slot is just not reused.
+		if (array_push(compiler->temps, &none) < 0)
+			return;
 	}
+	array_set(compiler->temps, addr, &temp);
+}
 
-	// initialization
-	int rval = 0;
-	{
-		stack_track = 0;
-		variables = NULL;
-		vm = NULL;
-		line_count = 1;
-		compilation_success = true;
+// Take a new slot at the top of the machine stack. Return its address.
+Addr alloc_slot(Compiler *compiler) {
+	compiler->stack_track++;
+	if (!in_frame(compiler))
+		vm_push_cmd_push(compiler->vm);
+	else if (compiler->stack_track > compiler->stack_peak)
+		compiler->stack_peak = compiler->stack_track;
+	set_temp(compiler, compiler->stack_track, 0);
+	return compiler->stack_track;
+}
 
-		variables = map_new(2);
-		if (variables == NULL) {
-			printf("Map is null.\n");
-			rval = 1;
-			goto main_end;
-		}
+// Take a slot for the value of an expression: the slot of a temporary that was already used, if
+// one was in the current block, or else a new one. Each temporary is used once, by the expression
+// around it, so the stack a block needs is the most temporaries alive at once, not one slot per
+// operator.
+// Only temporaries of the current block are taken: a loop tests its condition again after its
+// block, so the block must not write over the temporaries of the condition.
+Addr alloc_temp(Compiler *compiler) {
+	size_t position = 0;
+	array_peek(compiler->stack_scope, &position);
+
+	Addr addr = 0;
+	if (array_peek(compiler->free_temps, &addr) >= 0 && addr > (Addr) position)
+		array_pop(compiler->free_temps, &addr);
+	else
+		addr = alloc_slot(compiler);
+	set_temp(compiler, addr, 1);
+	return addr;
+}
 
-		vm = vm_new();
-		if (vm == NULL) {
-			printf("vm is null.\n");
-			rval = 1;
-			goto main_end;
-		}
+// The temporary at addr was used: its slot may hold the next one. Anything else, such as a
+// variable, is left alone, and so is address 1, which true reads (see boolean).
+void free_temp(Compiler *compiler, Addr addr) {
+	if (!is_temp(compiler, addr) || addr == 1)
+		return;
+	set_temp(compiler, addr, 0);
+	array_push(compiler->free_temps, &addr);
+}
 
-		stack_scope = array_new(sizeof(size_t), 0);
-		if (stack_scope == NULL) {
-			printf("stack_scope is null.\n");
-			rval = 1;
-			goto main_end;
-		}
+// Forget the used temporaries above position, which a block that ends takes with it.
+void drop_temps(Compiler *compiler, size_t position) {
+	Addr addr = 0;
+	while (array_peek(compiler->free_temps, &addr) >= 0 && addr > (Addr) position)
+		array_pop(compiler->free_temps, &addr);
+}
 
-		identifiers_scope = array_new(sizeof(size_t), 0);
-		if (identifiers_scope == NULL) {
-			printf("identifiers_scope is null.\n");
-			rval = 1;
-			goto main_end;
-		}
+// Remember a variable declared at the top level, for the host to find it by name.
+void add_global(Compiler *compiler, const char *identifier, Addr addr, Byte type) {
+	if (compiler->stack_scope->length > 0)
+		return;
+	CompilerGlobal global = { addr, type };
+	if (!map_put(compiler->globals, identifier, strlen(identifier), &global, sizeof(global)))
+		PRINT_ERROR("Could not record global %s.", identifier);
+}
 
-		identifier_stack = array_new(sizeof(char *), 0);
-		if (identifier_stack == NULL) {
-			printf("identifier_stack is null.\n");
-			rval = 1;
-			goto main_end;
-		}
+// Release the slot at the top of the machine stack.
+void free_slot(Compiler *compiler) {
+	if (!in_frame(compiler))
+		vm_push_cmd_pop(compiler->vm);
+	compiler->stack_track--;
+}
 
-		labels = map_array_new(2, sizeof(Addr), 0);
-		if (labels == NULL) {
-			printf("Labels is null.\n");
-			rval = 1;
-			goto main_end;
+// True if the command writes its result to raddr.
+bool has_result(Byte code) {
+	return (code >= CMD_ADD && code <= CMD_DIV) || (code >= CMD_AND && code <= CMD_LEQ);
+}
+
+// Type of the value at addr as known at compile time, or 0 if unknown.
+Byte slot_type(Compiler *compiler, Addr addr) {
+	Byte type = 0;
+	if (addr >= 0 && addr < compiler->slot_types->length)
+		array_get(compiler->slot_types, addr, &type);
+	return type;
+}
+
+void set_slot_type(Compiler *compiler, Addr addr, Byte type) {
+	Byte unknown = 0;
+	while (compiler->slot_types->length <= addr) {
+		if (array_push(compiler->slot_types, &unknown) < 0) {
+			// without the types of the slots, emit generic commands only.
+			compiler->static_typing = false;
+			return;
 		}
+	}
+	array_set(compiler->slot_types, addr, &type);
+}
+
+// Record the type of the value written by the command at index and, if the types of its
+// operands are known, rewrite it to its typed variant. Return index.
+Addr typed(Compiler *compiler, Addr index) {
+	if (index < 0)
+		return index;
+	Command cmd = vm_get_cmd(compiler->vm, index);
+	Byte code = vm_generic_code(cmd.code);
+	Byte ltype = slot_type(compiler, cmd.addr);
+	Byte rtype = slot_type(compiler, cmd.addr_arg);
+
+	switch (code) {
+	case CMD_SET_BYTE:  set_slot_type(compiler, cmd.addr, TYPE_BYTE); break;
+	case CMD_SET_UINT:  set_slot_type(compiler, cmd.addr, TYPE_UINT); break;
+	case CMD_SET_INT:   set_slot_type(compiler, cmd.addr, TYPE_INT); break;
+	case CMD_SET_FLOAT: set_slot_type(compiler, cmd.addr, TYPE_FLOAT); break;
+	case CMD_ASSIGN:
+		// assignment converts to the type of the left value, which keeps its type.
+		break;
+	case CMD_ADD:
+	case CMD_SUB:
+	case CMD_MULT:
+	case CMD_DIV:
+	case CMD_GREATER:
+	case CMD_LESS:
+	case CMD_EQUAL:
+	case CMD_NEQUAL:
+	case CMD_GEQ:
+	case CMD_LEQ:
+		// the result takes the wider of the operand types.
+		if (vm_type_rank(ltype) == 0 || vm_type_rank(rtype) == 0)
+			set_slot_type(compiler, cmd.raddr, 0);
+		else
+			set_slot_type(compiler, cmd.raddr, vm_type_rank(ltype) > vm_type_rank(rtype) ? ltype : rtype);
+		break;
+	default:
+		if (has_result(code))
+			set_slot_type(compiler, cmd.raddr, 0);
+		break;
+	}
+
+	Byte typed_code = vm_typed_code(code, ltype, rtype);
+	if (compiler->static_typing && typed_code != 0) {
+		cmd.code = typed_code;
+		if (vm_set_cmd(compiler->vm, index, cmd) != 0)
+			PRINT_ERROR("Could not change command %ld.", index);
+	}
+	return index;
+}
 
-		strings = array_new(sizeof(char *), 0);
-		if (strings == NULL) {
-			printf("Identifiers is null.\n");
-			rval = 1;
-			goto main_end;
+// Turn all typed commands back into generic commands.
+void untype_commands(Compiler *compiler) {
+	for (Addr i = 0; i < compiler->vm->program->commands->length; i++) {
+		Command cmd = vm_get_cmd(compiler->vm, i);
+		if (vm_generic_code(cmd.code) != cmd.code) {
+			cmd.code = vm_generic_code(cmd.code);
+			if (vm_set_cmd(compiler->vm, i, cmd) != 0)
+				PRINT_ERROR("Could not change command %ld.", i);
 		}
+	}
+}
 
-		control_stack = array_new(sizeof(Addr), 0);
-		if (control_stack == NULL) {
-			printf("Control stack is null.\n");
-			rval = 1;
-			goto main_end;
+// Emit the jump taken when the condition at bool_addr is false, with its target set to 0.
+// A condition that was just computed by a comparison is fused with the jump into a single
+// compare-and-branch command, and the slot of its result is dropped.
+// Set loop_addr to the command a loop jumps back to in order to test the condition again.
+// Return the index of the jump command.
+Addr emit_jump_unless(Compiler *compiler, Addr bool_addr, Addr *loop_addr) {
+	Addr length = compiler->vm->program->commands->length;
+
+	if (length >= 2) {
+		Command last = vm_get_cmd(compiler->vm, length - 1);
+		Command previous = vm_get_cmd(compiler->vm, length - 2);
+		Byte relation = vm_generic_code(last.code);
+		if (relation >= CMD_GREATER && relation <= CMD_LEQ
+			&& last.raddr == bool_addr && is_temp(compiler, bool_addr))
+		{
+			// outside a frame a new slot for the result was pushed right before the comparison.
+			bool pushed = !in_frame(compiler) && bool_addr == compiler->stack_track && previous.code == CMD_PUSH;
+			vm_truncate_commands(compiler->vm, pushed ? length - 2 : length - 1);
+			if (pushed) {
+				set_temp(compiler, bool_addr, 0);
+				compiler->stack_track--;
+			}
+			else {
+				free_temp(compiler, bool_addr);
+			}
+			// the result of the comparison may have taken the slot of an operand, and with it the
+			// type of the slot, so the jump is typed as the comparison was and not from the slots.
+			Addr jump = vm_push_cmd_jnot(compiler->vm, relation, last.addr, last.addr_arg, 0);
+			Byte type = 0;
+			if (last.code == vm_typed_code(relation, TYPE_INT, TYPE_INT))
+				type = TYPE_INT;
+			else if (last.code == vm_typed_code(relation, TYPE_FLOAT, TYPE_FLOAT))
+				type = TYPE_FLOAT;
+			if (jump >= 0 && type != 0) {
+				Command cmd = vm_get_cmd(compiler->vm, jump);
+				cmd.code = vm_typed_code(cmd.code, type, type);
+				if (vm_set_cmd(compiler->vm, jump, cmd) != 0)
+					PRINT_ERROR("Could not change command %ld.", jump);
+			}
+			*loop_addr = jump;
+			return *loop_addr;
 		}
+	}
+
+	// test again from the command that computed the condition, if it is the last one.
+	*loop_addr = length;
+	if (length >= 1) {
+		Command last = vm_get_cmd(compiler->vm, length - 1);
+		if (has_result(vm_generic_code(last.code)) && last.raddr == bool_addr)
+			*loop_addr = length - 1;
+	}
+
+	alloc_slot(compiler);
+	typed(compiler, vm_push_cmd_not(compiler->vm, bool_addr, compiler->stack_track));
+	free_temp(compiler, bool_addr);
+	return vm_push_cmd_jcond(compiler->vm, 0, compiler->stack_track);
+}
 
-		null_addr = vm_push_int(vm, 0);
+// Emit a call of the native function called name, whose count arguments are the last in
+// call_args, and take them out. Arguments already in consecutive slots of the types of the
+// parameters are passed where they are; otherwise each is assigned to a new slot of the type of
+// its parameter. Return the slot of the result.
+Addr emit_call(Compiler *compiler, const char *name, int count) {
+	Addr args[NATIVE_MAX_ARGS];
+	for (int i = count - 1; i >= 0; i--) {
+		Addr addr = compiler->null_addr;
+		array_pop(compiler->call_args, &addr);
+		if (i < NATIVE_MAX_ARGS)
+			args[i] = addr;
+	}
+
+	Native native;
+	long index = native_find(compiler->vm->program->natives, name, &native);
+	if (index < 0) {
+		PRINT_ERROR("Function '%s' undeclared.", name);
+		return compiler->null_addr;
+	}
+	if (count != native.arg_count) {
+		PRINT_ERROR("Function '%s' takes %d arguments, not %d.", name, native.arg_count, count);
+		return compiler->null_addr;
+	}
+
+	bool in_place = compiler->static_typing;
+	for (int i = 0; i < count; i++) {
+		if (args[i] != args[0] + i || slot_type(compiler, args[i]) != native.args[i])
+			in_place = false;
+	}
+	Addr first = count > 0 ? args[0] : 0;
+	if (!in_place && count > 0) {
+		// the copies are new slots, to be consecutive, and temporaries used by the call.
+		first = compiler->stack_track + 1;
+		for (int i = 0; i < count; i++) {
+			alloc_slot(compiler);
+			if (native.args[i] == TYPE_INT)
+				typed(compiler, vm_push_cmd_set_int(compiler->vm, compiler->stack_track, 0));
+			else
+				typed(compiler, vm_push_cmd_set_float(compiler->vm, compiler->stack_track, 0.0));
+			typed(compiler, vm_push_cmd_assign(compiler->vm, compiler->stack_track, args[i]));
+			set_temp(compiler, compiler->stack_track, 1);
+		}
+		for (int i = 0; i < count; i++)
+			free_temp(compiler, args[i]);
 	}
+	// the call reads all its arguments before it writes its result.
+	for (int i = 0; i < count; i++)
+		free_temp(compiler, first + i);
 
-	yyparse();
+	Addr addr = alloc_temp(compiler);
+	vm_push_cmd_call_native(compiler->vm, first, index, addr);
+	set_slot_type(compiler, addr, native.result);
+	return addr;
+}
 
-main_end:
-	exit_program(rval);
+// Optimize the program, keeping the values of the globals, which the host reads after the run,
+// and of the null slot. Report how many commands were removed and moved out of loops.
+void optimize(Compiler *compiler) {
+	Map *globals = compiler->globals;
+	Addr *observable = (Addr *) malloc(sizeof(Addr) * (globals->length + 1));
+	if (observable == NULL)
+		return;
+	size_t count = 0;
+	observable[count++] = compiler->null_addr;
+	for (size_t i = 0; i < globals->length; i++) {
+		if (globals->buckets[i].key == NULL)
+			continue;
+		CompilerGlobal global;
+		memcpy(&global, globals->buckets[i].value, sizeof(global));
+		observable[count++] = global.addr;
+	}
+
+	long hoisted = 0;
+	long removed = optimize_program(compiler->vm, observable, count, &hoisted);
+	free(observable);
+	if (removed > 0) {
+		compiler->removed_commands = removed;
+		fprintf(compiler->out, "Optimized out %ld commands.\n", removed);
+	}
+	if (removed >= 0 && hoisted > 0) {
+		compiler->hoisted_commands = hoisted;
+		fprintf(compiler->out, "Hoisted %ld commands out of loops.\n", hoisted);
+	}
+}
+
+int compiler_parse(Compiler *compiler) {
+	yyscan_t scanner;
+	if (yylex_init_extra(compiler, &scanner) != 0)
+		return 1;
+	yyset_in(compiler->in, scanner);
+	int rval = yyparse(scanner, compiler);
+	yylex_destroy(scanner);
 	return rval;
 }
 
 %}
 
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {Compiler *compiler}
+
+%code requires {
+#include "compiler.h"
+}
+
 %union {
 	Int int_value;
 	Float float_value;
@@ -264,10 +479,11 @@ main_end:
 %type <float_value> FLOAT_LITERAL
 %type <int_value> HEX_LITERAL
 %type <addr_value> expression
+%type <int_value> arguments
 %type <int_value> vm_command_int_param
 %type <float_value> vm_command_float_param
 
-%token UNDERLINE NEWLINE IDENTIFIER INT_LITERAL FLOAT_LITERAL HEX_LITERAL STRING_LITERAL PRINT BYTE INT UINT LONG ULONG FLOAT DOUBLE BOOL STRING PURE QUIT EXIT TRUE FALSE STACK COMMANDS VM_SET_BYTE VM_SET_INT VM_SET_UINT VM_SET_FLOAT VM_MALLOC VM_FREE VM_ADD VM_SUB VM_MULT VM_DIV VM_JUMP VM_JCOND VM_POP VM_PUSH VM_PUSH_BYTE VM_PUSH_INT VM_PUSH_UINT VM_PUSH_FLOAT VM_AND VM_OR VM_XOR VM_NOT VM_EXIT DUMP GOTO NOT AND OR IF WHILE EQUAL NEQUAL GEQ LEQ CONTINUE BREAK RETURN
+%token UNDERLINE NEWLINE IDENTIFIER INT_LITERAL FLOAT_LITERAL HEX_LITERAL STRING_LITERAL PRINT BYTE INT UINT LONG ULONG FLOAT DOUBLE BOOL STRING PURE QUIT EXIT TRUE FALSE STACK COMMANDS VM_SET_BYTE VM_SET_INT VM_SET_UINT VM_SET_FLOAT VM_MALLOC VM_FREE VM_ADD VM_SUB VM_MULT VM_DIV VM_JUMP VM_JCOND VM_POP VM_PUSH VM_PUSH_BYTE VM_PUSH_INT VM_PUSH_UINT VM_PUSH_FLOAT VM_AND VM_OR VM_XOR VM_NOT VM_EXIT DUMP GOTO NOT AND OR IF WHILE EQUAL NEQUAL GEQ LEQ CONTINUE BREAK RETURN YIELD
 %left '+' '-'
 %left '*' '/' '%'
 %left OR XOR '|' '^'
@@ -280,17 +496,12 @@ main_end:
 program
 	: sentences
 	{
-		if (!interactive_mode) {
-			printf("Finished compiling.\n");
-			if (compilation_success) {
-				printf("Compilation successful.\n");
-				printf("Now running.\n");
-				vm_run(vm);
-			}
-			else {
-				printf("Compilation Failed. Exiting with status -1.\n");
-				exit_program(-1);
-			}
+		if (!compiler->interactive_mode) {
+			fprintf(compiler->out, "Finished compiling.\n");
+			if (!compiler->static_typing)
+				untype_commands(compiler);
+			else if (compiler->optimize && compiler->compilation_success)
+				optimize(compiler);
 		}
 	}
 	;
@@ -299,43 +510,44 @@ sentences
 	: %empty
 	| sentences declaration end_sentence
 	{
-		if (interactive_mode) {
-			vm_run(vm);
+		if (compiler->interactive_mode) {
+			vm_run(compiler->vm);
 		}
 	}
 	| sentences assignment end_sentence
 	{
-		if (interactive_mode) {
-			vm_run(vm);
+		if (compiler->interactive_mode) {
+			vm_run(compiler->vm);
 		}
 	}
 	| sentences expression end_sentence
 	{
-		if (interactive_mode) {
-			vm_run(vm);
+		free_temp(compiler, $2);
+		if (compiler->interactive_mode) {
+			vm_run(compiler->vm);
 			Addr addr = $2;
-			Register reg = vm_get(vm, addr);
+			Register reg = vm_get(compiler->vm, addr);
 			switch (reg.type) {
 			case TYPE_BYTE:
-				printf("%d\n", reg.byte_value);
+				fprintf(compiler->out, "%d\n", reg.byte_value);
 				break;
 			case TYPE_UINT:
-				printf("%lu\n", reg.uint_value);
+				fprintf(compiler->out, "%lu\n", reg.uint_value);
 				break;
 			case TYPE_INT:
-				printf("%ld\n", reg.int_value);
+				fprintf(compiler->out, "%ld\n", reg.int_value);
 				break;
 			case TYPE_FLOAT:
-				printf("%f\n", reg.float_value);
+				fprintf(compiler->out, "%f\n", reg.float_value);
 				break;
 			default:
-				printf("no type\n");
+				fprintf(compiler->out, "no type\n");
 			}
 		}
 	}
 	| sentences error end_sentence
 	{
-		printf("Error at line %lu\n", line_count);
+		fprintf(compiler->out, "Error at line %lu\n", compiler->line_count);
 	}
 	| sentences label end_sentence
 	| sentences end_sentence
@@ -344,8 +556,8 @@ sentences
 	| sentences vm_command end_sentence
 	{
 		// if it is interactive mode, execute after each line.
-		if (interactive_mode) {
-			vm_run(vm);
+		if (compiler->interactive_mode) {
+			vm_run(compiler->vm);
 		}
 	}
 	| sentences GOTO IDENTIFIER end_sentence
@@ -361,17 +573,17 @@ sentences
 		Addr addr;
 		size_t size;
 		if (map_get(
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&addr, &size
 		)) {
-			vm_push_cmd_jump(vm, addr);
+			vm_push_cmd_jump(compiler->vm, addr);
 		}
 		else {
-			vm_push_cmd_jump(vm, 0);
+			vm_push_cmd_jump(compiler->vm, 0);
 
-			Addr jump_addr = vm->commands->length - 1;
-			if (map_array_push(labels, identifier, strlen(identifier), &jump_addr) < 0) {
+			Addr jump_addr = compiler->vm->program->commands->length - 1;
+			if (map_array_push(compiler->labels, identifier, strlen(identifier), &jump_addr) < 0) {
 				CRITICAL_ERROR("label push failed.");
 			}
 		}
@@ -389,15 +601,14 @@ if_block
 	{
 		// lookup the address of the conditional jump and set it to jump here.
 		Addr index = 0;
-		array_pop(control_stack, &index);
+		array_pop(compiler->control_stack, &index);
 
-		Command command;
-		array_get(vm->commands, index, &command);
-		command.addr = vm->commands->length;
-		array_set(vm->commands, index, &command);
+		Command command = vm_get_cmd(compiler->vm, index);
+		if (vm_set_jump_target(compiler->vm, index, compiler->vm->program->commands->length) != 0)
+			PRINT_ERROR("Could not set the target of the jump.");
 
-		vm_push_cmd_pop(vm);
-		stack_track--;
+		if (command.code == CMD_JCOND)
+			free_slot(compiler);
 	}
 	;
 
@@ -407,16 +618,12 @@ if_statement
 		// set a jump conditional to 0.
 		// at the end of the if block, retroactively set that 0 as the actual command address.
 		Addr bool_addr = $2;
-		
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_not(vm, bool_addr, stack_track);
 
-		Addr if_addr = vm->commands->length;
-		if (array_push(control_stack, &if_addr) < 0) {
+		Addr loop_addr = 0;
+		Addr if_addr = emit_jump_unless(compiler, bool_addr, &loop_addr);
+		if (array_push(compiler->control_stack, &if_addr) < 0) {
 			CRITICAL_ERROR("If control_stack push failed.");
 		}
-		vm_push_cmd_jcond(vm, 0, stack_track);
 	}
 	;
 
@@ -425,17 +632,27 @@ while_block
 	: while_statement block
 	{
 		Addr index = 0;
-		array_pop(control_stack, &index);
-
-		Command command;
-		array_get(vm->commands, index, &command);
-		command.addr = vm->commands->length + 2;
-		array_set(vm->commands, index, &command);
-
-		vm_push_cmd_pop(vm);
-		vm_push_cmd_jump(vm, index - 3);
-		vm_push_cmd_pop(vm);
-		stack_track--; // only one, because one pop when looping, one pop when done
+		Addr loop_addr = 0;
+		array_pop(compiler->control_stack, &index);
+		array_pop(compiler->control_stack, &loop_addr);
+
+		Command command = vm_get_cmd(compiler->vm, index);
+		if (command.code == CMD_JCOND && !in_frame(compiler)) {
+			if (vm_set_jump_target(compiler->vm, index, compiler->vm->program->commands->length + 2) != 0)
+				PRINT_ERROR("Could not set the target of the jump.");
+			vm_push_cmd_pop(compiler->vm);
+			vm_push_cmd_jump(compiler->vm, loop_addr);
+			vm_push_cmd_pop(compiler->vm);
+			compiler->stack_track--; // only one, because one pop when looping, one pop when done
+		}
+		else {
+			// fused compare-and-branch, or a condition slot in the frame of the block: nothing to pop.
+			if (vm_set_jump_target(compiler->vm, index, compiler->vm->program->commands->length + 1) != 0)
+				PRINT_ERROR("Could not set the target of the jump.");
+			vm_push_cmd_jump(compiler->vm, loop_addr);
+			if (command.code == CMD_JCOND)
+				compiler->stack_track--;
+		}
 	}
 	;
 
@@ -443,16 +660,12 @@ while_statement
 	: WHILE expression
 	{
 		Addr bool_addr = $2;
-		
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_not(vm, bool_addr, stack_track);
 
-		Addr while_addr = vm->commands->length;
-		if (array_push(control_stack, &while_addr) < 0) {
+		Addr loop_addr = 0;
+		Addr while_addr = emit_jump_unless(compiler, bool_addr, &loop_addr);
+		if (array_push(compiler->control_stack, &loop_addr) < 0 || array_push(compiler->control_stack, &while_addr) < 0) {
 			CRITICAL_ERROR("While control_stack push failed.");
 		}
-		vm_push_cmd_jcond(vm, 0, stack_track);
 	}
 	;
 
@@ -463,29 +676,55 @@ block
 start_block
 	: '{'
 	{
-		size_t level = array_push(stack_scope, &stack_track);
-		array_push(identifiers_scope, &identifier_stack->length);
+		size_t level = array_push(compiler->stack_scope, &compiler->stack_track);
+		array_push(compiler->identifiers_scope, &compiler->identifier_stack->length);
+
+		if (in_frame(compiler)) {
+			// reserve the frame of the block at once. Its size is set at the end of the block.
+			size_t enter_addr = vm_push_cmd_enter(compiler->vm, 0);
+			array_push(compiler->frame_stack, &enter_addr);
+			array_push(compiler->frame_stack, &compiler->stack_peak);
+			compiler->stack_peak = compiler->stack_track;
+		}
 	}
 	;
 end_block
 	: '}'
 	{
 		size_t position = 0;
-		array_pop(stack_scope, &position);
-
-		for (; stack_track > position; stack_track--) {
-			// pop from machine stack (run time)
-			vm_push_cmd_pop(vm);
+		array_peek(compiler->stack_scope, &position);
+		drop_temps(compiler, position);
+
+		if (in_frame(compiler)) {
+			// size the frame to the deepest slot the block used and drop it in one command.
+			size_t enter_addr = 0;
+			Addr size = compiler->stack_peak - position;
+			array_pop(compiler->frame_stack, &compiler->stack_peak);
+			array_pop(compiler->frame_stack, &enter_addr);
+
+			Command enter = vm_get_cmd(compiler->vm, enter_addr);
+			enter.addr = size;
+			if (vm_set_cmd(compiler->vm, enter_addr, enter) != 0)
+				PRINT_ERROR("Could not size the frame of the block.");
+			vm_push_cmd_leave(compiler->vm, size);
+			compiler->stack_track = position;
 		}
+		else {
+			for (; compiler->stack_track > position; compiler->stack_track--) {
+				// pop from machine stack (run time)
+				vm_push_cmd_pop(compiler->vm);
+			}
+		}
+		array_pop(compiler->stack_scope, &position);
 
 		position = 0;
-		array_pop(identifiers_scope, &position);
+		array_pop(compiler->identifiers_scope, &position);
 
-		for (int i = identifier_stack->length; i > position; i--) {
+		for (int i = compiler->identifier_stack->length; i > position; i--) {
 			// remove variables from stack and from map (compile time)
 			char *vname = NULL;
-			array_pop(identifier_stack, &vname);
-			map_remove(variables, vname, strlen(vname));
+			array_pop(compiler->identifier_stack, &vname);
+			map_remove(compiler->variables, vname, strlen(vname));
 		}
 	}
 	;
@@ -495,12 +734,13 @@ function_declaration
 	: IDENTIFIER  param_list ':' type
 	{
 		char *identifier = $1;
-		printf("function declaration\n");
+		fprintf(compiler->out, "function declaration\n");
 	}
 	;
 
 param_list
-	: param_list_content ')'
+	: '(' ')'
+	| param_list_content ')'
 
 param_list_content
 	: param_list_content ',' IDENTIFIER ':' type
@@ -511,7 +751,6 @@ param_list_content
 	{
 		char *identifier = $2;
 	}
-	| '('
 	; 
 
 
@@ -525,35 +764,33 @@ label
 		Addr addr = 0;
 		size_t size = 0;
 		if (map_get(
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&addr, &size
 		)) {
 			PRINT_ERROR("Identifier '%s' already declared.", identifier);
 		}
 
-		array_push(identifier_stack, &identifier);
+		array_push(compiler->identifier_stack, &identifier);
 
 		if (!map_put (
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
-			&vm->commands->length, sizeof(vm->commands->length)
+			&compiler->vm->program->commands->length, sizeof(compiler->vm->program->commands->length)
 		)){
 			CRITICAL_ERROR("Could not push identifier %s to variables.", identifier);
 		}
 
-		if (map_array_contains_array(labels, identifier, strlen(identifier))) {
+		if (map_array_contains_array(compiler->labels, identifier, strlen(identifier))) {
 			Array *array = NULL;
-			map_array_get_array(labels, identifier, strlen(identifier), &array);
+			map_array_get_array(compiler->labels, identifier, strlen(identifier), &array);
 
 			for (int i = 0; i < array->length; i++) {
 				Addr index = 0;
 				array_get(array, i, &index);
 
-				Command command;
-				array_get(vm->commands, index, &command);
-				command.addr = vm->commands->length;
-				array_set(vm->commands, index, &command);
+				if (vm_set_jump_target(compiler->vm, index, compiler->vm->program->commands->length) != 0)
+					PRINT_ERROR("Could not set the target of the jump.");
 			}
 		}
 	}
@@ -567,37 +804,36 @@ declaration
 		Addr addr = 0;
 		size_t size = 0;
 		if (map_get(
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&addr, &size
 		)) {
 			PRINT_ERROR("Identifier '%s' already declared.", identifier);
 		}
 		else {
-			array_push(identifier_stack, &identifier);
+			array_push(compiler->identifier_stack, &identifier);
 
-			vm_push_cmd_push(vm);
-
-			stack_track++;
+			alloc_slot(compiler);
 
 			map_put (
-				variables,
+				compiler->variables,
 				identifier, strlen(identifier),
-				&stack_track, sizeof(stack_track)
+				&compiler->stack_track, sizeof(compiler->stack_track)
 			);
+			add_global(compiler, identifier, compiler->stack_track, type);
 
 			switch (type) {
 			case TYPE_BYTE:
-				vm_push_cmd_set_byte(vm, stack_track, 0);
+				typed(compiler, vm_push_cmd_set_byte(compiler->vm, compiler->stack_track, 0));
 				break;
 			case TYPE_UINT:
-				vm_push_cmd_set_uint(vm, stack_track, 0);
+				typed(compiler, vm_push_cmd_set_uint(compiler->vm, compiler->stack_track, 0));
 				break;
 			case TYPE_INT:
-				vm_push_cmd_set_int(vm, stack_track, 0);
+				typed(compiler, vm_push_cmd_set_int(compiler->vm, compiler->stack_track, 0));
 				break;
 			case TYPE_FLOAT:
-				vm_push_cmd_set_float(vm, stack_track, 0.0);
+				typed(compiler, vm_push_cmd_set_float(compiler->vm, compiler->stack_track, 0.0));
 				break;
 			}
 		}
@@ -611,41 +847,41 @@ declaration
 		Addr addr = 0;
 		size_t size = 0;
 		if (map_get(
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&addr, &size
 		)) {
 			PRINT_ERROR("Identifier '%s' already declared.", identifier);
 		}
 		else {
-			array_push(identifier_stack, &identifier);
-
-			vm_push_cmd_push(vm);
+			array_push(compiler->identifier_stack, &identifier);
 
-			stack_track++;
+			alloc_slot(compiler);
 			map_put (
-				variables,
+				compiler->variables,
 				identifier, strlen(identifier),
-				&stack_track, sizeof(stack_track)
+				&compiler->stack_track, sizeof(compiler->stack_track)
 			);
+			add_global(compiler, identifier, compiler->stack_track, type);
 
 			switch (type) {
 			case TYPE_BYTE:
-				vm_push_cmd_set_byte(vm, stack_track, 0);
+				typed(compiler, vm_push_cmd_set_byte(compiler->vm, compiler->stack_track, 0));
 				break;
 			case TYPE_UINT:
-				vm_push_cmd_set_uint(vm, stack_track, 0);
+				typed(compiler, vm_push_cmd_set_uint(compiler->vm, compiler->stack_track, 0));
 				break;
 			case TYPE_INT:
-				vm_push_cmd_set_int(vm, stack_track, 0);
+				typed(compiler, vm_push_cmd_set_int(compiler->vm, compiler->stack_track, 0));
 				break;
 			case TYPE_FLOAT:
-				vm_push_cmd_set_float(vm, stack_track, 0.0);
+				typed(compiler, vm_push_cmd_set_float(compiler->vm, compiler->stack_track, 0.0));
 				break;
 			}
 
-			vm_push_cmd_assign(vm, stack_track, rregaddr);
+			typed(compiler, vm_push_cmd_assign(compiler->vm, compiler->stack_track, rregaddr));
 		}
+		free_temp(compiler, rregaddr);
 	}
 	;
 
@@ -660,7 +896,7 @@ assignment
 
 		size_t size;
 		if (!map_get (
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&lregaddr, &size
 		))
@@ -668,32 +904,30 @@ assignment
 			PRINT_ERROR("Identifier '%s' undeclared.", identifier);
 		}
 		else {
-			vm_push_cmd_assign(vm, lregaddr, rregaddr);
+			typed(compiler, vm_push_cmd_assign(compiler->vm, lregaddr, rregaddr));
 		}
+		free_temp(compiler, rregaddr);
 	}
 	;
 
 expression
 	: INT_LITERAL
 	{
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_set_int(vm, stack_track, $1);
-		$$ = stack_track;
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_set_int(compiler->vm, addr, $1));
+		$$ = addr;
 	}
 	| FLOAT_LITERAL
 	{
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_set_float(vm, stack_track, $1);
-		$$ = stack_track;
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_set_float(compiler->vm, addr, $1));
+		$$ = addr;
 	}
 	| HEX_LITERAL
 	{
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_set_int(vm, stack_track, $1);
-		$$ = stack_track;
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_set_int(compiler->vm, addr, $1));
+		$$ = addr;
 	}
 	| STRING_LITERAL
 	{
@@ -709,24 +943,32 @@ expression
 
 		size_t size;
 		if (!map_get (
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&addr, &size
 		))
 		{
 			PRINT_ERROR("Identifier '%s' undeclared.", identifier);
-			addr = null_addr;
+			addr = compiler->null_addr;
 		}
 
 		$$ = addr;
 	}
+	| IDENTIFIER '(' ')'
+	{
+		$$ = emit_call(compiler, $1, 0);
+	}
+	| IDENTIFIER '(' arguments ')'
+	{
+		$$ = emit_call(compiler, $1, $3);
+	}
 	| '-' expression
 	{
-		Addr addr = $2;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_sub(vm, 0, addr, stack_track);
-		$$ = stack_track;
+		Addr rvaladdr = $2;
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_sub(compiler->vm, 0, rvaladdr, addr));
+		$$ = addr;
 	}
 	| '(' expression ')'
 	{
@@ -736,37 +978,41 @@ expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_add(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_add(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '-' expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_sub(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_sub(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '*' expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_mult(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_mult(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '/' expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_div(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_div(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '%' expression
 	{
@@ -777,125 +1023,155 @@ expression
 		// bitwise and
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_and(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_and(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '|' expression
 	{
 		// bitwise or
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_or(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_or(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| '!' expression
 	{
 		// bitwise not
 		Addr rvaladdr = $2;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_not(vm, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_not(compiler->vm, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '^' expression
 	{
 		// bitwise xor
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_xor(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_xor(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression AND expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_and(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_and(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression OR expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_or(vm, lvaladdr, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_or(compiler->vm, lvaladdr, rvaladdr, addr));
+		$$ = addr;
 	}
 	| NOT expression
 	{
 		Addr rvaladdr = $2;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_not(vm, rvaladdr, stack_track);
-		$$ = stack_track;
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_not(compiler->vm, rvaladdr, addr));
+		$$ = addr;
 	}
 	| expression '<' expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_less(vm, lvaladdr, rvaladdr, stack_track);
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_less(compiler->vm, lvaladdr, rvaladdr, addr));
 
-		$$ = stack_track;
+		$$ = addr;
 	}
 	| expression '>' expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_greater(vm, lvaladdr, rvaladdr, stack_track);
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_greater(compiler->vm, lvaladdr, rvaladdr, addr));
 
-		$$ = stack_track;
+		$$ = addr;
 	}
 	| expression EQUAL expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_equal(vm, lvaladdr, rvaladdr, stack_track);
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_equal(compiler->vm, lvaladdr, rvaladdr, addr));
 
-		$$ = stack_track;
+		$$ = addr;
 	}
 	| expression NEQUAL expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_nequal(vm, lvaladdr, rvaladdr, stack_track);
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_nequal(compiler->vm, lvaladdr, rvaladdr, addr));
 
-		$$ = stack_track;
+		$$ = addr;
 	}
 	| expression LEQ expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_leq(vm, lvaladdr, rvaladdr, stack_track);
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_leq(compiler->vm, lvaladdr, rvaladdr, addr));
 
-		$$ = stack_track;
+		$$ = addr;
 	}
 	| expression GEQ expression
 	{
 		Addr lvaladdr = $1;
 		Addr rvaladdr = $3;
-		stack_track++;
-		vm_push_cmd_push(vm);
-		vm_push_cmd_geq(vm, lvaladdr, rvaladdr, stack_track);
+		free_temp(compiler, lvaladdr);
+		free_temp(compiler, rvaladdr);
+		Addr addr = alloc_temp(compiler);
+		typed(compiler, vm_push_cmd_geq(compiler->vm, lvaladdr, rvaladdr, addr));
 
-		$$ = stack_track;
+		$$ = addr;
+	}
+	;
+
+arguments
+	: expression
+	{
+		Addr addr = $1;
+		if (array_push(compiler->call_args, &addr) < 0) {
+			CRITICAL_ERROR("Call arguments push failed.");
+		}
+		$$ = 1;
+	}
+	| arguments ',' expression
+	{
+		Addr addr = $3;
+		if (array_push(compiler->call_args, &addr) < 0) {
+			CRITICAL_ERROR("Call arguments push failed.");
+		}
+		$$ = $1 + 1;
 	}
 	;
 
@@ -907,7 +1183,7 @@ command
 
 		size_t size;
 		if (!map_get (
-			variables,
+			compiler->variables,
 			identifier, strlen(identifier),
 			&addr, &size
 		))
@@ -915,109 +1191,130 @@ command
 			PRINT_ERROR("Identifier '%s' undeclared.", identifier);
 		}
 		else {
-			vm_push_cmd_print(vm, addr);
+			vm_push_cmd_print(compiler->vm, addr);
 		}
 	}
 	| DUMP
 	{
-		dump();
+		dump(compiler);
+	}
+	| YIELD
+	{
+		// let the scheduler run other machines. See vm_run_slice.
+		vm_push_cmd_yield(compiler->vm);
 	}
 	;
 
 vm_command
 	: STACK
 	{
-		vm_push_cmd_stack(vm);
+		vm_push_cmd_stack(compiler->vm);
 	}
 	| COMMANDS
 	{
-		vm_push_cmd_commands(vm);
+		vm_push_cmd_commands(compiler->vm);
 	}
 	| PRINT vm_command_int_param
 	{
-		vm_push_cmd_print(vm, $2);
+		vm_push_cmd_print(compiler->vm, $2);
 	}
 	| VM_SET_BYTE vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_set_byte(vm, $2, $3);
+		compiler->static_typing = false;
+		vm_push_cmd_set_byte(compiler->vm, $2, $3);
 	}
 	| VM_SET_INT vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_set_int(vm, $2, $3);
+		compiler->static_typing = false;
+		vm_push_cmd_set_int(compiler->vm, $2, $3);
 	}
 	| VM_SET_UINT vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_set_uint(vm, $2, $3);
+		compiler->static_typing = false;
+		vm_push_cmd_set_uint(compiler->vm, $2, $3);
 	}
 	| VM_SET_FLOAT vm_command_int_param vm_command_float_param
 	{
-		vm_push_cmd_set_float(vm, $2, $3);
+		compiler->static_typing = false;
+		vm_push_cmd_set_float(compiler->vm, $2, $3);
 	}
 	| VM_ADD vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_add(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_add(compiler->vm, $2, $3, $4);
 	}
 	| VM_SUB vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_sub(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_sub(compiler->vm, $2, $3, $4);
 	}
 	| VM_MULT vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_mult(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_mult(compiler->vm, $2, $3, $4);
 	}
 	| VM_DIV vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_div(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_div(compiler->vm, $2, $3, $4);
 	}
 	| VM_AND vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_and(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_and(compiler->vm, $2, $3, $4);
 	}
 	| VM_OR vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_or(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_or(compiler->vm, $2, $3, $4);
 	}
 	| VM_XOR vm_command_int_param vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_xor(vm, $2, $3, $4);
+		compiler->static_typing = false;
+		vm_push_cmd_xor(compiler->vm, $2, $3, $4);
 	}
 	| VM_NOT vm_command_int_param vm_command_int_param 
 	{
-		vm_push_cmd_not(vm, $2, $3);
+		compiler->static_typing = false;
+		vm_push_cmd_not(compiler->vm, $2, $3);
 	}
 	| VM_JUMP vm_command_int_param
 	{
-		vm_push_cmd_jump(vm, $2);
+		compiler->static_typing = false;
+		vm_push_cmd_jump(compiler->vm, $2);
 	}
 	| VM_JCOND vm_command_int_param vm_command_int_param
 	{
-		vm_push_cmd_jcond(vm, $2, $3);
+		compiler->static_typing = false;
+		vm_push_cmd_jcond(compiler->vm, $2, $3);
 	}
 	| VM_PUSH
 	{
-		vm_push_cmd_push(vm);
+		compiler->static_typing = false;
+		vm_push_cmd_push(compiler->vm);
 	}
 	| VM_POP
 	{
-		vm_push_cmd_pop(vm);
+		compiler->static_typing = false;
+		vm_push_cmd_pop(compiler->vm);
 	}
 	| VM_EXIT
 	{
-		vm_push_cmd_exit(vm);
+		vm_push_cmd_exit(compiler->vm);
 	}
 	| EXIT
 	{
-		if (interactive_mode)
-			exit_program(0);
+		if (compiler->interactive_mode)
+			exit_program(compiler, 0);
 		else
-			vm_push_cmd_exit(vm);
+			vm_push_cmd_exit(compiler->vm);
 	}
 	| QUIT
 	{
-		if (interactive_mode)
-			exit_program(0);
+		if (compiler->interactive_mode)
+			exit_program(compiler, 0);
 		else
-			vm_push_cmd_exit(vm);
+			vm_push_cmd_exit(compiler->vm);
 	}
 	;
 
@@ -1047,14 +1344,19 @@ type
 	;
 
 boolean
-	: TRUE { $$ = 1; }
+	: TRUE
+	{
+		// the value at address 1 depends on the program, so its type is not known.
+		set_slot_type(compiler, 1, 0);
+		$$ = 1;
+	}
 	| FALSE { $$ = 0; }
 	;
 
 end_sentence
 	: NEWLINE
 	{
-		line_count++;
+		compiler->line_count++;
 	}
 	| ';'
 	;
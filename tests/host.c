@@ -0,0 +1,78 @@
+/*
+ * Runs a script through the host API (see host.h), as a C program linked with liblanguage.a does.
+ *
+ *     tests/host SCRIPT
+ *
+ * The script is compiled with host_compile and run twice in one context, put back to its start
+ * with vm_restart in between, and only the second run writes its output. So the output is the
+ * same as the program's only if a restarted context runs as a new one does.
+ */
+#include "host.h"
+#include <stdlib.h>
+
+static char *host_read(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return NULL;
+	char *source = NULL;
+	if (fseek(file, 0, SEEK_END) != 0)
+		goto host_read_end;
+	long length = ftell(file);
+	if (length < 0 || fseek(file, 0, SEEK_SET) != 0)
+		goto host_read_end;
+	source = (char *) malloc(length + 1);
+	if (source == NULL)
+		goto host_read_end;
+	if (fread(source, 1, length, file) != (size_t) length) {
+		free(source);
+		source = NULL;
+		goto host_read_end;
+	}
+	source[length] = '\0';
+	*size = length;
+
+host_read_end:
+	fclose(file);
+	return source;
+}
+
+int main(int argc, char **argv) {
+	if (argc != 2) {
+		fprintf(stderr, "Usage: %s SCRIPT\n", argv[0]);
+		return 2;
+	}
+	size_t size = 0;
+	char *source = host_read(argv[1], &size);
+	if (source == NULL) {
+		fprintf(stderr, "Could not read %s.\n", argv[1]);
+		return 1;
+	}
+	HostScript *script = host_compile(source, size, NULL, 0, NULL, stderr);
+	free(source);
+	if (script == NULL)
+		return 1;
+	VM *vm = host_context(script);
+	if (vm == NULL) {
+		host_delete(script);
+		return 1;
+	}
+
+	FILE *null = fopen("/dev/null", "w");
+	if (null == NULL) {
+		vm_delete(vm);
+		host_delete(script);
+		return 1;
+	}
+	vm->out = null;
+	int status = vm_run(vm);
+	vm->out = stdout;
+	if (status == VM_FINISHED && vm_restart(vm) == 0)
+		status = vm_run(vm);
+	if (status == VM_FAILED)
+		printf("%s Exiting with status -1.\n", vm_failure(vm));
+
+	fclose(null);
+	vm_delete(vm);
+	host_delete(script);
+	return status == VM_FINISHED ? 0 : 1;
+}
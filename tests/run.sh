@@ -0,0 +1,62 @@
+#!/bin/sh
+# Run a script with ./program and the options given, and write only what the script printed:
+# the lines between "Now running." and "Good bye.".
+#
+#     tests/run.sh SCRIPT [--image | --emit-c | --daemon | --host] [OPTION...]
+#
+# With --image the script is written to an image by --compile and the image is run. With --emit-c
+# the script is translated to C, built and run. With --daemon a daemon of one worker is started
+# and ./client sends it the source, then the image: only the second run is written, the one on the
+# machine the first left behind. With --host the script is run by tests/host, through the host
+# API, and the options are not used.
+
+script=$1
+shift
+mode=$1
+case $mode in
+--image|--emit-c|--daemon|--host)
+	shift
+	;;
+*)
+	mode=
+	;;
+esac
+
+output() {
+	sed -e '/^Now running\.$/,$!d' -e '/^Now running\.$/d' -e '/^Good bye\.$/d'
+}
+
+work=$(mktemp -d)
+daemon=
+trap '[ -n "$daemon" ] && kill $daemon; rm -rf "$work"' EXIT
+
+case $mode in
+--image)
+	./program "$@" --compile "$work/image" "$script" > "$work/compile.out" 2>&1 || { cat "$work/compile.out"; exit 1; }
+	./program "$@" --image "$work/image" 2>&1 | output
+	;;
+--emit-c)
+	./program "$@" --emit-c "$work/program.c" "$script" > "$work/compile.out" 2>&1 || { cat "$work/compile.out"; exit 1; }
+	cc -O1 -I. -o "$work/program" "$work/program.c" -lm 2>&1 || exit 1
+	"$work/program" 2>&1
+	;;
+--daemon)
+	./program "$@" --compile "$work/image" "$script" > "$work/compile.out" 2>&1 || { cat "$work/compile.out"; exit 1; }
+	./program "$@" --workers=1 --daemon "$work/socket" > "$work/daemon.out" 2>&1 &
+	daemon=$!
+	tries=0
+	while ! grep -q '^Listening on' "$work/daemon.out"; do
+		tries=$((tries + 1))
+		[ $tries -gt 50 ] && { cat "$work/daemon.out"; exit 1; }
+		sleep 0.1
+	done
+	./client "$work/socket" "$script" > /dev/null 2>&1
+	./client "$work/socket" --image "$work/image" 2>&1 | output
+	;;
+--host)
+	tests/host "$script" 2>&1
+	;;
+*)
+	./program "$@" "$script" 2>&1 | output
+	;;
+esac
@@ -1,58 +1,1124 @@
 #include "vm.h"
+#include "vm_ops.h"
+#include "jit.h"
+#include "native.h"
 #include <stdio.h>
+#include <limits.h>
+
+Program *program_new() {
+	Program *program = NULL;
+	Array *commands = NULL;
+	Array *operands = NULL;
+	Array *constants = NULL;
+
+	program = (Program*) malloc(sizeof(Program));
+	if (program == NULL)
+		goto program_new_fail;
+	commands = array_new(sizeof(Byte), 0);
+	if (commands == NULL)
+		goto program_new_fail;
+	operands = array_new(sizeof(Operands), 0);
+	if (operands == NULL)
+		goto program_new_fail;
+	constants = array_new(sizeof(Constant), 0);
+	if (constants == NULL)
+		goto program_new_fail;
+
+	program->commands = commands;
+	program->operands = operands;
+	program->constants = constants;
+	program->stack = NULL;
+#ifdef VM_SOA_STACK
+	program->types = NULL;
+#endif
+#ifdef VM_NAN_BOXING
+	program->wide = NULL;
+#endif
+	program->natives = native_builtins();
+	program->cmd_ptr = 0;
+	program->shared = 0;
+	return program;
+
+program_new_fail:
+	if (program != NULL)
+		free(program);
+	if (commands != NULL)
+		array_delete(commands);
+	if (operands != NULL)
+		array_delete(operands);
+	if (constants != NULL)
+		array_delete(constants);
+	return NULL;
+}
+
+void program_delete(Program *program) {
+	array_delete(program->commands);
+	array_delete(program->operands);
+	array_delete(program->constants);
+	if (program->stack != NULL)
+		array_delete(program->stack);
+#ifdef VM_SOA_STACK
+	if (program->types != NULL)
+		array_delete(program->types);
+#endif
+#ifdef VM_NAN_BOXING
+	if (program->wide != NULL)
+		array_delete(program->wide);
+#endif
+	free(program);
+}
 
 VM *vm_new() {
 	VM *vm = NULL;
-	Array *commands = NULL;
+	Program *program = NULL;
 	Array *stack = NULL;
+#ifdef VM_SOA_STACK
+	Array *types = NULL;
+#endif
+#ifdef VM_NAN_BOXING
+	Array *wide = NULL;
+#endif
 	
 	vm = (VM*) malloc(sizeof(VM));
 	if (vm == NULL)
 	   	goto vm_new_fail;
-	commands = array_new(sizeof(Command), 0);
-	if (commands == NULL)
+	program = program_new();
+	if (program == NULL)
+		goto vm_new_fail;
+#ifdef VM_SOA_STACK
+	stack = array_new(sizeof(Value), 0);
+	if (stack == NULL)
+		goto vm_new_fail;
+	types = array_new(sizeof(Byte), 0);
+	if (types == NULL)
+		goto vm_new_fail;
+	vm->types = types;
+#elif defined(VM_NAN_BOXING)
+	stack = array_new(sizeof(uint64_t), 0);
+	if (stack == NULL)
 		goto vm_new_fail;
+	wide = array_new(sizeof(uint64_t), 0);
+	if (wide == NULL)
+		goto vm_new_fail;
+	vm->wide = wide;
+#else
 	stack = array_new(sizeof(Register), 0);
 	if (stack == NULL)
 		goto vm_new_fail;
+#endif
 
-	vm->commands = commands;
+	vm->program = program;
 	vm->stack = stack;
 	vm->cmd_ptr = 0;
+	vm->engine = ENGINE_THREADED;
+	vm->quicken = 0;
+	vm->jit = 0;
+	vm->jit_state = NULL;
+	vm->out = stdout;
+	vm->owns_program = 1;
+	vm->context = 0;
 	return vm;
 
 vm_new_fail:
 	if (vm != NULL) 
 		free(vm);
-	if (commands != NULL)
-		array_delete(commands);
+	if (program != NULL)
+		program_delete(program);
 	if (stack != NULL)
 		array_delete(stack);
+#ifdef VM_SOA_STACK
+	if (types != NULL)
+		array_delete(types);
+#endif
+#ifdef VM_NAN_BOXING
+	if (wide != NULL)
+		array_delete(wide);
+#endif
 	return NULL;
 }
 
 void vm_delete(VM *vm) {
-	array_delete(vm->commands);
+	if (vm->owns_program)
+		program_delete(vm->program);
+	if (vm->jit_state != NULL)
+		jit_delete(vm->jit_state);
+	if (vm->context) {
+		// the arrays and their first heaps are in the block of the machine.
+		array_release(vm->stack);
+#ifdef VM_SOA_STACK
+		array_release(vm->types);
+#endif
+#ifdef VM_NAN_BOXING
+		array_release(vm->wide);
+#endif
+		free(vm);
+		return;
+	}
 	array_delete(vm->stack);
+#ifdef VM_SOA_STACK
+	array_delete(vm->types);
+#endif
+#ifdef VM_NAN_BOXING
+	array_delete(vm->wide);
+#endif
 	free(vm);
 }
 
+static Byte vm_quick_code(Byte code, Byte type);
+static int vm_resize_stack(VM *vm, size_t length);
+
+// A copy of the elements of array in use.
+static Array *vm_array_copy(Array *array) {
+	Array *copy = array_new(array->data_size, array->length);
+	if (copy != NULL)
+		memcpy(copy->heap, array->heap, array->length * array->data_size);
+	return copy;
+}
+
+Program *vm_take_program(VM *vm) {
+	Program *program = vm->program;
+	Array *stack = NULL;
+#ifdef VM_SOA_STACK
+	Array *types = NULL;
+#endif
+#ifdef VM_NAN_BOXING
+	Array *wide = NULL;
+#endif
+
+	if (!vm->owns_program)
+		goto vm_take_program_fail;
+	stack = vm_array_copy(vm->stack);
+	if (stack == NULL)
+		goto vm_take_program_fail;
+#ifdef VM_SOA_STACK
+	types = vm_array_copy(vm->types);
+	if (types == NULL)
+		goto vm_take_program_fail;
+#endif
+#ifdef VM_NAN_BOXING
+	wide = vm_array_copy(vm->wide);
+	if (wide == NULL)
+		goto vm_take_program_fail;
+#endif
+
+	// quickened commands are rewritten as they run; put them back to their generic commands.
+	Byte *codes = (Byte *) program->commands->heap;
+	for (size_t i = 0; i < program->commands->length; i++) {
+		Byte generic = vm_generic_code(codes[i]);
+		if (codes[i] == vm_quick_code(generic, TYPE_INT) || codes[i] == vm_quick_code(generic, TYPE_FLOAT))
+			codes[i] = generic;
+	}
+	if (vm->jit_state != NULL)
+		jit_reset(vm->jit_state);
+
+	program->stack = stack;
+#ifdef VM_SOA_STACK
+	program->types = types;
+#endif
+#ifdef VM_NAN_BOXING
+	program->wide = wide;
+#endif
+	program->cmd_ptr = vm->cmd_ptr;
+	program->shared = 1;
+	vm->owns_program = 0;
+	vm->quicken = 0;
+	return program;
+
+vm_take_program_fail:
+	if (stack != NULL)
+		array_delete(stack);
+#ifdef VM_SOA_STACK
+	if (types != NULL)
+		array_delete(types);
+#endif
+#ifdef VM_NAN_BOXING
+	if (wide != NULL)
+		array_delete(wide);
+#endif
+	return NULL;
+}
+
+VM *vm_new_context(Program *program) {
+	if (program->stack == NULL)
+		return NULL;
+
+	// The machine, its arrays and the heaps of the arrays, in one block.
+	size_t length = program->stack->length;
+	size_t capacity = length + VM_CONTEXT_STACK;
+	size_t stack_size = capacity * program->stack->data_size;
+	size_t size = sizeof(VM) + 2 * sizeof(Array) + stack_size;
+#ifdef VM_SOA_STACK
+	size += capacity * program->types->data_size;
+#endif
+#ifdef VM_NAN_BOXING
+	size += capacity * program->wide->data_size;
+#endif
+	Byte *block = (Byte *) malloc(size);
+	if (block == NULL)
+		return NULL;
+
+	VM *vm = (VM *) block;
+	Array *arrays = (Array *) (block + sizeof(VM));
+	Byte *heap = block + sizeof(VM) + 2 * sizeof(Array);
+
+	vm->stack = &arrays[0];
+	array_init_view(vm->stack, heap, program->stack->data_size, length, capacity);
+	memcpy(heap, program->stack->heap, length * program->stack->data_size);
+#ifdef VM_SOA_STACK
+	vm->types = &arrays[1];
+	array_init_view(vm->types, heap + stack_size, program->types->data_size, length, capacity);
+	memcpy(heap + stack_size, program->types->heap, length * program->types->data_size);
+#endif
+#ifdef VM_NAN_BOXING
+	vm->wide = &arrays[1];
+	array_init_view(vm->wide, heap + stack_size, program->wide->data_size, length, capacity);
+	memcpy(heap + stack_size, program->wide->heap, length * program->wide->data_size);
+#endif
+
+	vm->program = program;
+	vm->cmd_ptr = program->cmd_ptr;
+	vm->engine = ENGINE_THREADED;
+	vm->quicken = 0;
+	vm->jit = 0;
+	vm->jit_state = NULL;
+	vm->out = stdout;
+	vm->owns_program = 0;
+	vm->context = 1;
+	return vm;
+}
+
+/*
+ * Apply an operation of vm_ops.h to registers of the stack: the result register first, then the
+ * operands. With the default layout it works on the stack in place. With a packed layout the
+ * registers are loaded, and the result, which starts as the old register, is stored back.
+ */
+#ifndef VM_REGISTER_STACK
+#define VM_APPLY_UNARY(op, vm, raddr, addr) {									\
+	Register operand = vm_load(vm, addr);										\
+	Register result = vm_load(vm, raddr);										\
+	op(&result, &operand);														\
+	vm_store(vm, raddr, result);												\
+}
+#define VM_APPLY_BINARY(op, vm, raddr, lval_addr, rval_addr) {					\
+	Register lval = vm_load(vm, lval_addr);										\
+	Register rval = vm_load(vm, rval_addr);										\
+	Register result = vm_load(vm, raddr);										\
+	op(&result, &lval, &rval);													\
+	vm_store(vm, raddr, result);												\
+}
+#else
+#define VM_APPLY_UNARY(op, vm, raddr, addr) op(vm_slot(vm, raddr), vm_slot(vm, addr))
+#define VM_APPLY_BINARY(op, vm, raddr, lval_addr, rval_addr) op(vm_slot(vm, raddr), vm_slot(vm, lval_addr), vm_slot(vm, rval_addr))
+#endif
+
+/*
+ * Quickened operations. Each one checks that both operands have the type it was specialized for
+ * and, if so, writes the result straight to the stack and returns 1. Otherwise it returns 0 and
+ * the caller falls back to the generic operation.
+ */
+#define VM_QUICK_OP(name, kind, c_type, op)										\
+static inline int name(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {	\
+	c_type lval, rval;															\
+	if (!vm_load_##kind(vm, lval_addr, &lval) || !vm_load_##kind(vm, rval_addr, &rval))	\
+		return 0;																\
+	vm_store_##kind(vm, raddr, lval op rval);									\
+	return 1;																	\
+}
+
+VM_QUICK_OP(vm_add_int_int, int, Int, +)
+VM_QUICK_OP(vm_add_float_float, float, Float, +)
+VM_QUICK_OP(vm_sub_int_int, int, Int, -)
+VM_QUICK_OP(vm_sub_float_float, float, Float, -)
+VM_QUICK_OP(vm_mult_int_int, int, Int, *)
+VM_QUICK_OP(vm_mult_float_float, float, Float, *)
+VM_QUICK_OP(vm_div_int_int, int, Int, /)
+VM_QUICK_OP(vm_div_float_float, float, Float, /)
+VM_QUICK_OP(vm_greater_int_int, int, Int, >)
+VM_QUICK_OP(vm_greater_float_float, float, Float, >)
+VM_QUICK_OP(vm_less_int_int, int, Int, <)
+VM_QUICK_OP(vm_less_float_float, float, Float, <)
+VM_QUICK_OP(vm_equal_int_int, int, Int, ==)
+VM_QUICK_OP(vm_equal_float_float, float, Float, ==)
+VM_QUICK_OP(vm_nequal_int_int, int, Int, !=)
+VM_QUICK_OP(vm_nequal_float_float, float, Float, !=)
+VM_QUICK_OP(vm_geq_int_int, int, Int, >=)
+VM_QUICK_OP(vm_geq_float_float, float, Float, >=)
+VM_QUICK_OP(vm_leq_int_int, int, Int, <=)
+VM_QUICK_OP(vm_leq_float_float, float, Float, <=)
+
+/*
+ * Typed operations. The compiler only emits a typed command when it knows the types of the
+ * operands, so they are not checked.
+ */
+#define VM_TYPED_OP(name, kind, c_type, op)										\
+static inline void name(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {	\
+	c_type lval = 0, rval = 0;													\
+	vm_load_##kind(vm, lval_addr, &lval);										\
+	vm_load_##kind(vm, rval_addr, &rval);										\
+	vm_store_##kind(vm, raddr, lval op rval);									\
+}
+
+#define VM_TYPED_TEST(name, kind, c_type, op)									\
+static inline int name(VM *vm, Addr lval_addr, Addr rval_addr) {				\
+	c_type lval = 0, rval = 0;													\
+	vm_load_##kind(vm, lval_addr, &lval);										\
+	vm_load_##kind(vm, rval_addr, &rval);										\
+	return lval op rval;														\
+}
+
+#define VM_TYPED_ASSIGN(name, kind, c_type, rval_kind, rval_c_type)				\
+static inline void name(VM *vm, Addr lval_addr, Addr rval_addr) {				\
+	rval_c_type rval = 0;														\
+	vm_load_##rval_kind(vm, rval_addr, &rval);									\
+	vm_store_##kind(vm, lval_addr, (c_type) rval);								\
+}
+
+VM_TYPED_OP(vm_add_int, int, Int, +)
+VM_TYPED_OP(vm_add_float, float, Float, +)
+VM_TYPED_OP(vm_sub_int, int, Int, -)
+VM_TYPED_OP(vm_sub_float, float, Float, -)
+VM_TYPED_OP(vm_mult_int, int, Int, *)
+VM_TYPED_OP(vm_mult_float, float, Float, *)
+VM_TYPED_OP(vm_div_int, int, Int, /)
+VM_TYPED_OP(vm_div_float, float, Float, /)
+VM_TYPED_OP(vm_greater_int, int, Int, >)
+VM_TYPED_OP(vm_greater_float, float, Float, >)
+VM_TYPED_OP(vm_less_int, int, Int, <)
+VM_TYPED_OP(vm_less_float, float, Float, <)
+VM_TYPED_OP(vm_equal_int, int, Int, ==)
+VM_TYPED_OP(vm_equal_float, float, Float, ==)
+VM_TYPED_OP(vm_nequal_int, int, Int, !=)
+VM_TYPED_OP(vm_nequal_float, float, Float, !=)
+VM_TYPED_OP(vm_geq_int, int, Int, >=)
+VM_TYPED_OP(vm_geq_float, float, Float, >=)
+VM_TYPED_OP(vm_leq_int, int, Int, <=)
+VM_TYPED_OP(vm_leq_float, float, Float, <=)
+
+VM_TYPED_TEST(vm_test_greater_int, int, Int, >)
+VM_TYPED_TEST(vm_test_greater_float, float, Float, >)
+VM_TYPED_TEST(vm_test_less_int, int, Int, <)
+VM_TYPED_TEST(vm_test_less_float, float, Float, <)
+VM_TYPED_TEST(vm_test_equal_int, int, Int, ==)
+VM_TYPED_TEST(vm_test_equal_float, float, Float, ==)
+VM_TYPED_TEST(vm_test_nequal_int, int, Int, !=)
+VM_TYPED_TEST(vm_test_nequal_float, float, Float, !=)
+VM_TYPED_TEST(vm_test_geq_int, int, Int, >=)
+VM_TYPED_TEST(vm_test_geq_float, float, Float, >=)
+VM_TYPED_TEST(vm_test_leq_int, int, Int, <=)
+VM_TYPED_TEST(vm_test_leq_float, float, Float, <=)
+
+VM_TYPED_ASSIGN(vm_assign_int, int, Int, int, Int)
+VM_TYPED_ASSIGN(vm_assign_float, float, Float, float, Float)
+VM_TYPED_ASSIGN(vm_assign_int_from_float, int, Int, float, Float)
+VM_TYPED_ASSIGN(vm_assign_float_from_int, float, Float, int, Int)
+
+// Quickened variant of a generic command for operands of the given type, or 0 if there is none.
+static Byte vm_quick_code(Byte code, Byte type) {
+	if (type != TYPE_INT && type != TYPE_FLOAT)
+		return 0;
+	switch (code) {
+	case CMD_ADD: return type == TYPE_INT ? CMD_ADD_INT_INT : CMD_ADD_FLOAT_FLOAT;
+	case CMD_SUB: return type == TYPE_INT ? CMD_SUB_INT_INT : CMD_SUB_FLOAT_FLOAT;
+	case CMD_MULT: return type == TYPE_INT ? CMD_MULT_INT_INT : CMD_MULT_FLOAT_FLOAT;
+	case CMD_DIV: return type == TYPE_INT ? CMD_DIV_INT_INT : CMD_DIV_FLOAT_FLOAT;
+	case CMD_GREATER: return type == TYPE_INT ? CMD_GREATER_INT_INT : CMD_GREATER_FLOAT_FLOAT;
+	case CMD_LESS: return type == TYPE_INT ? CMD_LESS_INT_INT : CMD_LESS_FLOAT_FLOAT;
+	case CMD_EQUAL: return type == TYPE_INT ? CMD_EQUAL_INT_INT : CMD_EQUAL_FLOAT_FLOAT;
+	case CMD_NEQUAL: return type == TYPE_INT ? CMD_NEQUAL_INT_INT : CMD_NEQUAL_FLOAT_FLOAT;
+	case CMD_GEQ: return type == TYPE_INT ? CMD_GEQ_INT_INT : CMD_GEQ_FLOAT_FLOAT;
+	case CMD_LEQ: return type == TYPE_INT ? CMD_LEQ_INT_INT : CMD_LEQ_FLOAT_FLOAT;
+	default: return 0;
+	}
+}
+
+// Generic command of a quickened or typed command. Other commands are returned unchanged.
+Byte vm_generic_code(Byte code) {
+	switch (code) {
+	case CMD_ADD_INT_INT:
+	case CMD_ADD_FLOAT_FLOAT:
+	case CMD_ADD_INT:
+	case CMD_ADD_FLOAT:
+		return CMD_ADD;
+	case CMD_SUB_INT_INT:
+	case CMD_SUB_FLOAT_FLOAT:
+	case CMD_SUB_INT:
+	case CMD_SUB_FLOAT:
+		return CMD_SUB;
+	case CMD_MULT_INT_INT:
+	case CMD_MULT_FLOAT_FLOAT:
+	case CMD_MULT_INT:
+	case CMD_MULT_FLOAT:
+		return CMD_MULT;
+	case CMD_DIV_INT_INT:
+	case CMD_DIV_FLOAT_FLOAT:
+	case CMD_DIV_INT:
+	case CMD_DIV_FLOAT:
+		return CMD_DIV;
+	case CMD_GREATER_INT_INT:
+	case CMD_GREATER_FLOAT_FLOAT:
+	case CMD_GREATER_INT:
+	case CMD_GREATER_FLOAT:
+		return CMD_GREATER;
+	case CMD_LESS_INT_INT:
+	case CMD_LESS_FLOAT_FLOAT:
+	case CMD_LESS_INT:
+	case CMD_LESS_FLOAT:
+		return CMD_LESS;
+	case CMD_EQUAL_INT_INT:
+	case CMD_EQUAL_FLOAT_FLOAT:
+	case CMD_EQUAL_INT:
+	case CMD_EQUAL_FLOAT:
+		return CMD_EQUAL;
+	case CMD_NEQUAL_INT_INT:
+	case CMD_NEQUAL_FLOAT_FLOAT:
+	case CMD_NEQUAL_INT:
+	case CMD_NEQUAL_FLOAT:
+		return CMD_NEQUAL;
+	case CMD_GEQ_INT_INT:
+	case CMD_GEQ_FLOAT_FLOAT:
+	case CMD_GEQ_INT:
+	case CMD_GEQ_FLOAT:
+		return CMD_GEQ;
+	case CMD_LEQ_INT_INT:
+	case CMD_LEQ_FLOAT_FLOAT:
+	case CMD_LEQ_INT:
+	case CMD_LEQ_FLOAT:
+		return CMD_LEQ;
+	case CMD_JNOT_GREATER_INT:
+	case CMD_JNOT_GREATER_FLOAT:
+		return CMD_JNOT_GREATER;
+	case CMD_JNOT_LESS_INT:
+	case CMD_JNOT_LESS_FLOAT:
+		return CMD_JNOT_LESS;
+	case CMD_JNOT_EQUAL_INT:
+	case CMD_JNOT_EQUAL_FLOAT:
+		return CMD_JNOT_EQUAL;
+	case CMD_JNOT_NEQUAL_INT:
+	case CMD_JNOT_NEQUAL_FLOAT:
+		return CMD_JNOT_NEQUAL;
+	case CMD_JNOT_GEQ_INT:
+	case CMD_JNOT_GEQ_FLOAT:
+		return CMD_JNOT_GEQ;
+	case CMD_JNOT_LEQ_INT:
+	case CMD_JNOT_LEQ_FLOAT:
+		return CMD_JNOT_LEQ;
+	case CMD_ASSIGN_INT:
+	case CMD_ASSIGN_FLOAT:
+	case CMD_ASSIGN_INT_FROM_FLOAT:
+	case CMD_ASSIGN_FLOAT_FROM_INT:
+		return CMD_ASSIGN;
+	default:
+		return code;
+	}
+}
+
+// Typed variant of a generic command for operands of the given types, or 0 if there is none.
+Byte vm_typed_code(Byte code, Byte ltype, Byte rtype) {
+	if ((ltype != TYPE_INT && ltype != TYPE_FLOAT) || (rtype != TYPE_INT && rtype != TYPE_FLOAT))
+		return 0;
+	if (code == CMD_ASSIGN) {
+		if (ltype == TYPE_INT)
+			return rtype == TYPE_INT ? CMD_ASSIGN_INT : CMD_ASSIGN_INT_FROM_FLOAT;
+		return rtype == TYPE_FLOAT ? CMD_ASSIGN_FLOAT : CMD_ASSIGN_FLOAT_FROM_INT;
+	}
+	if (ltype != rtype)
+		return 0;
+	switch (code) {
+	case CMD_ADD: return ltype == TYPE_INT ? CMD_ADD_INT : CMD_ADD_FLOAT;
+	case CMD_SUB: return ltype == TYPE_INT ? CMD_SUB_INT : CMD_SUB_FLOAT;
+	case CMD_MULT: return ltype == TYPE_INT ? CMD_MULT_INT : CMD_MULT_FLOAT;
+	case CMD_DIV: return ltype == TYPE_INT ? CMD_DIV_INT : CMD_DIV_FLOAT;
+	case CMD_GREATER: return ltype == TYPE_INT ? CMD_GREATER_INT : CMD_GREATER_FLOAT;
+	case CMD_LESS: return ltype == TYPE_INT ? CMD_LESS_INT : CMD_LESS_FLOAT;
+	case CMD_EQUAL: return ltype == TYPE_INT ? CMD_EQUAL_INT : CMD_EQUAL_FLOAT;
+	case CMD_NEQUAL: return ltype == TYPE_INT ? CMD_NEQUAL_INT : CMD_NEQUAL_FLOAT;
+	case CMD_GEQ: return ltype == TYPE_INT ? CMD_GEQ_INT : CMD_GEQ_FLOAT;
+	case CMD_LEQ: return ltype == TYPE_INT ? CMD_LEQ_INT : CMD_LEQ_FLOAT;
+	case CMD_JNOT_GREATER: return ltype == TYPE_INT ? CMD_JNOT_GREATER_INT : CMD_JNOT_GREATER_FLOAT;
+	case CMD_JNOT_LESS: return ltype == TYPE_INT ? CMD_JNOT_LESS_INT : CMD_JNOT_LESS_FLOAT;
+	case CMD_JNOT_EQUAL: return ltype == TYPE_INT ? CMD_JNOT_EQUAL_INT : CMD_JNOT_EQUAL_FLOAT;
+	case CMD_JNOT_NEQUAL: return ltype == TYPE_INT ? CMD_JNOT_NEQUAL_INT : CMD_JNOT_NEQUAL_FLOAT;
+	case CMD_JNOT_GEQ: return ltype == TYPE_INT ? CMD_JNOT_GEQ_INT : CMD_JNOT_GEQ_FLOAT;
+	case CMD_JNOT_LEQ: return ltype == TYPE_INT ? CMD_JNOT_LEQ_INT : CMD_JNOT_LEQ_FLOAT;
+	default: return 0;
+	}
+}
+
+/*
+ * Rewrite the command at index to the variant that matches the current types of its operands:
+ * a quickened command if there is one, otherwise the generic command.
+ * Return 1 if the command was changed.
+ */
+Byte vm_quicken(VM *vm, Addr index) {
+	Byte *cmd_code = (Byte *) vm->program->commands->heap + index;
+	Operands *cmd = (Operands *) vm->program->operands->heap + index;
+	Byte generic = vm_generic_code(*cmd_code);
+	if (vm_quick_code(generic, TYPE_INT) == 0)
+		return 0;
+
+	Byte ltype = vm_load(vm, cmd->addr).type;
+	Byte rtype = vm_load(vm, cmd->arg).type;
+	Byte code = ltype == rtype ? vm_quick_code(generic, ltype) : 0;
+	if (code == 0)
+		code = generic;
+	if (code == *cmd_code)
+		return 0;
+	*cmd_code = code;
+	return 1;
+}
+
+static int vm_switch(VM *vm, long budget, int yields);
+static int vm_threaded(VM *vm, long budget, int yields);
+
+// Run about budget commands, or without a limit if budget is negative, stopping after a yield
+// command if yields is true. Return a VMStatus.
+static int vm_run_budget(VM *vm, long budget, int yields) {
+	// a shared program is run by other machines at the same time and is not rewritten.
+	if (vm->program->shared)
+		vm->quicken = 0;
+	switch (vm->engine) {
+	case ENGINE_SWITCH:
+		return vm_switch(vm, budget, yields);
+	case ENGINE_THREADED:
+	default:
+		return vm_threaded(vm, budget, yields);
+	}
+}
+
 int vm_run(VM *vm) {
-	while (vm->cmd_ptr < vm->commands->length) {
-		Command cmd;
-		array_get(vm->commands, vm->cmd_ptr, &cmd);
-		vm_execute(vm, cmd);
+	return vm_run_budget(vm, -1, 0);
+}
+
+int vm_resume(VM *vm) {
+	return vm_run_budget(vm, -1, 1);
+}
+
+int vm_run_slice(VM *vm, long budget) {
+	if (budget <= 0)
+		return vm->cmd_ptr < vm->program->commands->length ? VM_EXHAUSTED : VM_FINISHED;
+	return vm_run_budget(vm, budget, 1);
+}
+
+const char *vm_failure(VM *vm) {
+	Byte code = 0;
+	if (vm->cmd_ptr >= 0 && vm->cmd_ptr < vm->program->commands->length)
+		code = ((Byte *) vm->program->commands->heap)[vm->cmd_ptr];
+	if (code == CMD_LEAVE)
+		return "The stack was too short for the frame to leave.";
+	return "The stack could not grow.";
+}
+
+int vm_run_switch(VM *vm) {
+	return vm_switch(vm, -1, 0);
+}
+
+int vm_run_threaded(VM *vm) {
+	return vm_threaded(vm, -1, 0);
+}
+
+static int vm_switch(VM *vm, long budget, int yields) {
+	while (vm->cmd_ptr < vm->program->commands->length) {
+		if (budget-- == 0)
+			return VM_EXHAUSTED;
+		if (vm->quicken)
+			vm_quicken(vm, vm->cmd_ptr);
+		Command cmd = vm_get_cmd(vm, vm->cmd_ptr);
+		// a frame that cannot be entered or left, or a push the stack has no room for, stops the
+		// machine at it.
+		if (vm_execute(vm, cmd) < 0 && (cmd.code == CMD_ENTER || cmd.code == CMD_LEAVE || cmd.code == CMD_PUSH))
+			return VM_FAILED;
 		vm->cmd_ptr++;
+		if (cmd.code == CMD_YIELD && yields)
+			return VM_YIELDED;
 	}
-	return 0;
+	return VM_FINISHED;
+}
+
+/*
+ * Threaded engine. Commands are read in place from the code and operand arrays and the program
+ * counter is kept in a local, so there is no per-command copy and no return to a central loop.
+ * With GCC or Clang each handler jumps straight to the next one through a table of label
+ * addresses (computed goto). Elsewhere, or when compiled with VM_NO_COMPUTED_GOTO, the same
+ * handlers are cases of a switch inside a loop.
+ */
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(VM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO
+#endif
+
+#ifdef VM_COMPUTED_GOTO
+#define VM_CASE(code) op_##code:
+#define VM_CASE_DEFAULT op_default:
+#define VM_DISPATCH() { if (pc >= length) goto vm_run_end; cmd = operands + pc; goto *dispatch_table[codes[pc]]; }
+#else
+#define VM_CASE(code) case code:
+#define VM_CASE_DEFAULT default:
+#define VM_DISPATCH() continue
+#endif
+
+#define VM_NEXT() { pc++; VM_DISPATCH(); }
+// A jump pays for the commands run since the last one: between jumps the commands only go forward,
+// so checking the budget here bounds a slice without a check on every dispatch.
+#define VM_JUMP(target) {											\
+		budget -= pc - mark + 1;										\
+		pc = mark = (target);											\
+		if (budget <= 0 && pc < length)									\
+			goto vm_run_exhausted;										\
+		VM_DISPATCH();													\
+	}
+
+// A fused compare-and-branch tests int and float pairs inline and everything else with vm_test.
+#define VM_JNOT_CASE(code, relation, op)								\
+	VM_CASE(code)														\
+		{																\
+		Int lint, rint;													\
+		Float lfloat, rfloat;											\
+		int holds;														\
+		if (vm_load_int(vm, cmd->addr, &lint) && vm_load_int(vm, cmd->arg, &rint))	\
+			holds = lint op rint;										\
+		else if (vm_load_float(vm, cmd->addr, &lfloat) && vm_load_float(vm, cmd->arg, &rfloat))	\
+			holds = lfloat op rfloat;									\
+		else {															\
+			Register lval = vm_load(vm, cmd->addr);						\
+			Register rval = vm_load(vm, cmd->arg);						\
+			holds = vm_test(relation, &lval, &rval);					\
+		}																\
+		if (holds)														\
+			VM_NEXT();													\
+		VM_JUMP(cmd->raddr);											\
+		}
+
+// A quickened command runs its fast path, or is rewritten to match its operands and dispatched again.
+#define VM_QUICK_CASE(code, fn)										\
+	VM_CASE(code)													\
+		if (fn(vm, cmd->addr, cmd->arg, cmd->raddr))			\
+			VM_NEXT();												\
+		vm_quicken(vm, pc);											\
+		VM_DISPATCH();
+
+// A typed command runs without checking the types of its operands.
+#define VM_TYPED_CASE(code, fn)										\
+	VM_CASE(code)													\
+		fn(vm, cmd->addr, cmd->arg, cmd->raddr);					\
+		VM_NEXT();
+
+#define VM_TYPED_JNOT_CASE(code, fn)								\
+	VM_CASE(code)													\
+		if (fn(vm, cmd->addr, cmd->arg))							\
+			VM_NEXT();												\
+		VM_JUMP(cmd->raddr);
+
+#define VM_TYPED_ASSIGN_CASE(code, fn)								\
+	VM_CASE(code)													\
+		fn(vm, cmd->addr, cmd->arg);								\
+		VM_NEXT();
+
+// Run as vm_run_budget does. The budget is counted down at jumps (see VM_JUMP), so a slice may run
+// past it up to the next jump.
+static int vm_threaded(VM *vm, long budget, int yields) {
+	Byte *codes = (Byte *) vm->program->commands->heap;
+	Operands *operands = (Operands *) vm->program->operands->heap;
+	Constant *constants = (Constant *) vm->program->constants->heap;
+	Addr length = vm->program->commands->length;
+	Addr pc = vm->cmd_ptr;
+	Operands *cmd = NULL;
+	Addr mark = pc;					// Where the commands not yet paid for start.
+	int sliced = budget >= 0;
+	int status = VM_FINISHED;
+	if (!sliced)
+		budget = LONG_MAX;
+
+#ifdef VM_COMPUTED_GOTO
+	static void *dispatch_table[256] = {
+		[0 ... 255] = &&op_default,
+		[CMD_COPY] = &&op_CMD_COPY,
+		[CMD_ASSIGN] = &&op_CMD_ASSIGN,
+		[CMD_SET_BYTE] = &&op_CMD_SET_BYTE,
+		[CMD_SET_UINT] = &&op_CMD_SET_UINT,
+		[CMD_SET_INT] = &&op_CMD_SET_INT,
+		[CMD_SET_FLOAT] = &&op_CMD_SET_FLOAT,
+		[CMD_ADD] = &&op_CMD_ADD,
+		[CMD_SUB] = &&op_CMD_SUB,
+		[CMD_MULT] = &&op_CMD_MULT,
+		[CMD_DIV] = &&op_CMD_DIV,
+		[CMD_JUMP] = &&op_CMD_JUMP,
+		[CMD_JCOND] = &&op_CMD_JCOND,
+		[CMD_AND] = &&op_CMD_AND,
+		[CMD_OR] = &&op_CMD_OR,
+		[CMD_XOR] = &&op_CMD_XOR,
+		[CMD_NOT] = &&op_CMD_NOT,
+		[CMD_RSHIFT] = &&op_CMD_RSHIFT,
+		[CMD_LSHIFT] = &&op_CMD_LSHIFT,
+		[CMD_GREATER] = &&op_CMD_GREATER,
+		[CMD_LESS] = &&op_CMD_LESS,
+		[CMD_EQUAL] = &&op_CMD_EQUAL,
+		[CMD_NEQUAL] = &&op_CMD_NEQUAL,
+		[CMD_GEQ] = &&op_CMD_GEQ,
+		[CMD_LEQ] = &&op_CMD_LEQ,
+		[CMD_PUSH] = &&op_CMD_PUSH,
+		[CMD_POP] = &&op_CMD_POP,
+		[CMD_ENTER] = &&op_CMD_ENTER,
+		[CMD_LEAVE] = &&op_CMD_LEAVE,
+		[CMD_STACK] = &&op_CMD_STACK,
+		[CMD_COMMANDS] = &&op_CMD_COMMANDS,
+		[CMD_PRINT] = &&op_CMD_PRINT,
+		[CMD_EXIT] = &&op_CMD_EXIT,
+		[CMD_SET_SLEN] = &&op_CMD_SET_SLEN,
+		[CMD_ADD_INT_INT] = &&op_CMD_ADD_INT_INT,
+		[CMD_ADD_FLOAT_FLOAT] = &&op_CMD_ADD_FLOAT_FLOAT,
+		[CMD_SUB_INT_INT] = &&op_CMD_SUB_INT_INT,
+		[CMD_SUB_FLOAT_FLOAT] = &&op_CMD_SUB_FLOAT_FLOAT,
+		[CMD_MULT_INT_INT] = &&op_CMD_MULT_INT_INT,
+		[CMD_MULT_FLOAT_FLOAT] = &&op_CMD_MULT_FLOAT_FLOAT,
+		[CMD_DIV_INT_INT] = &&op_CMD_DIV_INT_INT,
+		[CMD_DIV_FLOAT_FLOAT] = &&op_CMD_DIV_FLOAT_FLOAT,
+		[CMD_GREATER_INT_INT] = &&op_CMD_GREATER_INT_INT,
+		[CMD_GREATER_FLOAT_FLOAT] = &&op_CMD_GREATER_FLOAT_FLOAT,
+		[CMD_LESS_INT_INT] = &&op_CMD_LESS_INT_INT,
+		[CMD_LESS_FLOAT_FLOAT] = &&op_CMD_LESS_FLOAT_FLOAT,
+		[CMD_EQUAL_INT_INT] = &&op_CMD_EQUAL_INT_INT,
+		[CMD_EQUAL_FLOAT_FLOAT] = &&op_CMD_EQUAL_FLOAT_FLOAT,
+		[CMD_NEQUAL_INT_INT] = &&op_CMD_NEQUAL_INT_INT,
+		[CMD_NEQUAL_FLOAT_FLOAT] = &&op_CMD_NEQUAL_FLOAT_FLOAT,
+		[CMD_GEQ_INT_INT] = &&op_CMD_GEQ_INT_INT,
+		[CMD_GEQ_FLOAT_FLOAT] = &&op_CMD_GEQ_FLOAT_FLOAT,
+		[CMD_LEQ_INT_INT] = &&op_CMD_LEQ_INT_INT,
+		[CMD_LEQ_FLOAT_FLOAT] = &&op_CMD_LEQ_FLOAT_FLOAT,
+		[CMD_JNOT_GREATER] = &&op_CMD_JNOT_GREATER,
+		[CMD_JNOT_LESS] = &&op_CMD_JNOT_LESS,
+		[CMD_JNOT_EQUAL] = &&op_CMD_JNOT_EQUAL,
+		[CMD_JNOT_NEQUAL] = &&op_CMD_JNOT_NEQUAL,
+		[CMD_JNOT_GEQ] = &&op_CMD_JNOT_GEQ,
+		[CMD_JNOT_LEQ] = &&op_CMD_JNOT_LEQ,
+		[CMD_ADD_INT] = &&op_CMD_ADD_INT,
+		[CMD_ADD_FLOAT] = &&op_CMD_ADD_FLOAT,
+		[CMD_SUB_INT] = &&op_CMD_SUB_INT,
+		[CMD_SUB_FLOAT] = &&op_CMD_SUB_FLOAT,
+		[CMD_MULT_INT] = &&op_CMD_MULT_INT,
+		[CMD_MULT_FLOAT] = &&op_CMD_MULT_FLOAT,
+		[CMD_DIV_INT] = &&op_CMD_DIV_INT,
+		[CMD_DIV_FLOAT] = &&op_CMD_DIV_FLOAT,
+		[CMD_GREATER_INT] = &&op_CMD_GREATER_INT,
+		[CMD_GREATER_FLOAT] = &&op_CMD_GREATER_FLOAT,
+		[CMD_LESS_INT] = &&op_CMD_LESS_INT,
+		[CMD_LESS_FLOAT] = &&op_CMD_LESS_FLOAT,
+		[CMD_EQUAL_INT] = &&op_CMD_EQUAL_INT,
+		[CMD_EQUAL_FLOAT] = &&op_CMD_EQUAL_FLOAT,
+		[CMD_NEQUAL_INT] = &&op_CMD_NEQUAL_INT,
+		[CMD_NEQUAL_FLOAT] = &&op_CMD_NEQUAL_FLOAT,
+		[CMD_GEQ_INT] = &&op_CMD_GEQ_INT,
+		[CMD_GEQ_FLOAT] = &&op_CMD_GEQ_FLOAT,
+		[CMD_LEQ_INT] = &&op_CMD_LEQ_INT,
+		[CMD_LEQ_FLOAT] = &&op_CMD_LEQ_FLOAT,
+		[CMD_JNOT_GREATER_INT] = &&op_CMD_JNOT_GREATER_INT,
+		[CMD_JNOT_GREATER_FLOAT] = &&op_CMD_JNOT_GREATER_FLOAT,
+		[CMD_JNOT_LESS_INT] = &&op_CMD_JNOT_LESS_INT,
+		[CMD_JNOT_LESS_FLOAT] = &&op_CMD_JNOT_LESS_FLOAT,
+		[CMD_JNOT_EQUAL_INT] = &&op_CMD_JNOT_EQUAL_INT,
+		[CMD_JNOT_EQUAL_FLOAT] = &&op_CMD_JNOT_EQUAL_FLOAT,
+		[CMD_JNOT_NEQUAL_INT] = &&op_CMD_JNOT_NEQUAL_INT,
+		[CMD_JNOT_NEQUAL_FLOAT] = &&op_CMD_JNOT_NEQUAL_FLOAT,
+		[CMD_JNOT_GEQ_INT] = &&op_CMD_JNOT_GEQ_INT,
+		[CMD_JNOT_GEQ_FLOAT] = &&op_CMD_JNOT_GEQ_FLOAT,
+		[CMD_JNOT_LEQ_INT] = &&op_CMD_JNOT_LEQ_INT,
+		[CMD_JNOT_LEQ_FLOAT] = &&op_CMD_JNOT_LEQ_FLOAT,
+		[CMD_ASSIGN_INT] = &&op_CMD_ASSIGN_INT,
+		[CMD_ASSIGN_FLOAT] = &&op_CMD_ASSIGN_FLOAT,
+		[CMD_ASSIGN_INT_FROM_FLOAT] = &&op_CMD_ASSIGN_INT_FROM_FLOAT,
+		[CMD_ASSIGN_FLOAT_FROM_INT] = &&op_CMD_ASSIGN_FLOAT_FROM_INT,
+		[CMD_CALL_NATIVE] = &&op_CMD_CALL_NATIVE,
+		[CMD_YIELD] = &&op_CMD_YIELD,
+	};
+
+	VM_DISPATCH();
+#else
+	for (;;) {
+		if (pc >= length)
+			goto vm_run_end;
+		cmd = operands + pc;
+		switch (codes[pc]) {
+#endif
+
+	VM_CASE(CMD_COPY)
+		{
+		vm_copy(vm, cmd->addr, cmd->arg);
+		VM_NEXT();
+		}
+
+	VM_CASE(CMD_ASSIGN)
+		vm_assign(vm, cmd->addr, cmd->arg);
+		VM_NEXT();
+
+	VM_CASE(CMD_SET_BYTE)
+		{
+		Register reg;
+		reg.type = TYPE_BYTE;
+		reg.uint_value = 0;
+		reg.byte_value = (Byte) cmd->arg;
+		vm_store(vm, cmd->addr, reg);
+		VM_NEXT();
+		}
+
+	VM_CASE(CMD_SET_UINT)
+		{
+		Register reg;
+		reg.type = TYPE_UINT;
+		reg.uint_value = constants[cmd->arg].uint_value;
+		vm_store(vm, cmd->addr, reg);
+		VM_NEXT();
+		}
+
+	VM_CASE(CMD_SET_INT)
+		{
+		vm_store_int(vm, cmd->addr, constants[cmd->arg].int_value);
+		VM_NEXT();
+		}
+
+	VM_CASE(CMD_SET_FLOAT)
+		{
+		vm_store_float(vm, cmd->addr, constants[cmd->arg].float_value);
+		VM_NEXT();
+		}
+
+	VM_CASE(CMD_ADD)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_add(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_SUB)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_sub(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_MULT)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_mult(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_DIV)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_div(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_JUMP)
+		// native code does not count commands, so sliced runs stay in the interpreter.
+		if (vm->jit && !sliced && cmd->addr <= pc) {
+			Addr next = jit_loop(vm, cmd->addr, pc);
+			if (next != JIT_MISS)
+				VM_JUMP(next);
+		}
+		VM_JUMP(cmd->addr);
+
+	VM_CASE(CMD_JCOND)
+		{
+		Register reg = vm_load(vm, cmd->arg);
+		if (vm_truth(&reg))
+			VM_JUMP(cmd->addr);
+		VM_NEXT();
+		}
+
+	VM_JNOT_CASE(CMD_JNOT_GREATER, CMD_GREATER, >)
+	VM_JNOT_CASE(CMD_JNOT_LESS, CMD_LESS, <)
+	VM_JNOT_CASE(CMD_JNOT_EQUAL, CMD_EQUAL, ==)
+	VM_JNOT_CASE(CMD_JNOT_NEQUAL, CMD_NEQUAL, !=)
+	VM_JNOT_CASE(CMD_JNOT_GEQ, CMD_GEQ, >=)
+	VM_JNOT_CASE(CMD_JNOT_LEQ, CMD_LEQ, <=)
+
+	VM_CASE(CMD_AND)
+		vm_and(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_OR)
+		vm_or(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_XOR)
+		vm_xor(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_NOT)
+		vm_not(vm, cmd->addr, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_RSHIFT)
+		vm_rshift(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_LSHIFT)
+		vm_lshift(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_GREATER)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_greater(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_LESS)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_less(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_EQUAL)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_equal(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_NEQUAL)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_nequal(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_GEQ)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_geq(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_LEQ)
+		if (vm->quicken && vm_quicken(vm, pc))
+			VM_DISPATCH();
+		vm_leq(vm, cmd->addr, cmd->arg, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_PUSH)
+		if (vm_push(vm) < 0)
+			goto vm_run_failed;
+		VM_NEXT();
+
+	VM_CASE(CMD_POP)
+		vm_pop(vm);
+		VM_NEXT();
+
+	VM_CASE(CMD_ENTER)
+		if (vm_enter(vm, cmd->addr) < 0)
+			goto vm_run_failed;
+		VM_NEXT();
+
+	VM_CASE(CMD_LEAVE)
+		if (vm_leave(vm, cmd->addr) < 0)
+			goto vm_run_failed;
+		VM_NEXT();
+
+	VM_CASE(CMD_STACK)
+		vm_stack_dump(vm);
+		VM_NEXT();
+
+	VM_CASE(CMD_COMMANDS)
+		vm->cmd_ptr = pc;
+		vm_commands_dump(vm);
+		VM_NEXT();
+
+	VM_CASE(CMD_PRINT)
+		vm_register_dump(vm, cmd->addr);
+		VM_NEXT();
+
+	VM_CASE(CMD_EXIT)
+		VM_JUMP(length);
+
+	VM_CASE(CMD_SET_SLEN)
+		vm_set_slen(vm, cmd->addr);
+		VM_NEXT();
+
+	VM_QUICK_CASE(CMD_ADD_INT_INT, vm_add_int_int)
+	VM_QUICK_CASE(CMD_ADD_FLOAT_FLOAT, vm_add_float_float)
+	VM_QUICK_CASE(CMD_SUB_INT_INT, vm_sub_int_int)
+	VM_QUICK_CASE(CMD_SUB_FLOAT_FLOAT, vm_sub_float_float)
+	VM_QUICK_CASE(CMD_MULT_INT_INT, vm_mult_int_int)
+	VM_QUICK_CASE(CMD_MULT_FLOAT_FLOAT, vm_mult_float_float)
+	VM_QUICK_CASE(CMD_DIV_INT_INT, vm_div_int_int)
+	VM_QUICK_CASE(CMD_DIV_FLOAT_FLOAT, vm_div_float_float)
+	VM_QUICK_CASE(CMD_GREATER_INT_INT, vm_greater_int_int)
+	VM_QUICK_CASE(CMD_GREATER_FLOAT_FLOAT, vm_greater_float_float)
+	VM_QUICK_CASE(CMD_LESS_INT_INT, vm_less_int_int)
+	VM_QUICK_CASE(CMD_LESS_FLOAT_FLOAT, vm_less_float_float)
+	VM_QUICK_CASE(CMD_EQUAL_INT_INT, vm_equal_int_int)
+	VM_QUICK_CASE(CMD_EQUAL_FLOAT_FLOAT, vm_equal_float_float)
+	VM_QUICK_CASE(CMD_NEQUAL_INT_INT, vm_nequal_int_int)
+	VM_QUICK_CASE(CMD_NEQUAL_FLOAT_FLOAT, vm_nequal_float_float)
+	VM_QUICK_CASE(CMD_GEQ_INT_INT, vm_geq_int_int)
+	VM_QUICK_CASE(CMD_GEQ_FLOAT_FLOAT, vm_geq_float_float)
+	VM_QUICK_CASE(CMD_LEQ_INT_INT, vm_leq_int_int)
+	VM_QUICK_CASE(CMD_LEQ_FLOAT_FLOAT, vm_leq_float_float)
+
+	VM_TYPED_CASE(CMD_ADD_INT, vm_add_int)
+	VM_TYPED_CASE(CMD_ADD_FLOAT, vm_add_float)
+	VM_TYPED_CASE(CMD_SUB_INT, vm_sub_int)
+	VM_TYPED_CASE(CMD_SUB_FLOAT, vm_sub_float)
+	VM_TYPED_CASE(CMD_MULT_INT, vm_mult_int)
+	VM_TYPED_CASE(CMD_MULT_FLOAT, vm_mult_float)
+	VM_TYPED_CASE(CMD_DIV_INT, vm_div_int)
+	VM_TYPED_CASE(CMD_DIV_FLOAT, vm_div_float)
+	VM_TYPED_CASE(CMD_GREATER_INT, vm_greater_int)
+	VM_TYPED_CASE(CMD_GREATER_FLOAT, vm_greater_float)
+	VM_TYPED_CASE(CMD_LESS_INT, vm_less_int)
+	VM_TYPED_CASE(CMD_LESS_FLOAT, vm_less_float)
+	VM_TYPED_CASE(CMD_EQUAL_INT, vm_equal_int)
+	VM_TYPED_CASE(CMD_EQUAL_FLOAT, vm_equal_float)
+	VM_TYPED_CASE(CMD_NEQUAL_INT, vm_nequal_int)
+	VM_TYPED_CASE(CMD_NEQUAL_FLOAT, vm_nequal_float)
+	VM_TYPED_CASE(CMD_GEQ_INT, vm_geq_int)
+	VM_TYPED_CASE(CMD_GEQ_FLOAT, vm_geq_float)
+	VM_TYPED_CASE(CMD_LEQ_INT, vm_leq_int)
+	VM_TYPED_CASE(CMD_LEQ_FLOAT, vm_leq_float)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_GREATER_INT, vm_test_greater_int)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_GREATER_FLOAT, vm_test_greater_float)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_LESS_INT, vm_test_less_int)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_LESS_FLOAT, vm_test_less_float)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_EQUAL_INT, vm_test_equal_int)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_EQUAL_FLOAT, vm_test_equal_float)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_NEQUAL_INT, vm_test_nequal_int)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_NEQUAL_FLOAT, vm_test_nequal_float)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_GEQ_INT, vm_test_geq_int)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_GEQ_FLOAT, vm_test_geq_float)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_LEQ_INT, vm_test_leq_int)
+	VM_TYPED_JNOT_CASE(CMD_JNOT_LEQ_FLOAT, vm_test_leq_float)
+	VM_TYPED_ASSIGN_CASE(CMD_ASSIGN_INT, vm_assign_int)
+	VM_TYPED_ASSIGN_CASE(CMD_ASSIGN_FLOAT, vm_assign_float)
+	VM_TYPED_ASSIGN_CASE(CMD_ASSIGN_INT_FROM_FLOAT, vm_assign_int_from_float)
+	VM_TYPED_ASSIGN_CASE(CMD_ASSIGN_FLOAT_FROM_INT, vm_assign_float_from_int)
+
+	VM_CASE(CMD_CALL_NATIVE)
+		native_call(vm, (Native *) vm->program->natives->heap + cmd->arg, cmd->addr, cmd->raddr);
+		VM_NEXT();
+
+	VM_CASE(CMD_YIELD)
+		if (yields) {
+			pc++;
+			status = VM_YIELDED;
+			goto vm_run_end;
+		}
+		VM_NEXT();
+
+	VM_CASE_DEFAULT
+		VM_NEXT();
+
+#ifndef VM_COMPUTED_GOTO
+		}
+	}
+#endif
+
+vm_run_failed:
+	status = VM_FAILED;
+	goto vm_run_end;
+vm_run_exhausted:
+	status = VM_EXHAUSTED;
+vm_run_end:
+	vm->cmd_ptr = pc;
+	return status;
 }
 
 Addr vm_execute(VM *vm, Command cmd) {
 	switch(cmd.code) {
 	case CMD_COPY:
 		{
-		Register reg = vm_get(vm, cmd.addr_arg);
-		vm_set(vm, cmd.addr, reg);
+		vm_copy(vm, cmd.addr, cmd.addr_arg);
 		break;
 		}
 	case CMD_ASSIGN:
@@ -62,8 +1128,9 @@ Addr vm_execute(VM *vm, Command cmd) {
 		{
 		Register reg;
 		reg.type = TYPE_BYTE;
+		reg.uint_value = 0;
 		reg.byte_value = cmd.byte_arg;
-		vm_set(vm, cmd.addr, reg);
+		vm_store(vm, cmd.addr, reg);
 		break;
 		}
 
@@ -72,25 +1139,19 @@ Addr vm_execute(VM *vm, Command cmd) {
 		Register reg;
 		reg.type = TYPE_UINT;
 		reg.uint_value = cmd.uint_arg;
-		vm_set(vm, cmd.addr, reg);
+		vm_store(vm, cmd.addr, reg);
 		break;
 		}
 
 	case CMD_SET_INT: 
 		{
-		Register reg;
-		reg.type = TYPE_INT;
-		reg.int_value = cmd.int_arg;
-		vm_set(vm, cmd.addr, reg);
+		vm_store_int(vm, cmd.addr, cmd.int_arg);
 		break;
 		}
 
 	case CMD_SET_FLOAT:
 		{
-		Register reg;
-		reg.type = TYPE_FLOAT;
-		reg.float_value = cmd.float_arg;
-		vm_set(vm, cmd.addr, reg);
+		vm_store_float(vm, cmd.addr, cmd.float_arg);
 		break;
 		}
 
@@ -118,6 +1179,24 @@ Addr vm_execute(VM *vm, Command cmd) {
 	case CMD_JCOND:
 		return vm_jcond(vm, cmd.addr, cmd.addr_arg);
 	
+	case CMD_JNOT_GREATER:
+		return vm_jnot(vm, CMD_GREATER, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_JNOT_LESS:
+		return vm_jnot(vm, CMD_LESS, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_JNOT_EQUAL:
+		return vm_jnot(vm, CMD_EQUAL, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_JNOT_NEQUAL:
+		return vm_jnot(vm, CMD_NEQUAL, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_JNOT_GEQ:
+		return vm_jnot(vm, CMD_GEQ, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_JNOT_LEQ:
+		return vm_jnot(vm, CMD_LEQ, cmd.addr, cmd.addr_arg, cmd.raddr);
+
 	case CMD_AND:
 		return vm_and(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
 
@@ -131,7 +1210,7 @@ Addr vm_execute(VM *vm, Command cmd) {
 		return vm_not(vm, cmd.addr, cmd.raddr);
 	
 	case CMD_RSHIFT:
-		return vm_lshift(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return vm_rshift(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
 	
 	case CMD_LSHIFT:
 		return vm_lshift(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
@@ -155,12 +1234,17 @@ Addr vm_execute(VM *vm, Command cmd) {
 		return vm_leq(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
 
 	case CMD_PUSH:
-		vm_push(vm);
-		break;
+		return vm_push(vm);
 
 	case CMD_POP:
 		vm_pop(vm);
 		break;
+
+	case CMD_ENTER:
+		return vm_enter(vm, cmd.addr);
+
+	case CMD_LEAVE:
+		return vm_leave(vm, cmd.addr);
 	
 	case CMD_STACK:
 		vm_stack_dump(vm);
@@ -175,753 +1259,881 @@ Addr vm_execute(VM *vm, Command cmd) {
 		break;
 	
 	case CMD_EXIT:
-		vm->cmd_ptr = vm->commands->length;
+		vm->cmd_ptr = vm->program->commands->length;
 		break;
 	
 	case CMD_SET_SLEN:
 		vm_set_slen(vm, cmd.addr);
 		break;
 
+	case CMD_ADD_INT_INT:
+		if (vm_add_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_add(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_ADD_FLOAT_FLOAT:
+		if (vm_add_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_add(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_SUB_INT_INT:
+		if (vm_sub_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_sub(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_SUB_FLOAT_FLOAT:
+		if (vm_sub_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_sub(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_MULT_INT_INT:
+		if (vm_mult_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_mult(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_MULT_FLOAT_FLOAT:
+		if (vm_mult_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_mult(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_DIV_INT_INT:
+		if (vm_div_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_div(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_DIV_FLOAT_FLOAT:
+		if (vm_div_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_div(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_GREATER_INT_INT:
+		if (vm_greater_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_greater(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_GREATER_FLOAT_FLOAT:
+		if (vm_greater_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_greater(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_LESS_INT_INT:
+		if (vm_less_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_less(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_LESS_FLOAT_FLOAT:
+		if (vm_less_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_less(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_EQUAL_INT_INT:
+		if (vm_equal_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_equal(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_EQUAL_FLOAT_FLOAT:
+		if (vm_equal_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_equal(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_NEQUAL_INT_INT:
+		if (vm_nequal_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_nequal(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_NEQUAL_FLOAT_FLOAT:
+		if (vm_nequal_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_nequal(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_GEQ_INT_INT:
+		if (vm_geq_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_geq(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_GEQ_FLOAT_FLOAT:
+		if (vm_geq_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_geq(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_LEQ_INT_INT:
+		if (vm_leq_int_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_leq(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_LEQ_FLOAT_FLOAT:
+		if (vm_leq_float_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr))
+			return cmd.raddr;
+		return vm_leq(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+
+	case CMD_ADD_INT:
+		vm_add_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_ADD_FLOAT:
+		vm_add_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_SUB_INT:
+		vm_sub_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_SUB_FLOAT:
+		vm_sub_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_MULT_INT:
+		vm_mult_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_MULT_FLOAT:
+		vm_mult_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_DIV_INT:
+		vm_div_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_DIV_FLOAT:
+		vm_div_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_GREATER_INT:
+		vm_greater_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_GREATER_FLOAT:
+		vm_greater_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_LESS_INT:
+		vm_less_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_LESS_FLOAT:
+		vm_less_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_EQUAL_INT:
+		vm_equal_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_EQUAL_FLOAT:
+		vm_equal_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_NEQUAL_INT:
+		vm_nequal_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_NEQUAL_FLOAT:
+		vm_nequal_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_GEQ_INT:
+		vm_geq_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_GEQ_FLOAT:
+		vm_geq_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_LEQ_INT:
+		vm_leq_int(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_LEQ_FLOAT:
+		vm_leq_float(vm, cmd.addr, cmd.addr_arg, cmd.raddr);
+		return cmd.raddr;
+
+	case CMD_JNOT_GREATER_INT:
+		if (vm_test_greater_int(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_GREATER_FLOAT:
+		if (vm_test_greater_float(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_LESS_INT:
+		if (vm_test_less_int(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_LESS_FLOAT:
+		if (vm_test_less_float(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_EQUAL_INT:
+		if (vm_test_equal_int(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_EQUAL_FLOAT:
+		if (vm_test_equal_float(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_NEQUAL_INT:
+		if (vm_test_nequal_int(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_NEQUAL_FLOAT:
+		if (vm_test_nequal_float(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_GEQ_INT:
+		if (vm_test_geq_int(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_GEQ_FLOAT:
+		if (vm_test_geq_float(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_LEQ_INT:
+		if (vm_test_leq_int(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_JNOT_LEQ_FLOAT:
+		if (vm_test_leq_float(vm, cmd.addr, cmd.addr_arg))
+			return 0;
+		return vm_jump(vm, cmd.raddr);
+
+	case CMD_ASSIGN_INT:
+		vm_assign_int(vm, cmd.addr, cmd.addr_arg);
+		break;
+
+	case CMD_ASSIGN_FLOAT:
+		vm_assign_float(vm, cmd.addr, cmd.addr_arg);
+		break;
+
+	case CMD_ASSIGN_INT_FROM_FLOAT:
+		vm_assign_int_from_float(vm, cmd.addr, cmd.addr_arg);
+		break;
+
+	case CMD_ASSIGN_FLOAT_FROM_INT:
+		vm_assign_float_from_int(vm, cmd.addr, cmd.addr_arg);
+		break;
+
+	case CMD_CALL_NATIVE:
+		native_call(vm, (Native *) vm->program->natives->heap + cmd.addr_arg, cmd.addr, cmd.raddr);
+		break;
+
+	case CMD_YIELD:
+		// the engines stop after it when resuming or running a slice.
+		break;
+	}
+	return 0;
+}
+
+// True if the command keeps its literal argument in the constant pool.
+static inline int vm_has_constant(Byte code) {
+	return code == CMD_SET_INT || code == CMD_SET_UINT || code == CMD_SET_FLOAT;
+}
+
+/*
+ * Encode the arguments of cmd. A literal that goes to the constant pool is written at
+ * constant_index, or appended to the pool if constant_index is negative.
+ * Return 0 on success, or 1 if an address does not fit in 32 bits or the pool could not grow.
+ */
+static int vm_encode(VM *vm, const Command *cmd, Operands *ops, long constant_index) {
+	if (cmd->addr != (int32_t) cmd->addr || cmd->raddr != (int32_t) cmd->raddr)
+		return 1;
+	ops->addr = (int32_t) cmd->addr;
+	ops->raddr = (int32_t) cmd->raddr;
+
+	if (vm_has_constant(cmd->code)) {
+		Constant constant;
+		switch (cmd->code) {
+			case CMD_SET_INT:   constant.int_value = cmd->int_arg; break;
+			case CMD_SET_UINT:  constant.uint_value = cmd->uint_arg; break;
+			case CMD_SET_FLOAT: constant.float_value = cmd->float_arg; break;
+		}
+		if (constant_index < 0)
+			constant_index = array_push(vm->program->constants, &constant);
+		else
+			array_set(vm->program->constants, constant_index, &constant);
+		if (constant_index < 0 || constant_index != (int32_t) constant_index)
+			return 1;
+		ops->arg = (int32_t) constant_index;
+	}
+	else if (cmd->code == CMD_SET_BYTE) {
+		ops->arg = cmd->byte_arg;
+	}
+	else {
+		if (cmd->addr_arg != (int32_t) cmd->addr_arg)
+			return 1;
+		ops->arg = (int32_t) cmd->addr_arg;
 	}
 	return 0;
 }
 
 Addr vm_push_cmd(VM *vm, Command cmd) {
-	return array_push(vm->commands, &cmd);
+	Operands ops;
+	if (vm_encode(vm, &cmd, &ops, -1))
+		return -1;
+	if (array_push(vm->program->operands, &ops) < 0)
+		return -1;
+	if (array_push(vm->program->commands, &cmd.code) < 0) {
+		vm->program->operands->length--;
+		return -1;
+	}
+	return vm->program->commands->length - 1;
+}
+
+Command vm_get_cmd(VM *vm, Addr index) {
+	Command cmd = { 0 };
+	Operands ops;
+	array_get(vm->program->commands, index, &cmd.code);
+	array_get(vm->program->operands, index, &ops);
+
+	cmd.addr = ops.addr;
+	cmd.raddr = ops.raddr;
+	if (vm_has_constant(cmd.code)) {
+		Constant constant;
+		array_get(vm->program->constants, ops.arg, &constant);
+		switch (cmd.code) {
+			case CMD_SET_INT:   cmd.int_arg = constant.int_value; break;
+			case CMD_SET_UINT:  cmd.uint_arg = constant.uint_value; break;
+			case CMD_SET_FLOAT: cmd.float_arg = constant.float_value; break;
+		}
+	}
+	else if (cmd.code == CMD_SET_BYTE) {
+		cmd.byte_arg = (Byte) ops.arg;
+	}
+	else {
+		cmd.addr_arg = ops.arg;
+	}
+	return cmd;
+}
+
+int vm_set_cmd(VM *vm, Addr index, Command cmd) {
+	Byte old_code;
+	Operands ops;
+	array_get(vm->program->commands, index, &old_code);
+	array_get(vm->program->operands, index, &ops);
+
+	// reuse the constant of the old command, if it had one.
+	long constant_index = vm_has_constant(old_code) ? ops.arg : -1;
+	if (vm_encode(vm, &cmd, &ops, constant_index))
+		return -1;
+	array_set(vm->program->commands, index, &cmd.code);
+	array_set(vm->program->operands, index, &ops);
+	if (vm->jit_state != NULL)
+		jit_reset(vm->jit_state);
+	return 0;
+}
+
+void vm_truncate_commands(VM *vm, Addr length) {
+	if (length < vm->program->commands->length) {
+		vm->program->commands->length = length;
+		vm->program->operands->length = length;
+		if (vm->jit_state != NULL)
+			jit_reset(vm->jit_state);
+	}
 }
 
 Addr vm_push_cmd_copy(VM *vm, Addr addr, Addr addr_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_COPY;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_assign(VM *vm, Addr addr, Addr addr_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_ASSIGN;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_set_byte(VM *vm, Addr addr, Byte byte_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_SET_BYTE;
 	cmd.addr = addr;
 	cmd.byte_arg = byte_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_set_int(VM *vm, Addr addr, Int int_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_SET_INT;
 	cmd.addr = addr;
 	cmd.int_arg = int_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_set_uint(VM *vm, Addr addr, UInt uint_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_SET_UINT;
 	cmd.addr = addr;
 	cmd.uint_arg = uint_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_set_float(VM *vm, Addr addr, Float float_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_SET_FLOAT;
 	cmd.addr = addr;
 	cmd.float_arg = float_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_add(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_ADD;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_sub(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_SUB;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_mult(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_MULT;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_div(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_DIV;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_jump(VM *vm, Addr addr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_JUMP;
 	cmd.addr = addr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_jcond(VM *vm, Addr addr, Addr addr_arg) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_JCOND;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
+}
+
+Addr vm_push_cmd_jnot(VM *vm, Byte relation, Addr addr, Addr addr_arg, Addr raddr) {
+	Command cmd = { 0 };
+	switch (relation) {
+		case CMD_GREATER: cmd.code = CMD_JNOT_GREATER; break;
+		case CMD_LESS:    cmd.code = CMD_JNOT_LESS; break;
+		case CMD_EQUAL:   cmd.code = CMD_JNOT_EQUAL; break;
+		case CMD_NEQUAL:  cmd.code = CMD_JNOT_NEQUAL; break;
+		case CMD_GEQ:     cmd.code = CMD_JNOT_GEQ; break;
+		case CMD_LEQ:     cmd.code = CMD_JNOT_LEQ; break;
+		default:          return -1;
+	}
+	cmd.addr = addr;
+	cmd.addr_arg = addr_arg;
+	cmd.raddr = raddr;
+	return vm_push_cmd(vm, cmd);
+}
+
+int vm_set_jump_target(VM *vm, Addr index, Addr target) {
+	Command cmd = vm_get_cmd(vm, index);
+	switch (vm_generic_code(cmd.code)) {
+		case CMD_JUMP:
+		case CMD_JCOND:
+			cmd.addr = target;
+			break;
+		case CMD_JNOT_GREATER:
+		case CMD_JNOT_LESS:
+		case CMD_JNOT_EQUAL:
+		case CMD_JNOT_NEQUAL:
+		case CMD_JNOT_GEQ:
+		case CMD_JNOT_LEQ:
+			cmd.raddr = target;
+			break;
+	}
+	return vm_set_cmd(vm, index, cmd);
 }
 
 Addr vm_push_cmd_push(VM *vm) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_PUSH;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_pop(VM *vm) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_POP;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
+}
+
+Addr vm_push_cmd_enter(VM *vm, Addr size) {
+	Command cmd = { 0 };
+	cmd.code = CMD_ENTER;
+	cmd.addr = size;
+	return vm_push_cmd(vm, cmd);
+}
+
+Addr vm_push_cmd_leave(VM *vm, Addr size) {
+	Command cmd = { 0 };
+	cmd.code = CMD_LEAVE;
+	cmd.addr = size;
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_and(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_AND;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_or(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_OR;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_xor(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_XOR;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_not(VM *vm, Addr addr, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_NOT;
 	cmd.addr = addr;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_rshift(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_RSHIFT;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_lshift(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_LSHIFT;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_greater(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_GREATER;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_less(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_LESS;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_equal(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_EQUAL;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_nequal(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_NEQUAL;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_geq(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_GEQ;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_leq(VM *vm, Addr addr, Addr addr_arg, Addr raddr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_LEQ;
 	cmd.addr = addr;
 	cmd.addr_arg = addr_arg;
 	cmd.raddr = raddr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_stack(VM *vm) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_STACK;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_commands(VM *vm) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_COMMANDS;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_print(VM *vm, Addr addr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_PRINT;
 	cmd.addr = addr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_exit(VM *vm) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_EXIT;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
 }
 
 Addr vm_push_cmd_set_slen(VM *vm, Addr addr) {
-	Command cmd;
+	Command cmd = { 0 };
 	cmd.code = CMD_SET_SLEN;
 	cmd.addr = addr;
-	return array_push(vm->commands, &cmd);
+	return vm_push_cmd(vm, cmd);
+}
+
+Addr vm_push_cmd_yield(VM *vm) {
+	Command cmd = { 0 };
+	cmd.code = CMD_YIELD;
+	return vm_push_cmd(vm, cmd);
+}
+
+Addr vm_push_cmd_call_native(VM *vm, Addr args, Addr index, Addr raddr) {
+	Command cmd = { 0 };
+	cmd.code = CMD_CALL_NATIVE;
+	cmd.addr = args;
+	cmd.addr_arg = index;
+	cmd.raddr = raddr;
+	return vm_push_cmd(vm, cmd);
 }
 
 void vm_clear_commands(VM *vm) {
-	vm->commands->length = 0;
+	vm->program->commands->length = 0;
+	vm->program->operands->length = 0;
+	vm->program->constants->length = 0;
+	if (vm->jit_state != NULL)
+		jit_reset(vm->jit_state);
+}
+
+int vm_restart(VM *vm) {
+	Program *program = vm->program;
+	if (program->stack == NULL)
+		return 1;
+	size_t length = program->stack->length;
+	if (vm_resize_stack(vm, length) != 0)
+		return 1;
+	memcpy(vm->stack->heap, program->stack->heap, length * program->stack->data_size);
+#ifdef VM_SOA_STACK
+	memcpy(vm->types->heap, program->types->heap, length * program->types->data_size);
+#endif
+#ifdef VM_NAN_BOXING
+	memcpy(vm->wide->heap, program->wide->heap, length * program->wide->data_size);
+#endif
+	vm->cmd_ptr = program->cmd_ptr;
+	return 0;
+}
+
+void vm_reset(VM *vm) {
+	array_clear(vm->program->commands);
+	array_clear(vm->program->operands);
+	array_clear(vm->program->constants);
+	vm->program->natives = native_builtins();
+	vm_leave(vm, vm->stack->length);
+	vm->cmd_ptr = 0;
+	if (vm->jit_state != NULL)
+		jit_reset(vm->jit_state);
 }
 
 void vm_assign(VM *vm, Addr lval_addr, Addr rval_addr) {
-	Register lval;
-	Register rval;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:  lval.byte_value = rval.byte_value; break;
-				case TYPE_UINT:  lval.byte_value = (Byte) rval.uint_value; break;
-				case TYPE_INT:   lval.byte_value = (Byte) rval.int_value; break;
-				case TYPE_FLOAT: lval.byte_value = (Byte) rval.float_value; break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:  lval.uint_value = (UInt) rval.byte_value; break;
-				case TYPE_UINT:  lval.uint_value = rval.uint_value; break;
-				case TYPE_INT:   lval.uint_value = (UInt) rval.int_value; break;
-				case TYPE_FLOAT: lval.uint_value = (UInt) rval.float_value; break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:  lval.int_value = (Int) rval.byte_value; break;
-				case TYPE_UINT:  lval.int_value = (Int) rval.uint_value; break;
-				case TYPE_INT:   lval.int_value = rval.int_value; break;
-				case TYPE_FLOAT: lval.int_value = (Int) rval.float_value; break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:  lval.float_value = (Float) rval.byte_value; break;
-				case TYPE_UINT:  lval.float_value = (Float) rval.uint_value; break;
-				case TYPE_INT:   lval.float_value = (Float) rval.int_value; break;
-				case TYPE_FLOAT: lval.float_value = rval.float_value; break;
-			}
-			break;
+	VM_APPLY_UNARY(vm_op_assign, vm, lval_addr, rval_addr);
+}
+
+// Push a register to the stack. Return its address.
+static Addr vm_push_register(VM *vm, Register reg) {
+#ifdef VM_SOA_STACK
+	Value value;
+	value.uint_value = reg.uint_value;
+	if (array_push(vm->types, &reg.type) < 0)
+		return -1;
+	if (array_push(vm->stack, &value) < 0) {
+		vm->types->length--;
+		return -1;
 	}
-
-	array_set(vm->stack, lval_addr, &lval);
+	return vm->stack->length - 1;
+#elif defined(VM_NAN_BOXING)
+	uint64_t bits = 0;
+	if (array_push(vm->wide, &bits) < 0)
+		return -1;
+	bits = vm_box(reg, (uint64_t *) vm->wide->heap + vm->wide->length - 1);
+	if (array_push(vm->stack, &bits) < 0) {
+		vm->wide->length--;
+		return -1;
+	}
+	return vm->stack->length - 1;
+#else
+	return array_push(vm->stack, &reg);
+#endif
+}
+
+// Set the number of registers in the stack. New registers are left undefined.
+// Return 0, or -1 if memory ran out and the stack was left as it was.
+static int vm_resize_stack(VM *vm, size_t length) {
+#ifdef VM_SOA_STACK
+	if (array_resize(vm->types, length) != 0)
+		return -1;
+#endif
+#ifdef VM_NAN_BOXING
+	if (array_resize(vm->wide, length) != 0)
+		return -1;
+#endif
+	if (array_resize(vm->stack, length) != 0) {
+		// shrinking back cannot fail.
+#ifdef VM_SOA_STACK
+		vm->types->length = vm->stack->length;
+#endif
+#ifdef VM_NAN_BOXING
+		vm->wide->length = vm->stack->length;
+#endif
+		return -1;
+	}
+	return 0;
 }
 
 Addr vm_push(VM *vm) {
 	Register reg;
-	return array_push(vm->stack, &reg);
+	return vm_push_register(vm, reg);
+}
+
+Addr vm_enter(VM *vm, Addr size) {
+	if (size < 0 || vm_resize_stack(vm, vm->stack->length + size) != 0)
+		return -1;
+	return vm->stack->length;
+}
+
+Addr vm_leave(VM *vm, Addr size) {
+	if (size < 0 || (size_t) size > vm->stack->length)
+		return -1;
+	vm_resize_stack(vm, vm->stack->length - size);
+	return vm->stack->length;
 }
 
 Addr vm_push_byte(VM *vm, Byte value) {
 	Register reg;
 	reg.type = TYPE_BYTE;
 	reg.byte_value = value;
-	return array_push(vm->stack, &reg);
+	return vm_push_register(vm, reg);
 }
 
 Addr vm_push_int(VM *vm, Int value) {
 	Register reg;
 	reg.type = TYPE_INT;
 	reg.int_value = value;
-	return array_push(vm->stack, &reg);
+	return vm_push_register(vm, reg);
 }
 
 Addr vm_push_uint(VM *vm, UInt value) {
 	Register reg;
 	reg.type = TYPE_UINT;
 	reg.uint_value = value;
-	return array_push(vm->stack, &reg);
+	return vm_push_register(vm, reg);
 }
 
 Addr vm_push_float(VM *vm, Float value) {
 	Register reg;
 	reg.type = TYPE_FLOAT;
 	reg.float_value = value;
-	return array_push(vm->stack, &reg);
+	return vm_push_register(vm, reg);
 }
 
 void vm_set_byte(VM *vm, Addr index, Byte value) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
+	Register reg = vm_load(vm, index);
 	reg.byte_value = value;
-	array_set(vm->stack, index, &reg);
+	vm_store(vm, index, reg);
 }
 
 void vm_set_uint(VM *vm, Addr index, UInt value) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
+	Register reg = vm_load(vm, index);
 	reg.uint_value = value;
-	array_set(vm->stack, index, &reg);
+	vm_store(vm, index, reg);
 }
 
 void vm_set_int(VM *vm, Addr index, Int value) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
+	Register reg = vm_load(vm, index);
 	reg.int_value = value;
-	array_set(vm->stack, index, &reg);
+	vm_store(vm, index, reg);
 }
 
 void vm_set_float(VM *vm, Addr index, Float value) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
+	Register reg = vm_load(vm, index);
 	reg.float_value = value;
-	array_set(vm->stack, index, &reg);
+	vm_store(vm, index, reg);
 }
 
 Addr vm_add(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value + rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) + rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) + rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) + rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value + ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value + rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) + rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) + rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value + ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value + ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value + rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) + rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value + ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value + ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value + ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value + rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_add, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_sub(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value - rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) - rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) - rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) - rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value - ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value - rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) - rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) - rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value - ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value - ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value - rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) - rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value - ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value - ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value - ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value - rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_sub, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_mult(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value * rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) * rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) * rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) * rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value * ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value * rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) * rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) * rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value * ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value * ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value * rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) * rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value * ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value * ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value * ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value * rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_mult, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_div(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value / rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) / rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) / rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) / rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value / ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value / rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) / rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) / rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value / ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value / ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value / rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) / rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value / ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value / ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value / ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value / rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_div, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
@@ -931,1410 +2143,537 @@ Addr vm_jump(VM *vm, Addr addr) {
 }
 
 Addr vm_jcond(VM *vm, Addr cmd_addr, Addr bool_addr) {
-	Register reg;
-	array_get(vm->stack, bool_addr, &reg);
-	switch (reg.type) {
-		case TYPE_BYTE:
-			if (reg.byte_value)
-				return vm_jump(vm, cmd_addr);
-			break;
-		case TYPE_UINT:
-			if (reg.uint_value)
-				return vm_jump(vm, cmd_addr);
-			break;
-		case TYPE_INT:
-			if (reg.int_value)
-				return vm_jump(vm, cmd_addr);
-			break;
-		case TYPE_FLOAT:
-			if ((Int) reg.float_value)
-				return vm_jump(vm, cmd_addr);
-			break;
-		default:
-			return 0;
-	}
+	Register reg = vm_load(vm, bool_addr);
+	if (vm_truth(&reg))
+		return vm_jump(vm, cmd_addr);
+	return 0;
 }
 
-Addr vm_and(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value & rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) & rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) & rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value & ((Byte) rval.float_value);
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value & ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value & rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) & rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value & (UInt) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value & ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value & ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value & rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value & (Int) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = ((Byte) lval.float_value) & rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.float_value = ((UInt) lval.float_value) & rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.float_value = ((Int) lval.float_value) & rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.float_value) & ((UInt) rval.float_value);
-					break;
-			}
-			break;
-	}
+Addr vm_jnot(VM *vm, Byte relation, Addr lval_addr, Addr rval_addr, Addr cmd_addr) {
+	Register lval = vm_load(vm, lval_addr);
+	Register rval = vm_load(vm, rval_addr);
+	if (!vm_test(relation, &lval, &rval))
+		return vm_jump(vm, cmd_addr);
+	return 0;
+}
 
-	array_set(vm->stack, raddr, &result);
+Addr vm_and(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
+	VM_APPLY_BINARY(vm_op_and, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_or(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value | rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) | rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) | rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value | ((Byte) rval.float_value);
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value | ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value | rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) | rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value | (UInt) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value | ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value | ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value | rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value | (Int) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = ((Byte) lval.float_value) | rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.float_value = ((UInt) lval.float_value) | rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.float_value = ((Int) lval.float_value) | rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.float_value) | ((UInt) rval.float_value);
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_or, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_xor(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value ^ rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) ^ rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) ^ rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value ^ ((Byte) rval.float_value);
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value ^ ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value ^ rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) ^ rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value ^ (UInt) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value ^ ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value ^ ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value ^ rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value ^ (Int) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = ((Byte) lval.float_value) ^ rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.float_value = ((UInt) lval.float_value) ^ rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.float_value = ((Int) lval.float_value) ^ rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.float_value) ^ ((UInt) rval.float_value);
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_xor, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_not(VM *vm, Addr lval_addr, Addr raddr) {
-	Register lval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			result.type = TYPE_BYTE;
-			result.byte_value = !lval.byte_value;
-			break;
-		case TYPE_UINT:
-			result.type = TYPE_UINT;
-			result.uint_value = !lval.uint_value;
-			break;
-		case TYPE_INT:
-			result.type = TYPE_INT;
-			result.int_value = !lval.int_value;
-			break;
-		case TYPE_FLOAT:
-			result.type = TYPE_UINT;
-			result.uint_value = !((UInt) lval.float_value);
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_UNARY(vm_op_not, vm, raddr, lval_addr);
 	return raddr;
 }
 
 Addr vm_rshift(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value << rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) << rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) << rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value << ((Byte) rval.float_value);
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value << ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value << rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) << rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value << (UInt) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value << ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value << ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value << rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value << (Int) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = ((Byte) lval.float_value) << rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.float_value = ((UInt) lval.float_value) << rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.float_value = ((Int) lval.float_value) << rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.float_value) << ((UInt) rval.float_value);
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_rshift, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_lshift(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value >> rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) >> rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) >> rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value >> ((Byte) rval.float_value);
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value >> ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value >> rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) >> rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value >> (UInt) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >> ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >> ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >> rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >> (Int) rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = ((Byte) lval.float_value) >> rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.float_value = ((UInt) lval.float_value) >> rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.float_value = ((Int) lval.float_value) >> rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.float_value) >> ((UInt) rval.float_value);
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_lshift, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_greater(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value > rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) > rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) > rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) > rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value > ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value > rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) > rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) > rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value > ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value > ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value > rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) > rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value > ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value > ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value > ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value > rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_greater, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_less(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value < rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) < rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) < rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) < rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value < ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value < rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) < rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) < rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value < ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value < ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value < rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) < rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value < ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value < ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value < ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value < rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_less, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_equal(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value == rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) == rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) == rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) == rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value == ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value == rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) == rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) == rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value == ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value == ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value == rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) == rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value == ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value == ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value == ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value == rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_equal, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_nequal(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value != rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) != rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) != rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) != rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value != ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value != rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) != rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) != rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value != ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value != ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value != rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) != rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value != ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value != ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value != ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value != rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_nequal, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_geq(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value >= rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) >= rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) >= rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) >= rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value >= ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value >= rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) >= rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) >= rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >= ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >= ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value >= rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) >= rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value >= ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value >= ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value >= ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value >= rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_geq, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_leq(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr) {
-	Register lval;
-	Register rval;
-	Register result;
-	array_get(vm->stack, lval_addr, &lval);
-	array_get(vm->stack, rval_addr, &rval);
-
-	switch (lval.type) {
-		case TYPE_BYTE:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_BYTE;
-					result.byte_value = lval.byte_value <= rval.byte_value;
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = ((UInt) lval.byte_value) <= rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.byte_value) <= rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.byte_value) <= rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_UINT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value <= ((Byte) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_UINT;
-					result.uint_value = lval.uint_value <= rval.uint_value;
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = ((Int) lval.uint_value) <= rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.uint_value) <= rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_INT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value <= ((Int) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value <= ((Int) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_INT;
-					result.int_value = lval.int_value <= rval.int_value;
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = ((Float) lval.int_value) <= rval.float_value;
-					break;
-			}
-			break;
-		case TYPE_FLOAT:
-			switch (rval.type) {
-				case TYPE_BYTE:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value <= ((Float) rval.byte_value);
-					break;
-				case TYPE_UINT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value <= ((Float) rval.uint_value);
-					break;
-				case TYPE_INT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value <= ((Float) rval.int_value);
-					break;
-				case TYPE_FLOAT:
-					result.type = TYPE_FLOAT;
-					result.float_value = lval.float_value <= rval.float_value;
-					break;
-			}
-			break;
-	}
-
-	array_set(vm->stack, raddr, &result);
+	VM_APPLY_BINARY(vm_op_leq, vm, raddr, lval_addr, rval_addr);
 	return raddr;
 }
 
 Addr vm_set_slen(VM *vm, Addr addr) {
-	Register val;
-	array_get(vm->stack, addr, &val);
-	val.type = TYPE_UINT;
-	val.uint_value = vm->stack->length;
+	Register reg;
+	reg.type = TYPE_UINT;
+	reg.uint_value = vm->stack->length;
+	vm_store(vm, addr, reg);
+	return addr;
 }
 
 Register vm_pop(VM *vm) {
-	Register reg;
-	array_pop(vm->stack, &reg);
+	Register reg = vm_load(vm, vm->stack->length - 1);
+	vm_resize_stack(vm, vm->stack->length - 1);
 	return reg;
 }
 
 Register vm_get(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg;
+	return vm_load(vm, index);
 }
 
 Register vm_reg(VM *vm, Addr index) {
-	Register reg;
-	Addr addr = vm->stack->length - index;
-	array_get(vm->stack, addr, &reg);
-	return reg;
+	return vm_load(vm, vm->stack->length - index);
 }
 
 void vm_set(VM *vm, Addr index, Register reg) {
-	array_set(vm->stack, index, &reg);
+	vm_store(vm, index, reg);
+}
+
+const char *vm_command_name(Byte code) {
+	switch (code) {
+	case CMD_COPY: return "copy";
+	case CMD_ASSIGN: return "assign";
+	case CMD_SET_BYTE: return "set_byte";
+	case CMD_SET_INT: return "set_int";
+	case CMD_SET_UINT: return "set_uint";
+	case CMD_SET_FLOAT: return "set_float";
+	case CMD_MALLOC: return "malloc";
+	case CMD_FREE: return "free";
+	case CMD_ADD: return "add";
+	case CMD_SUB: return "sub";
+	case CMD_MULT: return "mult";
+	case CMD_DIV: return "div";
+	case CMD_JUMP: return "jump";
+	case CMD_JCOND: return "jcond";
+	case CMD_AND: return "and";
+	case CMD_OR: return "or";
+	case CMD_XOR: return "xor";
+	case CMD_NOT: return "not";
+	case CMD_LSHIFT: return "lshift";
+	case CMD_RSHIFT: return "rshift";
+	case CMD_GREATER: return "greater";
+	case CMD_LESS: return "less";
+	case CMD_EQUAL: return "equal";
+	case CMD_NEQUAL: return "nequal";
+	case CMD_GEQ: return "geq";
+	case CMD_LEQ: return "leq";
+	case CMD_PUSH: return "push";
+	case CMD_POP: return "pop";
+	case CMD_ENTER: return "enter";
+	case CMD_LEAVE: return "leave";
+	case CMD_STACK: return "stack";
+	case CMD_COMMANDS: return "commands";
+	case CMD_PRINT: return "print";
+	case CMD_EXIT: return "exit";
+	case CMD_SET_SLEN: return "set_slen";
+	case CMD_ADD_INT_INT: return "add_ii";
+	case CMD_ADD_FLOAT_FLOAT: return "add_ff";
+	case CMD_SUB_INT_INT: return "sub_ii";
+	case CMD_SUB_FLOAT_FLOAT: return "sub_ff";
+	case CMD_MULT_INT_INT: return "mult_ii";
+	case CMD_MULT_FLOAT_FLOAT: return "mult_ff";
+	case CMD_DIV_INT_INT: return "div_ii";
+	case CMD_DIV_FLOAT_FLOAT: return "div_ff";
+	case CMD_GREATER_INT_INT: return "greater_ii";
+	case CMD_GREATER_FLOAT_FLOAT: return "greater_ff";
+	case CMD_LESS_INT_INT: return "less_ii";
+	case CMD_LESS_FLOAT_FLOAT: return "less_ff";
+	case CMD_EQUAL_INT_INT: return "equal_ii";
+	case CMD_EQUAL_FLOAT_FLOAT: return "equal_ff";
+	case CMD_NEQUAL_INT_INT: return "nequal_ii";
+	case CMD_NEQUAL_FLOAT_FLOAT: return "nequal_ff";
+	case CMD_GEQ_INT_INT: return "geq_ii";
+	case CMD_GEQ_FLOAT_FLOAT: return "geq_ff";
+	case CMD_LEQ_INT_INT: return "leq_ii";
+	case CMD_LEQ_FLOAT_FLOAT: return "leq_ff";
+	case CMD_JNOT_GREATER: return "jnot_gt";
+	case CMD_JNOT_LESS: return "jnot_lt";
+	case CMD_JNOT_EQUAL: return "jnot_eq";
+	case CMD_JNOT_NEQUAL: return "jnot_ne";
+	case CMD_JNOT_GEQ: return "jnot_ge";
+	case CMD_JNOT_LEQ: return "jnot_le";
+	case CMD_ADD_INT: return "add_i";
+	case CMD_ADD_FLOAT: return "add_f";
+	case CMD_SUB_INT: return "sub_i";
+	case CMD_SUB_FLOAT: return "sub_f";
+	case CMD_MULT_INT: return "mult_i";
+	case CMD_MULT_FLOAT: return "mult_f";
+	case CMD_DIV_INT: return "div_i";
+	case CMD_DIV_FLOAT: return "div_f";
+	case CMD_GREATER_INT: return "greater_i";
+	case CMD_GREATER_FLOAT: return "greater_f";
+	case CMD_LESS_INT: return "less_i";
+	case CMD_LESS_FLOAT: return "less_f";
+	case CMD_EQUAL_INT: return "equal_i";
+	case CMD_EQUAL_FLOAT: return "equal_f";
+	case CMD_NEQUAL_INT: return "nequal_i";
+	case CMD_NEQUAL_FLOAT: return "nequal_f";
+	case CMD_GEQ_INT: return "geq_i";
+	case CMD_GEQ_FLOAT: return "geq_f";
+	case CMD_LEQ_INT: return "leq_i";
+	case CMD_LEQ_FLOAT: return "leq_f";
+	case CMD_JNOT_GREATER_INT: return "jnot_gt_i";
+	case CMD_JNOT_GREATER_FLOAT: return "jnot_gt_f";
+	case CMD_JNOT_LESS_INT: return "jnot_lt_i";
+	case CMD_JNOT_LESS_FLOAT: return "jnot_lt_f";
+	case CMD_JNOT_EQUAL_INT: return "jnot_eq_i";
+	case CMD_JNOT_EQUAL_FLOAT: return "jnot_eq_f";
+	case CMD_JNOT_NEQUAL_INT: return "jnot_ne_i";
+	case CMD_JNOT_NEQUAL_FLOAT: return "jnot_ne_f";
+	case CMD_JNOT_GEQ_INT: return "jnot_ge_i";
+	case CMD_JNOT_GEQ_FLOAT: return "jnot_ge_f";
+	case CMD_JNOT_LEQ_INT: return "jnot_le_i";
+	case CMD_JNOT_LEQ_FLOAT: return "jnot_le_f";
+	case CMD_ASSIGN_INT: return "assign_i";
+	case CMD_ASSIGN_FLOAT: return "assign_f";
+	case CMD_ASSIGN_INT_FROM_FLOAT: return "assign_if";
+	case CMD_ASSIGN_FLOAT_FROM_INT: return "assign_fi";
+	case CMD_CALL_NATIVE: return "call";
+	case CMD_YIELD: return "yield";
+	default: return "unknown";
+	}
 }
 
 void vm_stack_dump(VM *vm) {
 	for (int i = 0; i < vm->stack->length; i++) {
-		printf("%4d: ", i);
-		Register reg = vm_get(vm, i);
-		switch (reg.type) {
-		case TYPE_BYTE:
-			printf("(byte)     %10d\n", reg.byte_value);
-			break;
-		case TYPE_UINT:
-			printf("(uint)     %10lu\n", reg.uint_value);
-			break;
-		case TYPE_INT:
-			printf("(int)      %10ld\n", reg.int_value);
-			break;
-		case TYPE_FLOAT:
-			printf("(float)    %10f\n", reg.float_value);
-			break;
-		default:
-			printf("(undefined) \n");
-			break;
-		}
+		Register reg = vm_load(vm, i);
+		vm_op_stack_line_dump(vm->out, i, &reg);
 	}
-	printf("Total: %lu\n", vm->stack->length);
+	fprintf(vm->out, "Total: %lu\n", vm->stack->length);
 }
 
 void vm_commands_dump(VM *vm) {
-	printf("%5s%10s %13s %10s %10s\n", "", "command", "addr", "arg", "raddr");
-	for (int i = 0; i < vm->commands->length; i++) {
+	vm_commands_fdump(vm, vm->out);
+}
+
+void vm_commands_fdump(VM *vm, FILE *out) {
+	fprintf(out, "%5s%10s %13s %10s %10s\n", "", "command", "addr", "arg", "raddr");
+	for (int i = 0; i < vm->program->commands->length; i++) {
 		if (i == vm->cmd_ptr)
-			printf("> %4d: ", i);
+			fprintf(out, "> %4d: ", i);
 		else
-			printf("  %4d: ", i);
-		Command cmd;
-		array_get(vm->commands, i, &cmd);
+			fprintf(out, "  %4d: ", i);
+		Command cmd = vm_get_cmd(vm, i);
 		switch (cmd.code) {
 		case CMD_COPY:
-			printf("%-10s", "copy");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "copy");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_ASSIGN:
-			printf("%-10s", "assign");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10s", "-");
+		case CMD_ASSIGN_INT:
+		case CMD_ASSIGN_FLOAT:
+		case CMD_ASSIGN_INT_FROM_FLOAT:
+		case CMD_ASSIGN_FLOAT_FROM_INT:
+			fprintf(out, "%-10s", vm_command_name(cmd.code));
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_SET_BYTE:
-			printf("%-10s", "set_byte");
-			printf(" %10ld", cmd.addr);
-			printf(" %10d", cmd.byte_arg);
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "set_byte");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10d", cmd.byte_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_SET_UINT:
-			printf("%-10s", "set_uint");
-			printf(" %10ld", cmd.addr);
-			printf(" %10lu", cmd.uint_arg);
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "set_uint");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10lu", cmd.uint_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_SET_INT:
-			printf("%-10s", "set_int");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.int_arg);
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "set_int");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.int_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_SET_FLOAT:
-			printf("%-10s", "set_float");
-			printf(" %10ld", cmd.addr);
-			printf(" %10f", cmd.float_arg);
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "set_float");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10f", cmd.float_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_ADD:
-			printf("%-10s", "add");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "add");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_SUB:
-			printf("%-10s", "sub");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "sub");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_MULT:
-			printf("%-10s", "mult");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "mult");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_DIV:
-			printf("%-10s", "div");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "div");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_AND:
-			printf("%-10s", "and");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "and");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_OR:
-			printf("%-10s", "or");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "or");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_XOR:
-			printf("%-10s", "xor");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "xor");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_NOT:
-			printf("%-10s", "not");
-			printf(" %10ld", cmd.addr);
-			printf(" %10s", "-");
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "not");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_GREATER:
-			printf("%-10s", "greater");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "greater");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_LESS:
-			printf("%-10s", "less");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "less");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_EQUAL:
-			printf("%-10s", "equal");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "equal");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_NEQUAL:
-			printf("%-10s", "nequal");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "nequal");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_GEQ:
-			printf("%-10s", "geq");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "geq");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_LEQ:
-			printf("%-10s", "leq");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "leq");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_RSHIFT:
-			printf("%-10s", "rshift");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "rshift");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_LSHIFT:
-			printf("%-10s", "lshift");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10ld", cmd.raddr);
+			fprintf(out, "%-10s", "lshift");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		case CMD_JUMP:
-			printf("%-10s", "jump");
-			printf(" %10ld", cmd.addr);
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "jump");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_JCOND:
-			printf("%-10s", "jcond");
-			printf(" %10ld", cmd.addr);
-			printf(" %10ld", cmd.addr_arg);
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "jcond");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_POP:
-			printf("%-10s", "pop");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "pop");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_PUSH:
-			printf("%-10s", "push");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "push");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			break;
+		case CMD_ENTER:
+			fprintf(out, "%-10s", "enter");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			break;
+		case CMD_LEAVE:
+			fprintf(out, "%-10s", "leave");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_STACK:
-			printf("%-10s", "stack");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "stack");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_EXIT:
-			printf("%-10s", "exit");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+		case CMD_YIELD:
+			fprintf(out, "%-10s", vm_command_name(cmd.code));
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_COMMANDS:
-			printf("%-10s", "commands");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "commands");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_PRINT:
-			printf("%-10s", "print");
-			printf(" %10ld", cmd.addr);
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "print");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
 			break;
 		case CMD_SET_SLEN:
-			printf("%-10s", "set_slen");
-			printf(" %10ld", cmd.addr);
-			printf(" %10s", "-");
-			printf(" %10s", "-");
+			fprintf(out, "%-10s", "set_slen");
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10s", "-");
+			fprintf(out, " %10s", "-");
+			break;
+		case CMD_JNOT_GREATER:
+		case CMD_JNOT_LESS:
+		case CMD_JNOT_EQUAL:
+		case CMD_JNOT_NEQUAL:
+		case CMD_JNOT_GEQ:
+		case CMD_JNOT_LEQ:
+		case CMD_ADD_INT_INT:
+		case CMD_ADD_FLOAT_FLOAT:
+		case CMD_SUB_INT_INT:
+		case CMD_SUB_FLOAT_FLOAT:
+		case CMD_MULT_INT_INT:
+		case CMD_MULT_FLOAT_FLOAT:
+		case CMD_DIV_INT_INT:
+		case CMD_DIV_FLOAT_FLOAT:
+		case CMD_GREATER_INT_INT:
+		case CMD_GREATER_FLOAT_FLOAT:
+		case CMD_LESS_INT_INT:
+		case CMD_LESS_FLOAT_FLOAT:
+		case CMD_EQUAL_INT_INT:
+		case CMD_EQUAL_FLOAT_FLOAT:
+		case CMD_NEQUAL_INT_INT:
+		case CMD_NEQUAL_FLOAT_FLOAT:
+		case CMD_GEQ_INT_INT:
+		case CMD_GEQ_FLOAT_FLOAT:
+		case CMD_LEQ_INT_INT:
+		case CMD_LEQ_FLOAT_FLOAT:
+		case CMD_ADD_INT:
+		case CMD_ADD_FLOAT:
+		case CMD_SUB_INT:
+		case CMD_SUB_FLOAT:
+		case CMD_MULT_INT:
+		case CMD_MULT_FLOAT:
+		case CMD_DIV_INT:
+		case CMD_DIV_FLOAT:
+		case CMD_GREATER_INT:
+		case CMD_GREATER_FLOAT:
+		case CMD_LESS_INT:
+		case CMD_LESS_FLOAT:
+		case CMD_EQUAL_INT:
+		case CMD_EQUAL_FLOAT:
+		case CMD_NEQUAL_INT:
+		case CMD_NEQUAL_FLOAT:
+		case CMD_GEQ_INT:
+		case CMD_GEQ_FLOAT:
+		case CMD_LEQ_INT:
+		case CMD_LEQ_FLOAT:
+		case CMD_JNOT_GREATER_INT:
+		case CMD_JNOT_GREATER_FLOAT:
+		case CMD_JNOT_LESS_INT:
+		case CMD_JNOT_LESS_FLOAT:
+		case CMD_JNOT_EQUAL_INT:
+		case CMD_JNOT_EQUAL_FLOAT:
+		case CMD_JNOT_NEQUAL_INT:
+		case CMD_JNOT_NEQUAL_FLOAT:
+		case CMD_JNOT_GEQ_INT:
+		case CMD_JNOT_GEQ_FLOAT:
+		case CMD_JNOT_LEQ_INT:
+		case CMD_JNOT_LEQ_FLOAT:
+		case CMD_CALL_NATIVE:
+			fprintf(out, "%-10s", vm_command_name(cmd.code));
+			fprintf(out, " %10ld", cmd.addr);
+			fprintf(out, " %10ld", cmd.addr_arg);
+			fprintf(out, " %10ld", cmd.raddr);
 			break;
 		}
-		printf("\n");
+		fprintf(out, "\n");
 	}
-	if (vm->cmd_ptr == vm->commands->length)
-		printf(">\n");
-	printf("Total: %lu\n", vm->commands->length);
+	if (vm->cmd_ptr == vm->program->commands->length)
+		fprintf(out, ">\n");
+	fprintf(out, "Total: %lu\n", vm->program->commands->length);
 }
 
 void vm_register_dump(VM *vm, Addr addr) {
 	if (addr >= 0 && addr < vm->stack->length) {
-		Register reg = vm_get(vm, addr);
-		printf("#%li: ", addr);
-		switch (reg.type) {
-		case TYPE_BYTE:
-			printf("(byte) %d\n", reg.byte_value);
-			break;
-		case TYPE_UINT:
-			printf("(uint) %lu\n", reg.uint_value);
-			break;
-		case TYPE_INT:
-			printf("(int) %ld\n", reg.int_value);
-			break;
-		case TYPE_FLOAT:
-			printf("(float) %f\n", reg.float_value);
-			break;
-		default:
-			printf("default\n");
-			break;
-		}
+		Register reg = vm_load(vm, addr);
+		vm_op_value_dump(vm->out, addr, &reg);
 	}
 	else {
-		printf("Out of stack\n");
+		fprintf(vm->out, "Out of stack\n");
 	}
 }
 
 Addr vm_get_addr(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg.addr_value;
+	return vm_load(vm, index).addr_value;
 }
 
 Byte vm_get_byte(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg.byte_value;
+	return vm_load(vm, index).byte_value;
 }
 
 UInt vm_get_uint(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg.uint_value;
+	return vm_load(vm, index).uint_value;
 }
 
 Int vm_get_int(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg.int_value;
+	return vm_load(vm, index).int_value;
 }
 
 Float vm_get_float(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg.float_value;
+	return vm_load(vm, index).float_value;
 }
 
 void *vm_get_ptr(VM *vm, Addr index) {
-	Register reg;
-	array_get(vm->stack, index, &reg);
-	return reg.ptr_value;
+	return vm_load(vm, index).ptr_value;
 }
@@ -1,8 +1,11 @@
 #ifndef __VM_H__
 #define __VM_H__
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <assert.h>
+#include <string.h>
 #include "array.h"
 #include "types.h"
 
@@ -51,6 +54,83 @@ enum CommandCode {
 	CMD_EXIT = 32,		// Exit the program.
 
 	CMD_SET_SLEN = 33,	// Set to addr the current size of the stack.
+
+	// Quickened commands. In quickening mode the machine rewrites a generic command to one of
+	// these the first time it runs, according to the types of its operands. They have the same
+	// arguments as the generic command and turn back into it if the operand types change.
+	CMD_ADD_INT_INT = 34,
+	CMD_ADD_FLOAT_FLOAT = 35,
+	CMD_SUB_INT_INT = 36,
+	CMD_SUB_FLOAT_FLOAT = 37,
+	CMD_MULT_INT_INT = 38,
+	CMD_MULT_FLOAT_FLOAT = 39,
+	CMD_DIV_INT_INT = 40,
+	CMD_DIV_FLOAT_FLOAT = 41,
+	CMD_GREATER_INT_INT = 42,
+	CMD_GREATER_FLOAT_FLOAT = 43,
+	CMD_LESS_INT_INT = 44,
+	CMD_LESS_FLOAT_FLOAT = 45,
+	CMD_EQUAL_INT_INT = 46,
+	CMD_EQUAL_FLOAT_FLOAT = 47,
+	CMD_NEQUAL_INT_INT = 48,
+	CMD_NEQUAL_FLOAT_FLOAT = 49,
+	CMD_GEQ_INT_INT = 50,
+	CMD_GEQ_FLOAT_FLOAT = 51,
+	CMD_LEQ_INT_INT = 52,
+	CMD_LEQ_FLOAT_FLOAT = 53,
+
+	// Fused compare-and-branch commands, emitted by the compiler for relational conditions.
+	CMD_JNOT_GREATER = 54,	// Jump to raddr unless addr > addr_arg.
+	CMD_JNOT_LESS = 55,		// Jump to raddr unless addr < addr_arg.
+	CMD_JNOT_EQUAL = 56,	// Jump to raddr unless addr == addr_arg.
+	CMD_JNOT_NEQUAL = 57,	// Jump to raddr unless addr != addr_arg.
+	CMD_JNOT_GEQ = 58,		// Jump to raddr unless addr >= addr_arg.
+	CMD_JNOT_LEQ = 59,		// Jump to raddr unless addr <= addr_arg.
+
+	// Frame commands, emitted by the compiler at block boundaries.
+	CMD_ENTER = 60,		// Grow the stack by addr values, left undefined.
+	CMD_LEAVE = 61,		// Shrink the stack by addr values.
+
+	// Typed commands, emitted by the compiler when it knows the types of the operands. They have
+	// the same arguments as the generic command but do not check the types of the operands.
+	CMD_ADD_INT = 62,
+	CMD_ADD_FLOAT = 63,
+	CMD_SUB_INT = 64,
+	CMD_SUB_FLOAT = 65,
+	CMD_MULT_INT = 66,
+	CMD_MULT_FLOAT = 67,
+	CMD_DIV_INT = 68,
+	CMD_DIV_FLOAT = 69,
+	CMD_GREATER_INT = 70,
+	CMD_GREATER_FLOAT = 71,
+	CMD_LESS_INT = 72,
+	CMD_LESS_FLOAT = 73,
+	CMD_EQUAL_INT = 74,
+	CMD_EQUAL_FLOAT = 75,
+	CMD_NEQUAL_INT = 76,
+	CMD_NEQUAL_FLOAT = 77,
+	CMD_GEQ_INT = 78,
+	CMD_GEQ_FLOAT = 79,
+	CMD_LEQ_INT = 80,
+	CMD_LEQ_FLOAT = 81,
+	CMD_JNOT_GREATER_INT = 82,
+	CMD_JNOT_GREATER_FLOAT = 83,
+	CMD_JNOT_LESS_INT = 84,
+	CMD_JNOT_LESS_FLOAT = 85,
+	CMD_JNOT_EQUAL_INT = 86,
+	CMD_JNOT_EQUAL_FLOAT = 87,
+	CMD_JNOT_NEQUAL_INT = 88,
+	CMD_JNOT_NEQUAL_FLOAT = 89,
+	CMD_JNOT_GEQ_INT = 90,
+	CMD_JNOT_GEQ_FLOAT = 91,
+	CMD_JNOT_LEQ_INT = 92,
+	CMD_JNOT_LEQ_FLOAT = 93,
+	CMD_ASSIGN_INT = 94,				// Assign an int to an int.
+	CMD_ASSIGN_FLOAT = 95,			// Assign a float to a float.
+	CMD_ASSIGN_INT_FROM_FLOAT = 96,	// Assign a float to an int, truncating it.
+	CMD_ASSIGN_FLOAT_FROM_INT = 97,	// Assign an int to a float.
+	CMD_CALL_NATIVE = 98,			// Call native function addr_arg with the arguments from addr on. Result to raddr. See native.h.
+	CMD_YIELD = 99,					// Suspend vm_resume and vm_run_slice here. Does nothing under vm_run.
 };
 // and, or, xor, not, compare
 
@@ -66,6 +146,10 @@ enum RegisterType {
 	TYPE_ADDR = 6
 };
 
+/**
+ * A command with its arguments, as it is given to vm_push_cmd and vm_execute. The machine stores
+ * commands encoded (see Operands below); use vm_get_cmd and vm_set_cmd to read and change them.
+ */
 typedef struct Command {
 	Byte code;				// Command code in CommandCode enum.
 	Addr addr;				// The first argument. An address.
@@ -81,6 +165,26 @@ typedef struct Command {
 } Command;
 
 
+/**
+ * Encoded arguments of a command. Command codes are kept in one array and their operands in another
+ * array at the same index, so the code stream is one byte per command and the operands twelve.
+ * Addresses are 32 bits. The literal of CMD_SET_BYTE is stored in arg; the literals of
+ * CMD_SET_INT, CMD_SET_UINT and CMD_SET_FLOAT are stored in the constant pool and arg is their index.
+ */
+typedef struct Operands {
+	int32_t addr;			// Command.addr.
+	int32_t arg;			// Command.addr_arg, a byte literal or an index in the constant pool.
+	int32_t raddr;			// Command.raddr.
+} Operands;
+
+// A literal value in the constant pool.
+typedef union Constant {
+	UInt uint_value;
+	Int int_value;
+	Float float_value;
+} Constant;
+
+
 typedef struct Register {
 	uint8_t type;			// The type of the variable in RegisterType enum.
 	union {					// The value of the variable.
@@ -93,6 +197,171 @@ typedef struct Register {
 	};
 } Register;
 
+// The value of a register without its type, as the stack stores it when compiled with VM_SOA_STACK.
+typedef union Value {
+	Addr addr_value;
+	void *ptr_value;
+	Byte byte_value;
+	UInt uint_value;
+	Int int_value;
+	Float float_value;
+} Value;
+
+
+/**
+ * Layouts of the stack. By default the stack is an array of Register, and VM_REGISTER_STACK is
+ * defined. Compile with VM_SOA_STACK or VM_NAN_BOXING for one of the packed layouts below.
+ */
+#if defined(VM_SOA_STACK) && defined(VM_NAN_BOXING)
+#error "VM_SOA_STACK and VM_NAN_BOXING are alternative stack layouts"
+#endif
+#if !defined(VM_SOA_STACK) && !defined(VM_NAN_BOXING)
+#define VM_REGISTER_STACK
+#endif
+
+#ifdef VM_NAN_BOXING
+/**
+ * NaN boxing. Each register is a 64-bit word. A float is stored as itself. Any other value is
+ * stored in the payload of a negative quiet NaN that no float operation produces: the top 13 bits
+ * set, a tag in the next 3 bits and the value in the low 48 bits. Tag 0 is left to the float NaN
+ * 0xfff8000000000000, and float NaNs that would look boxed are stored as that one.
+ *
+ * Ints, uints and addresses that do not fit in 48 bits, and pointers above 48 bits, are stored
+ * whole in the side table of the machine, at the same address as the register, and the register
+ * is boxed as VM_BOX_WIDE with the type in its payload. Registers of any other type keep only
+ * their type.
+ */
+#define VM_BOX_MIN 0xfff9000000000000UL		// Every boxed word is at least this; every float is below.
+#define VM_BOX_FLOAT_NAN 0xfff8000000000000UL	// Float NaNs that would look boxed are stored as this.
+#define VM_BOX_PAYLOAD 0x0000ffffffffffffUL	// The value bits of a boxed word.
+
+enum VMBoxTag {
+	VM_BOX_INT = 1,			// A 48-bit signed int.
+	VM_BOX_UINT = 2,		// A 48-bit uint.
+	VM_BOX_BYTE = 3,		// A byte.
+	VM_BOX_ADDR = 4,		// A 48-bit signed address.
+	VM_BOX_PTR = 5,			// A 48-bit pointer.
+	VM_BOX_OTHER = 6,		// An undefined register. The payload is its type.
+	VM_BOX_WIDE = 7,		// A value in the side table. The payload is its type.
+};
+
+static inline uint64_t vm_box_word(uint64_t tag, uint64_t payload) {
+	return 0xfff8000000000000UL | tag << 48 | (payload & VM_BOX_PAYLOAD);
+}
+
+// The tag of a boxed word. Floats give 0 or a number above every tag.
+static inline uint64_t vm_box_tag(uint64_t bits) {
+	return (bits >> 48) - 0xfff8;
+}
+
+// True if the signed value survives being cut to 48 bits.
+static inline int vm_box_fits(Int value) {
+	return ((Int) ((UInt) value << 16) >> 16) == value;
+}
+
+// Encode a register. Values that do not fit go to *wide.
+static inline uint64_t vm_box(Register reg, uint64_t *wide) {
+	uint64_t bits;
+	switch (reg.type) {
+	case TYPE_FLOAT:
+		memcpy(&bits, &reg.float_value, sizeof(bits));
+		return bits < VM_BOX_MIN ? bits : VM_BOX_FLOAT_NAN;
+	case TYPE_INT:
+		if (vm_box_fits(reg.int_value))
+			return vm_box_word(VM_BOX_INT, reg.int_value);
+		break;
+	case TYPE_UINT:
+		if (reg.uint_value <= VM_BOX_PAYLOAD)
+			return vm_box_word(VM_BOX_UINT, reg.uint_value);
+		break;
+	case TYPE_BYTE:
+		return vm_box_word(VM_BOX_BYTE, reg.byte_value);
+	case TYPE_ADDR:
+		if (vm_box_fits(reg.addr_value))
+			return vm_box_word(VM_BOX_ADDR, reg.addr_value);
+		break;
+	case TYPE_PTR:
+		if ((uintptr_t) reg.ptr_value <= VM_BOX_PAYLOAD)
+			return vm_box_word(VM_BOX_PTR, (uintptr_t) reg.ptr_value);
+		break;
+	default:
+		return vm_box_word(VM_BOX_OTHER, reg.type);
+	}
+	*wide = reg.uint_value;
+	return vm_box_word(VM_BOX_WIDE, reg.type);
+}
+
+// Decode a register. wide is its entry in the side table.
+static inline Register vm_unbox(uint64_t bits, const uint64_t *wide) {
+	Register reg;
+	if (bits < VM_BOX_MIN) {
+		reg.type = TYPE_FLOAT;
+		memcpy(&reg.float_value, &bits, sizeof(bits));
+		return reg;
+	}
+	uint64_t payload = bits & VM_BOX_PAYLOAD;
+	switch (vm_box_tag(bits)) {
+	case VM_BOX_INT:
+		reg.type = TYPE_INT;
+		reg.int_value = (Int) (payload << 16) >> 16;
+		break;
+	case VM_BOX_UINT:
+		reg.type = TYPE_UINT;
+		reg.uint_value = payload;
+		break;
+	case VM_BOX_BYTE:
+		reg.type = TYPE_BYTE;
+		reg.uint_value = payload;
+		break;
+	case VM_BOX_ADDR:
+		reg.type = TYPE_ADDR;
+		reg.addr_value = (Addr) (payload << 16) >> 16;
+		break;
+	case VM_BOX_PTR:
+		reg.type = TYPE_PTR;
+		reg.ptr_value = (void *) (uintptr_t) payload;
+		break;
+	case VM_BOX_WIDE:
+		reg.type = payload;
+		reg.uint_value = *wide;
+		break;
+	default:
+		reg.type = payload;
+		reg.uint_value = 0;
+		break;
+	}
+	return reg;
+}
+#endif
+
+
+/**
+ * Execution engines. vm_run dispatches to one of them according to the engine field of the machine.
+ */
+enum VMEngine {
+	ENGINE_SWITCH = 0,		// Copy each command out of the list and run it through vm_execute.
+	ENGINE_THREADED = 1,	// Threaded dispatch directly over the command buffer (computed goto where available).
+};
+
+/**
+ * Where vm_run, vm_resume and vm_run_slice stopped. vm_run runs to the end unless it fails.
+ */
+enum VMStatus {
+	VM_FINISHED = 0,		// The program ran to its end or exited.
+	VM_YIELDED = 1,			// The program ran a yield command. Run it again to go on after it.
+	VM_EXHAUSTED = 2,		// The budget ran out. Run it again to go on where it stopped.
+	VM_FAILED = 3,			// An enter or push command could not grow the stack, or a leave found it too short. The
+							// command pointer is left at that command; see vm_failure.
+};
+
+/**
+ * How the threaded engine compiles hot loops to native code (see jit.h).
+ */
+enum VMJit {
+	JIT_OFF = 0,			// Interpret everything.
+	JIT_TEMPLATE = 1,		// Compile the commands of the loop, one template each.
+	JIT_TRACE = 2,			// Record one iteration of the loop and compile that path.
+};
 
 /**
  * The virtual machine, which has variable memory, a list of commands and a pointer
@@ -101,14 +370,59 @@ typedef struct Register {
  * Create a new virtual machine with vm_new and delete it with vm_delete.
  * Add a command to the machine with vm_push_cmd.
  * Alternatively, use the vm_push_cmd_* to push specific commands to the vm without messing with the structures.
- * Run the machine with vm_execute.
+ * Run the machine with vm_run, which uses the engine selected in the engine field.
  * Clear the commands with vm_clear_commands.
+ *
+ * The stack is an array of Register by default. Compiled with VM_SOA_STACK it is split in two
+ * arrays instead: stack holds the values (an array of Value) and types the type of each value
+ * (an array of Byte), so the values are packed eight bytes apart. Compiled with VM_NAN_BOXING
+ * each register is one NaN-boxed word (see above). In any layout, read and write the stack
+ * through vm_load and vm_store, and size it through vm_push, vm_pop, vm_enter and vm_leave.
+ * The JIT needs the default layout.
+ *
+ * The commands are kept in a Program, which the machine owns while it is being compiled. Take it
+ * with vm_take_program to share it: from then on the program does not change, and any number of
+ * machines made with vm_new_context run it at the same time, each with its own stack and command
+ * pointer, from any thread. Machines running a shared program do not quicken it.
  * 
  */
+struct Jit;
+
+typedef struct Program {
+	Array *commands;	// The codes of the commands to execute. An array of Byte.
+	Array *operands;	// The arguments of the commands, at the same index as their codes. An array of Operands.
+	Array *constants;	// The constant pool, with the literals of set commands. An array of Constant.
+	Array *stack;		// The stack each context starts with, in the layout of the machine. NULL until the program is taken.
+#ifdef VM_SOA_STACK
+	Array *types;		// The types of the values in stack.
+#endif
+#ifdef VM_NAN_BOXING
+	Array *wide;		// The side table of stack.
+#endif
+	Array *natives;		// The native functions the commands call, by index. An array of Native. Not owned.
+	Addr cmd_ptr;		// The command each context starts from.
+	Byte shared;		// If true, the program was taken and must not change.
+} Program;
+
+#define VM_CONTEXT_STACK 256	// Registers a context can grow its stack by before the stack moves out of its block.
+
 typedef struct VM {
-	Addr cmd_ptr;		// The current point of execution. Points to an element in commands.
-	Array *commands;	// The list of commands to execute. An array of Command objects.
-	Array *stack;		// The memory of the machine. An array of Register objects.
+	Addr cmd_ptr;		// The current point of execution. Points to an element in the commands of program.
+	Program *program;	// The commands the machine runs.
+	Array *stack;		// The memory of the machine. An array of Register objects, of Value with VM_SOA_STACK or of uint64_t with VM_NAN_BOXING.
+#ifdef VM_SOA_STACK
+	Array *types;		// The types of the values in stack. An array of Byte.
+#endif
+#ifdef VM_NAN_BOXING
+	Array *wide;		// Values too wide to box, at the address of their register. An array of uint64_t.
+#endif
+	Byte engine;		// The engine used by vm_run, in VMEngine enum.
+	Byte quicken;		// If true, rewrite generic commands to their quickened variants as they run.
+	Byte jit;			// How the threaded engine compiles hot loops, in VMJit enum.
+	struct Jit *jit_state;	// Native code and loop counters, created on the first backward jump.
+	FILE *out;			// Where the print, stack and commands commands write. stdout by default.
+	Byte owns_program;	// If true, program is deleted with the machine.
+	Byte context;		// If true, the machine was made by vm_new_context, in one block with its stack.
 } VM;
 
 
@@ -117,11 +431,54 @@ typedef struct VM {
 VM *vm_new();
 void vm_delete(VM *vm);
 
+Program *program_new();
+void program_delete(Program *program);	// Delete the program. The machines running it must be deleted first.
+
+// Take the program out of the machine, with a copy of the stack and command pointer of the machine
+// to start contexts from. The machine keeps running the program but no longer owns it.
+// Return NULL if the machine does not own its program or if it could not be copied.
+Program *vm_take_program(VM *vm);
+
+// A machine that runs a taken program, made in one allocation. Its stack starts as the stack of
+// the program; delete it with vm_delete, which leaves the program alone.
+VM *vm_new_context(Program *program);
+
+// Put a context back to the start of its program: the stack of the program and its first command.
+// Return 0 on success.
+int vm_restart(VM *vm);
+
 int vm_run(VM *vm);
+
+// Run the machine as a coroutine: from the command pointer up to the next yield command or the
+// end. Return VM_YIELDED, VM_FINISHED or VM_FAILED. The stack and the command pointer are the state of the
+// coroutine and stay in the machine, so resuming it again goes on after the yield with nothing
+// copied or set up again.
+int vm_resume(VM *vm);
+
+// Run about budget commands from the command pointer, stopping early after a yield command.
+// Return a VMStatus; run it again to resume where it stopped. The threaded engine checks the
+// budget at jumps only, so a slice may run on to the next jump. Hot loops are not compiled to
+// native code while running a slice, as native code does not count commands.
+int vm_run_slice(VM *vm, long budget);
+
+// Why the machine stopped with VM_FAILED, as a sentence to show the user: the stack was too short
+// for the frame of a leave, or it could not grow.
+const char *vm_failure(VM *vm);
+int vm_run_switch(VM *vm);
+int vm_run_threaded(VM *vm);
 Addr vm_execute(VM *vm, Command cmd);
 Addr vm_push_cmd(VM *vm, Command cmd);
+Command vm_get_cmd(VM *vm, Addr index);
+// Replace the command at index. Return 0, or -1 if it could not be encoded and the old command was
+// left in place.
+int vm_set_cmd(VM *vm, Addr index, Command cmd);
+void vm_truncate_commands(VM *vm, Addr length);
 void vm_clear_commands(VM *vm);
 
+// Empty the commands, constants and stack of a machine that owns its program, so it can be used
+// again as if new. The arrays keep their memory, and commands attached from an image are dropped.
+void vm_reset(VM *vm);
+
 // The following vm_push_cmd_* functions are there to help push commands to the machine.
 // Parameters addr, addr_arg and raddr are absolute addresses and refer to the stack.
 // Returns the pushed command's index in the commands list.
@@ -141,9 +498,16 @@ Addr vm_push_cmd_div(VM *vm, Addr addr, Addr addr_arg, Addr raddr);
 
 Addr vm_push_cmd_jump(VM *vm, Addr addr);
 Addr vm_push_cmd_jcond(VM *vm, Addr addr, Addr addr_arg); 
+Addr vm_push_cmd_jnot(VM *vm, Byte relation, Addr addr, Addr addr_arg, Addr raddr);	// relation is CMD_GREATER to CMD_LEQ.
+
+// Set the target of the jump command at index, whichever argument holds it. Return 0, or -1 as
+// vm_set_cmd does.
+int vm_set_jump_target(VM *vm, Addr index, Addr target);
 
 Addr vm_push_cmd_push(VM *vm);
 Addr vm_push_cmd_pop(VM *vm);
+Addr vm_push_cmd_enter(VM *vm, Addr size);
+Addr vm_push_cmd_leave(VM *vm, Addr size);
 
 Addr vm_push_cmd_and(VM *vm, Addr addr, Addr addr_arg, Addr raddr);
 Addr vm_push_cmd_or(VM *vm, Addr addr, Addr addr_arg, Addr raddr);
@@ -165,19 +529,29 @@ Addr vm_push_cmd_print(VM *vm, Addr addr);
 Addr vm_push_cmd_exit(VM *vm);
 
 Addr vm_push_cmd_set_slen(VM *vm, Addr addr);
+Addr vm_push_cmd_yield(VM *vm);
+Addr vm_push_cmd_call_native(VM *vm, Addr args, Addr index, Addr raddr);	// index in the natives of the program.
 
 // Private functions:
 
 // Tranforms negative (relative) addr in absolute addr in the stack.
 #define VM_ABS_ADDR(vm, addr) {if (addr < 0) return vm->stack->length + addr; else return addr;}
 
+Byte vm_quicken(VM *vm, Addr index);
+Byte vm_generic_code(Byte code);	// generic command of a quickened or typed command, or code itself.
+Byte vm_typed_code(Byte code, Byte ltype, Byte rtype);	// typed variant of a generic command for its operand types, or 0.
+const char *vm_command_name(Byte code);
+
 void vm_stack_dump(VM *vm);
 void vm_commands_dump(VM *vm);
+void vm_commands_fdump(VM *vm, FILE *out);	// like vm_commands_dump, to out.
 void vm_register_dump(VM *vm, Addr addr);
 
 void vm_assign(VM *vm, Addr lval_addr, Addr rval_addr);
 
 Addr vm_push(VM *vm);
+Addr vm_enter(VM *vm, Addr size);	// grow the stack by size values. Return the new length, or -1 if memory ran out.
+Addr vm_leave(VM *vm, Addr size);	// shrink the stack by size values. Return the new length, or -1 if it is shorter.
 Addr vm_push_byte(VM *vm, Byte value);
 Addr vm_push_int(VM *vm, Int value);
 Addr vm_push_uint(VM *vm, UInt value);
@@ -194,6 +568,7 @@ Addr vm_mult(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr);
 Addr vm_div(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr);
 Addr vm_jump(VM *vm, Addr addr);
 Addr vm_jcond(VM *vm, Addr true_cmd_addr, Addr bool_addr);
+Addr vm_jnot(VM *vm, Byte relation, Addr lval_addr, Addr rval_addr, Addr cmd_addr);
 Addr vm_and(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr);
 Addr vm_or(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr);
 Addr vm_xor(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr);
@@ -211,6 +586,147 @@ Addr vm_leq(VM *vm, Addr lval_addr, Addr rval_addr, Addr raddr);
 Addr vm_set_slen(VM *vm, Addr addr);
 
 Register vm_pop(VM *vm);
+
+// Read and write the register in absolute address, whatever the layout of the stack.
+// vm_copy copies the register in from_addr to addr.
+// Compile with VM_DEBUG to check the address against the stack length.
+#if defined(VM_SOA_STACK)
+static inline Register vm_load(VM *vm, Addr addr) {
+#ifdef VM_DEBUG
+	assert(addr < vm->stack->length);
+#endif
+	Register reg;
+	reg.type = ((Byte *) vm->types->heap)[addr];
+	reg.uint_value = ((Value *) vm->stack->heap)[addr].uint_value;
+	return reg;
+}
+
+static inline void vm_store(VM *vm, Addr addr, Register reg) {
+#ifdef VM_DEBUG
+	assert(addr < vm->stack->length);
+#endif
+	((Byte *) vm->types->heap)[addr] = reg.type;
+	((Value *) vm->stack->heap)[addr].uint_value = reg.uint_value;
+}
+
+static inline void vm_copy(VM *vm, Addr addr, Addr from_addr) {
+	vm_store(vm, addr, vm_load(vm, from_addr));
+}
+#elif defined(VM_NAN_BOXING)
+static inline Register vm_load(VM *vm, Addr addr) {
+#ifdef VM_DEBUG
+	assert(addr < vm->stack->length);
+#endif
+	return vm_unbox(((uint64_t *) vm->stack->heap)[addr], (uint64_t *) vm->wide->heap + addr);
+}
+
+static inline void vm_store(VM *vm, Addr addr, Register reg) {
+#ifdef VM_DEBUG
+	assert(addr < vm->stack->length);
+#endif
+	((uint64_t *) vm->stack->heap)[addr] = vm_box(reg, (uint64_t *) vm->wide->heap + addr);
+}
+
+static inline void vm_copy(VM *vm, Addr addr, Addr from_addr) {
+	uint64_t bits = ((uint64_t *) vm->stack->heap)[from_addr];
+	if (vm_box_tag(bits) == VM_BOX_WIDE)
+		((uint64_t *) vm->wide->heap)[addr] = ((uint64_t *) vm->wide->heap)[from_addr];
+	((uint64_t *) vm->stack->heap)[addr] = bits;
+}
+#else
+// Pointer to the register in absolute address, valid until the stack grows.
+// Reads and writes go straight to the stack without copying the register.
+static inline Register *vm_slot(VM *vm, Addr addr) {
+#ifdef VM_DEBUG
+	assert(addr < vm->stack->length);
+#endif
+	return (Register *) vm->stack->heap + addr;
+}
+
+static inline Register vm_load(VM *vm, Addr addr) {
+	return *vm_slot(vm, addr);
+}
+
+static inline void vm_store(VM *vm, Addr addr, Register reg) {
+	*vm_slot(vm, addr) = reg;
+}
+
+static inline void vm_copy(VM *vm, Addr addr, Addr from_addr) {
+	*vm_slot(vm, addr) = *vm_slot(vm, from_addr);
+}
+#endif
+
+// Fast paths for int and float registers. vm_load_int and vm_load_float return 1 and set *out if
+// the register has that type, otherwise they return 0. vm_store_int and vm_store_float set the
+// register to a value of that type.
+#ifdef VM_NAN_BOXING
+static inline int vm_load_int(VM *vm, Addr addr, Int *out) {
+	uint64_t bits = ((uint64_t *) vm->stack->heap)[addr];
+	uint64_t tag = vm_box_tag(bits);
+	if (tag == VM_BOX_INT) {
+		*out = (Int) (bits << 16) >> 16;
+		return 1;
+	}
+	if (tag != VM_BOX_WIDE)
+		return 0;
+	Register reg = vm_load(vm, addr);
+	*out = reg.int_value;
+	return reg.type == TYPE_INT;
+}
+
+static inline int vm_load_float(VM *vm, Addr addr, Float *out) {
+	uint64_t bits = ((uint64_t *) vm->stack->heap)[addr];
+	if (bits >= VM_BOX_MIN)
+		return 0;
+	memcpy(out, &bits, sizeof(bits));
+	return 1;
+}
+
+static inline void vm_store_int(VM *vm, Addr addr, Int value) {
+	if (vm_box_fits(value)) {
+		((uint64_t *) vm->stack->heap)[addr] = vm_box_word(VM_BOX_INT, value);
+	}
+	else {
+		Register reg;
+		reg.type = TYPE_INT;
+		reg.int_value = value;
+		vm_store(vm, addr, reg);
+	}
+}
+
+static inline void vm_store_float(VM *vm, Addr addr, Float value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	((uint64_t *) vm->stack->heap)[addr] = bits < VM_BOX_MIN ? bits : VM_BOX_FLOAT_NAN;
+}
+#else
+static inline int vm_load_int(VM *vm, Addr addr, Int *out) {
+	Register reg = vm_load(vm, addr);
+	*out = reg.int_value;
+	return reg.type == TYPE_INT;
+}
+
+static inline int vm_load_float(VM *vm, Addr addr, Float *out) {
+	Register reg = vm_load(vm, addr);
+	*out = reg.float_value;
+	return reg.type == TYPE_FLOAT;
+}
+
+static inline void vm_store_int(VM *vm, Addr addr, Int value) {
+	Register reg;
+	reg.type = TYPE_INT;
+	reg.int_value = value;
+	vm_store(vm, addr, reg);
+}
+
+static inline void vm_store_float(VM *vm, Addr addr, Float value) {
+	Register reg;
+	reg.type = TYPE_FLOAT;
+	reg.float_value = value;
+	vm_store(vm, addr, reg);
+}
+#endif
+
 Register vm_get(VM *vm, Addr index);	// get a register in absolute address.
 Register vm_reg(VM *vm, Addr index);	// get a register in relative address.
 
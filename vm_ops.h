@@ -0,0 +1,1474 @@
+#ifndef __VM_OPS_H__
+#define __VM_OPS_H__
+
+#include <stdio.h>
+#include "vm.h"
+
+/*
+ * Operations on register values, without the machine around them.
+ * The machine runs its commands with these, and programs compiled to C (see aot.h) include this
+ * header so they compute exactly what the machine does.
+ * Operands and result may be the same register.
+ */
+
+// Truth value of a register, as used by conditional jumps.
+static inline int vm_truth(const Register *reg) {
+	switch (reg->type) {
+	case TYPE_BYTE:  return reg->byte_value != 0;
+	case TYPE_UINT:  return reg->uint_value != 0;
+	case TYPE_INT:   return reg->int_value != 0;
+	case TYPE_FLOAT: return ((Int) reg->float_value) != 0;
+	default:         return 0;
+	}
+}
+
+// Rank of a numeric type for the purpose of promotion: byte < uint < int < float.
+static inline int vm_type_rank(Byte type) {
+	switch (type) {
+	case TYPE_BYTE:  return 1;
+	case TYPE_UINT:  return 2;
+	case TYPE_INT:   return 3;
+	case TYPE_FLOAT: return 4;
+	default:         return 0;
+	}
+}
+
+#define VM_AS(reg, c_type) (																\
+	(reg)->type == TYPE_BYTE ? (c_type) (reg)->byte_value :								\
+	(reg)->type == TYPE_UINT ? (c_type) (reg)->uint_value :								\
+	(reg)->type == TYPE_INT ? (c_type) (reg)->int_value :								\
+	(reg)->type == TYPE_FLOAT ? (c_type) (reg)->float_value : (c_type) 0)
+
+#define VM_RELATION(relation, a, b) (														\
+	(relation) == CMD_GREATER ? (a) > (b) :												\
+	(relation) == CMD_LESS ? (a) < (b) :												\
+	(relation) == CMD_EQUAL ? (a) == (b) :												\
+	(relation) == CMD_NEQUAL ? (a) != (b) :												\
+	(relation) == CMD_GEQ ? (a) >= (b) :												\
+	(relation) == CMD_LEQ ? (a) <= (b) : 0)
+
+/*
+ * Truth value of a comparison command (CMD_GREATER to CMD_LEQ) between two registers. Operands
+ * are promoted to the wider of their types, as the comparison commands do.
+ */
+static inline int vm_test(Byte relation, const Register *lval, const Register *rval) {
+	int rank = vm_type_rank(lval->type) > vm_type_rank(rval->type) ? vm_type_rank(lval->type) : vm_type_rank(rval->type);
+	switch (rank) {
+	case 1:  return VM_RELATION(relation, VM_AS(lval, Byte), VM_AS(rval, Byte));
+	case 2:  return VM_RELATION(relation, VM_AS(lval, UInt), VM_AS(rval, UInt));
+	case 3:  return VM_RELATION(relation, VM_AS(lval, Int), VM_AS(rval, Int));
+	case 4:  return VM_RELATION(relation, VM_AS(lval, Float), VM_AS(rval, Float));
+	default: return 0;
+	}
+}
+
+static inline void vm_op_add(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value + rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) + rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) + rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) + rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value + ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value + rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) + rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) + rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value + ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value + ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value + rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) + rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value + ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value + ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value + ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value + rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_sub(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value - rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) - rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) - rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) - rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value - ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value - rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) - rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) - rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value - ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value - ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value - rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) - rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value - ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value - ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value - ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value - rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_mult(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value * rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) * rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) * rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) * rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value * ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value * rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) * rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) * rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value * ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value * ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value * rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) * rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value * ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value * ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value * ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value * rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_div(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value / rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) / rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) / rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) / rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value / ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value / rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) / rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) / rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value / ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value / ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value / rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) / rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value / ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value / ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value / ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value / rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_and(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value & rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) & rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) & rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value & ((Byte) rval->float_value);
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value & ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value & rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) & rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value & (UInt) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value & ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value & ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value & rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value & (Int) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = ((Byte) lval->float_value) & rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->float_value = ((UInt) lval->float_value) & rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->float_value = ((Int) lval->float_value) & rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->float_value) & ((UInt) rval->float_value);
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_or(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value | rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) | rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) | rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value | ((Byte) rval->float_value);
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value | ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value | rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) | rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value | (UInt) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value | ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value | ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value | rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value | (Int) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = ((Byte) lval->float_value) | rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->float_value = ((UInt) lval->float_value) | rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->float_value = ((Int) lval->float_value) | rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->float_value) | ((UInt) rval->float_value);
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_xor(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value ^ rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) ^ rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) ^ rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value ^ ((Byte) rval->float_value);
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value ^ ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value ^ rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) ^ rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value ^ (UInt) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value ^ ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value ^ ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value ^ rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value ^ (Int) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = ((Byte) lval->float_value) ^ rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->float_value = ((UInt) lval->float_value) ^ rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->float_value = ((Int) lval->float_value) ^ rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->float_value) ^ ((UInt) rval->float_value);
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_rshift(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value << rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) << rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) << rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value << ((Byte) rval->float_value);
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value << ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value << rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) << rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value << (UInt) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value << ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value << ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value << rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value << (Int) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = ((Byte) lval->float_value) << rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->float_value = ((UInt) lval->float_value) << rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->float_value = ((Int) lval->float_value) << rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->float_value) << ((UInt) rval->float_value);
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_lshift(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value >> rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) >> rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) >> rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value >> ((Byte) rval->float_value);
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value >> ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value >> rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) >> rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value >> (UInt) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >> ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >> ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >> rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >> (Int) rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = ((Byte) lval->float_value) >> rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->float_value = ((UInt) lval->float_value) >> rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->float_value = ((Int) lval->float_value) >> rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->float_value) >> ((UInt) rval->float_value);
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_greater(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value > rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) > rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) > rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) > rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value > ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value > rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) > rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) > rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value > ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value > ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value > rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) > rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value > ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value > ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value > ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value > rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_less(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value < rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) < rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) < rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) < rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value < ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value < rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) < rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) < rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value < ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value < ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value < rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) < rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value < ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value < ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value < ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value < rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_equal(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value == rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) == rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) == rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) == rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value == ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value == rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) == rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) == rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value == ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value == ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value == rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) == rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value == ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value == ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value == ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value == rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_nequal(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value != rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) != rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) != rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) != rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value != ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value != rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) != rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) != rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value != ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value != ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value != rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) != rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value != ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value != ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value != ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value != rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_geq(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value >= rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) >= rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) >= rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) >= rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value >= ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value >= rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) >= rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) >= rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >= ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >= ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value >= rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) >= rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value >= ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value >= ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value >= ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value >= rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_leq(Register *result, const Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_BYTE;
+					result->byte_value = lval->byte_value <= rval->byte_value;
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = ((UInt) lval->byte_value) <= rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->byte_value) <= rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->byte_value) <= rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value <= ((Byte) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_UINT;
+					result->uint_value = lval->uint_value <= rval->uint_value;
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = ((Int) lval->uint_value) <= rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->uint_value) <= rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value <= ((Int) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value <= ((Int) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_INT;
+					result->int_value = lval->int_value <= rval->int_value;
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = ((Float) lval->int_value) <= rval->float_value;
+					break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value <= ((Float) rval->byte_value);
+					break;
+				case TYPE_UINT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value <= ((Float) rval->uint_value);
+					break;
+				case TYPE_INT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value <= ((Float) rval->int_value);
+					break;
+				case TYPE_FLOAT:
+					result->type = TYPE_FLOAT;
+					result->float_value = lval->float_value <= rval->float_value;
+					break;
+			}
+			break;
+	}
+
+}
+
+static inline void vm_op_not(Register *result, const Register *lval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			result->type = TYPE_BYTE;
+			result->byte_value = !lval->byte_value;
+			break;
+		case TYPE_UINT:
+			result->type = TYPE_UINT;
+			result->uint_value = !lval->uint_value;
+			break;
+		case TYPE_INT:
+			result->type = TYPE_INT;
+			result->int_value = !lval->int_value;
+			break;
+		case TYPE_FLOAT:
+			result->type = TYPE_UINT;
+			result->uint_value = !((UInt) lval->float_value);
+			break;
+	}
+
+}
+
+// Assign the value of rval to lval, converted to the type of lval.
+static inline void vm_op_assign(Register *lval, const Register *rval) {
+	switch (lval->type) {
+		case TYPE_BYTE:
+			switch (rval->type) {
+				case TYPE_BYTE:  lval->byte_value = rval->byte_value; break;
+				case TYPE_UINT:  lval->byte_value = (Byte) rval->uint_value; break;
+				case TYPE_INT:   lval->byte_value = (Byte) rval->int_value; break;
+				case TYPE_FLOAT: lval->byte_value = (Byte) rval->float_value; break;
+			}
+			break;
+		case TYPE_UINT:
+			switch (rval->type) {
+				case TYPE_BYTE:  lval->uint_value = (UInt) rval->byte_value; break;
+				case TYPE_UINT:  lval->uint_value = rval->uint_value; break;
+				case TYPE_INT:   lval->uint_value = (UInt) rval->int_value; break;
+				case TYPE_FLOAT: lval->uint_value = (UInt) rval->float_value; break;
+			}
+			break;
+		case TYPE_INT:
+			switch (rval->type) {
+				case TYPE_BYTE:  lval->int_value = (Int) rval->byte_value; break;
+				case TYPE_UINT:  lval->int_value = (Int) rval->uint_value; break;
+				case TYPE_INT:   lval->int_value = rval->int_value; break;
+				case TYPE_FLOAT: lval->int_value = (Int) rval->float_value; break;
+			}
+			break;
+		case TYPE_FLOAT:
+			switch (rval->type) {
+				case TYPE_BYTE:  lval->float_value = (Float) rval->byte_value; break;
+				case TYPE_UINT:  lval->float_value = (Float) rval->uint_value; break;
+				case TYPE_INT:   lval->float_value = (Float) rval->int_value; break;
+				case TYPE_FLOAT: lval->float_value = rval->float_value; break;
+			}
+			break;
+	}
+}
+
+// Print to out the register at index as a line of the stack command.
+static inline void vm_op_stack_line_dump(FILE *out, int index, const Register *reg) {
+	fprintf(out, "%4d: ", index);
+	switch (reg->type) {
+	case TYPE_BYTE:
+		fprintf(out, "(byte)     %10d\n", reg->byte_value);
+		break;
+	case TYPE_UINT:
+		fprintf(out, "(uint)     %10lu\n", reg->uint_value);
+		break;
+	case TYPE_INT:
+		fprintf(out, "(int)      %10ld\n", reg->int_value);
+		break;
+	case TYPE_FLOAT:
+		fprintf(out, "(float)    %10f\n", reg->float_value);
+		break;
+	default:
+		fprintf(out, "(undefined) \n");
+		break;
+	}
+}
+
+// Print to out the registers of a stack, as the stack command does.
+static inline void vm_op_stack_dump(FILE *out, const Register *stack, size_t length) {
+	for (int i = 0; i < length; i++)
+		vm_op_stack_line_dump(out, i, &stack[i]);
+	fprintf(out, "Total: %lu\n", length);
+}
+
+// Print to out the register at addr, as the print command does.
+static inline void vm_op_value_dump(FILE *out, Addr addr, const Register *reg) {
+	fprintf(out, "#%li: ", addr);
+	switch (reg->type) {
+	case TYPE_BYTE:
+		fprintf(out, "(byte) %d\n", reg->byte_value);
+		break;
+	case TYPE_UINT:
+		fprintf(out, "(uint) %lu\n", reg->uint_value);
+		break;
+	case TYPE_INT:
+		fprintf(out, "(int) %ld\n", reg->int_value);
+		break;
+	case TYPE_FLOAT:
+		fprintf(out, "(float) %f\n", reg->float_value);
+		break;
+	default:
+		fprintf(out, "default\n");
+		break;
+	}
+}
+
+// Print to out the register at addr of a stack, or that it is out of the stack.
+static inline void vm_op_register_dump(FILE *out, const Register *stack, size_t length, Addr addr) {
+	if (addr >= 0 && addr < length)
+		vm_op_value_dump(out, addr, &stack[addr]);
+	else
+		fprintf(out, "Out of stack\n");
+}
+
+#endif /* __VM_OPS_H__ */